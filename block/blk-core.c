@@ -39,6 +39,7 @@
 
 #include "blk.h"
 #include "blk-mq.h"
+#include "blk-wbt.h"
 
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_bio_remap);
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_rq_remap);
@@ -791,6 +792,9 @@ blk_init_allocated_queue(struct request_queue *q, request_fn_proc *rfn,
 
 	q->sg_reserved_size = INT_MAX;
 
+	blk_stat_init(&q->rq_stats[READ]);
+	blk_stat_init(&q->rq_stats[WRITE]);
+
 	/* Protect q->elevator from elevator_change */
 	mutex_lock(&q->sysfs_lock);
 
@@ -1406,6 +1410,8 @@ void __blk_put_request(struct request_queue *q, struct request *req)
 
 	elv_completed_request(q, req);
 
+	wbt_done(q->rq_wb, req);
+
 	/* this is a bio leak */
 	WARN_ON(req->bio != NULL);
 
@@ -1611,6 +1617,7 @@ static void blk_queue_bio(struct request_queue *q, struct bio *bio)
 	int el_ret, rw_flags, where = ELEVATOR_INSERT_SORT;
 	struct request *req;
 	unsigned int request_count = 0;
+	bool wb_acct;
 
 	/*
 	 * low level driver can indicate that it wants pages above a
@@ -1667,16 +1674,27 @@ get_rq:
 	if (sync)
 		rw_flags |= REQ_SYNC;
 
+	/*
+	 * Throttle buffered writeback before taking a request, so that it
+	 * can't use up the request pool either.  Drops the queue lock while
+	 * sleeping.
+	 */
+	wb_acct = wbt_wait(q->rq_wb, bio, q->queue_lock);
+
 	/*
 	 * Grab a free request. This is might sleep but can not fail.
 	 * Returns with the queue unlocked.
 	 */
 	req = get_request(q, rw_flags, bio, GFP_NOIO);
 	if (IS_ERR(req)) {
+		if (wb_acct)
+			__wbt_done(q->rq_wb);
 		bio_endio(bio, PTR_ERR(req));	/* @q is dead */
 		goto out_unlock;
 	}
 
+	wbt_track(req, wb_acct);
+
 	/*
 	 * After dropping the lock and possibly sleeping here, our request
 	 * may now be mergeable after it had proven unmergeable (above).
@@ -2412,6 +2430,9 @@ void blk_start_request(struct request *req)
 
 	BUG_ON(test_bit(REQ_ATOM_COMPLETE, &req->atomic_flags));
 	blk_add_timer(req);
+	req->issue_time_ns = ktime_get_ns();
+	req->issue_sectors = blk_rq_sectors(req);
+	wbt_issue(req->q->rq_wb, req);
 }
 EXPORT_SYMBOL(blk_start_request);
 
@@ -2636,6 +2657,10 @@ void blk_finish_request(struct request *req, int error)
 
 	blk_account_io_done(req);
 
+	if (req->issue_time_ns)
+		blk_stat_add(&req->q->rq_stats[rq_data_dir(req)], req,
+			     ktime_get_ns());
+
 	if (req->end_io)
 		req->end_io(req, error);
 	else {
@@ -185,6 +185,46 @@ static ssize_t blk_mq_hw_sysfs_run_show(struct blk_mq_hw_ctx *hctx, char *page)
 	return sprintf(page, "%lu\n", hctx->run);
 }
 
+static ssize_t blk_mq_hw_sysfs_poll_show(struct blk_mq_hw_ctx *hctx, char *page)
+{
+	return sprintf(page, "invoked=%lu, success=%lu, sleeps=%lu\n",
+		       hctx->poll_invoked, hctx->poll_success,
+		       hctx->poll_sleeps);
+}
+
+static ssize_t blk_mq_hw_sysfs_stat_show(struct blk_mq_hw_ctx *hctx, char *page)
+{
+	struct blk_rq_stat stat[2];
+
+	blk_hctx_stat_get(hctx, stat);
+	return blk_stat_show(stat, page);
+}
+
+static ssize_t blk_mq_hw_sysfs_stat_store(struct blk_mq_hw_ctx *hctx,
+					  const char *page, size_t count)
+{
+	blk_hctx_stat_clear(hctx);
+	return count;
+}
+
+static ssize_t blk_mq_hw_sysfs_stat_lat_show(struct blk_mq_hw_ctx *hctx,
+					     char *page)
+{
+	struct blk_rq_stat stat[2];
+
+	blk_hctx_stat_get(hctx, stat);
+	return blk_stat_lat_show(stat, page);
+}
+
+static ssize_t blk_mq_hw_sysfs_stat_size_show(struct blk_mq_hw_ctx *hctx,
+					      char *page)
+{
+	struct blk_rq_stat stat[2];
+
+	blk_hctx_stat_get(hctx, stat);
+	return blk_stat_size_show(stat, page);
+}
+
 static ssize_t blk_mq_hw_sysfs_dispatched_show(struct blk_mq_hw_ctx *hctx,
 					       char *page)
 {
@@ -299,6 +339,23 @@ static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_cpus = {
 	.attr = {.name = "cpu_list", .mode = S_IRUGO },
 	.show = blk_mq_hw_sysfs_cpus_show,
 };
+static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_poll = {
+	.attr = {.name = "io_poll", .mode = S_IRUGO },
+	.show = blk_mq_hw_sysfs_poll_show,
+};
+static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_stat = {
+	.attr = {.name = "stats", .mode = S_IRUGO | S_IWUSR },
+	.show = blk_mq_hw_sysfs_stat_show,
+	.store = blk_mq_hw_sysfs_stat_store,
+};
+static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_stat_lat = {
+	.attr = {.name = "stats_lat", .mode = S_IRUGO },
+	.show = blk_mq_hw_sysfs_stat_lat_show,
+};
+static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_stat_size = {
+	.attr = {.name = "stats_size", .mode = S_IRUGO },
+	.show = blk_mq_hw_sysfs_stat_size_show,
+};
 
 static struct attribute *default_hw_ctx_attrs[] = {
 	&blk_mq_hw_sysfs_queued.attr,
@@ -308,6 +365,10 @@ static struct attribute *default_hw_ctx_attrs[] = {
 	&blk_mq_hw_sysfs_tags.attr,
 	&blk_mq_hw_sysfs_cpus.attr,
 	&blk_mq_hw_sysfs_active.attr,
+	&blk_mq_hw_sysfs_poll.attr,
+	&blk_mq_hw_sysfs_stat.attr,
+	&blk_mq_hw_sysfs_stat_lat.attr,
+	&blk_mq_hw_sysfs_stat_size.attr,
 	NULL,
 };
 
@@ -140,14 +140,14 @@ static inline bool hctx_may_queue(struct blk_mq_hw_ctx *hctx,
 	return atomic_read(&hctx->nr_active) < depth;
 }
 
-static int __bt_get_word(struct blk_align_bitmap *bm, unsigned int last_tag,
-			 bool nowrap)
+static int __bt_get_word(struct blk_align_bitmap *bm, unsigned int depth,
+			 unsigned int last_tag, bool nowrap)
 {
 	int tag, org_last_tag = last_tag;
 
 	while (1) {
-		tag = find_next_zero_bit(&bm->word, bm->depth, last_tag);
-		if (unlikely(tag >= bm->depth)) {
+		tag = find_next_zero_bit(&bm->word, depth, last_tag);
+		if (unlikely(tag >= depth)) {
 			/*
 			 * We started with an offset, and we didn't reset the
 			 * offset to 0 in a failure case, so start from 0 to
@@ -164,13 +164,29 @@ static int __bt_get_word(struct blk_align_bitmap *bm, unsigned int last_tag,
 			break;
 
 		last_tag = tag + 1;
-		if (last_tag >= bm->depth - 1)
+		if (last_tag >= depth - 1)
 			last_tag = 0;
 	}
 
 	return tag;
 }
 
+/*
+ * Usable bits of word @index, when allocations are limited to the first
+ * @shallow tags of the map.  A @shallow of 0 means no limit.
+ */
+static unsigned int bt_word_depth(struct blk_mq_bitmap_tags *bt, int index,
+				  unsigned int shallow)
+{
+	unsigned int first = index << bt->bits_per_word;
+
+	if (!shallow)
+		return bt->map[index].depth;
+	if (first >= shallow)
+		return 0;
+	return min_t(unsigned int, bt->map[index].depth, shallow - first);
+}
+
 #define BT_ALLOC_RR(tags) (tags->alloc_policy == BLK_TAG_ALLOC_RR)
 
 /*
@@ -185,7 +201,8 @@ static int __bt_get_word(struct blk_align_bitmap *bm, unsigned int last_tag,
  * until the map is exhausted.
  */
 static int __bt_get(struct blk_mq_hw_ctx *hctx, struct blk_mq_bitmap_tags *bt,
-		    unsigned int *tag_cache, struct blk_mq_tags *tags)
+		    unsigned int *tag_cache, struct blk_mq_tags *tags,
+		    unsigned int shallow)
 {
 	unsigned int last_tag, org_last_tag;
 	int index, i, tag;
@@ -194,11 +211,14 @@ static int __bt_get(struct blk_mq_hw_ctx *hctx, struct blk_mq_bitmap_tags *bt,
 		return -1;
 
 	last_tag = org_last_tag = *tag_cache;
+	if (shallow && last_tag >= shallow)
+		last_tag = 0;
 	index = TAG_TO_INDEX(bt, last_tag);
 
 	for (i = 0; i < bt->map_nr; i++) {
-		tag = __bt_get_word(&bt->map[index], TAG_TO_BIT(bt, last_tag),
-				    BT_ALLOC_RR(tags));
+		tag = __bt_get_word(&bt->map[index],
+				    bt_word_depth(bt, index, shallow),
+				    TAG_TO_BIT(bt, last_tag), BT_ALLOC_RR(tags));
 		if (tag != -1) {
 			tag += (index << bt->bits_per_word);
 			goto done;
@@ -260,7 +280,7 @@ static int bt_get(struct blk_mq_alloc_data *data,
 	DEFINE_WAIT(wait);
 	int tag;
 
-	tag = __bt_get(hctx, bt, last_tag, tags);
+	tag = __bt_get(hctx, bt, last_tag, tags, data->shallow_depth);
 	if (tag != -1)
 		return tag;
 
@@ -271,7 +291,7 @@ static int bt_get(struct blk_mq_alloc_data *data,
 	do {
 		prepare_to_wait(&bs->wait, &wait, TASK_UNINTERRUPTIBLE);
 
-		tag = __bt_get(hctx, bt, last_tag, tags);
+		tag = __bt_get(hctx, bt, last_tag, tags, data->shallow_depth);
 		if (tag != -1)
 			break;
 
@@ -288,7 +308,7 @@ static int bt_get(struct blk_mq_alloc_data *data,
 		 * Retry tag allocation after running the hardware queue,
 		 * as running the queue may also have found completions.
 		 */
-		tag = __bt_get(hctx, bt, last_tag, tags);
+		tag = __bt_get(hctx, bt, last_tag, tags, data->shallow_depth);
 		if (tag != -1)
 			break;
 
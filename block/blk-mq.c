@@ -28,6 +28,7 @@
 #include "blk.h"
 #include "blk-mq.h"
 #include "blk-mq-tag.h"
+#include "blk-wbt.h"
 
 static DEFINE_MUTEX(all_q_mutex);
 static LIST_HEAD(all_q_list);
@@ -198,6 +199,7 @@ static void blk_mq_rq_ctx_init(struct request_queue *q, struct blk_mq_ctx *ctx,
 	set_start_time_ns(rq);
 	rq->io_start_time_ns = 0;
 #endif
+	rq->issue_time_ns = 0;
 	rq->nr_phys_segments = 0;
 #if defined(CONFIG_BLK_DEV_INTEGRITY)
 	rq->nr_integrity_segments = 0;
@@ -293,6 +295,8 @@ static void __blk_mq_free_request(struct blk_mq_hw_ctx *hctx,
 
 	if (rq->cmd_flags & REQ_MQ_INFLIGHT)
 		atomic_dec(&hctx->nr_active);
+
+	wbt_done(q->rq_wb, rq);
 	rq->cmd_flags = 0;
 
 	clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
@@ -324,6 +328,10 @@ inline void __blk_mq_end_request(struct request *rq, int error)
 {
 	blk_account_io_done(rq);
 
+	if (rq->issue_time_ns)
+		blk_stat_add(&rq->mq_ctx->stat[rq_data_dir(rq)], rq,
+			     ktime_get_ns());
+
 	if (rq->end_io) {
 		rq->end_io(rq, error);
 	} else {
@@ -422,6 +430,10 @@ void blk_mq_start_request(struct request *rq)
 
 	blk_add_timer(rq);
 
+	rq->issue_time_ns = ktime_get_ns();
+	rq->issue_sectors = blk_rq_sectors(rq);
+	wbt_issue(q->rq_wb, rq);
+
 	/*
 	 * Ensure that ->deadline is visible before set the started
 	 * flag and clear the completed flag.
@@ -450,6 +462,113 @@ void blk_mq_start_request(struct request *rq)
 }
 EXPORT_SYMBOL(blk_mq_start_request);
 
+/*
+ * Half the mean completion time of the newest stats window of @hctx, reads
+ * and writes together.
+ */
+static unsigned int blk_mq_poll_nsecs(struct blk_mq_hw_ctx *hctx)
+{
+	struct blk_rq_stat stat[2];
+
+	blk_hctx_stat_get(hctx, stat);
+	blk_stat_sum(&stat[READ], &stat[WRITE]);
+
+	return min_t(u64, blk_stat_mean(&stat[READ]) / 2, UINT_MAX);
+}
+
+/*
+ * Hybrid polling: sleep for a while before starting to poll, half the
+ * mean completion time unless a fixed delay was configured, so that a
+ * polling task doesn't burn a CPU for the whole duration of the I/O.
+ */
+static bool blk_mq_poll_hybrid_sleep(struct request_queue *q,
+				     struct blk_mq_hw_ctx *hctx)
+{
+	struct hrtimer_sleeper hs;
+	unsigned int nsec;
+
+	if (q->poll_nsec < 0)
+		return false;
+	if (q->poll_nsec)
+		nsec = q->poll_nsec;
+	else
+		nsec = blk_mq_poll_nsecs(hctx);
+	if (!nsec)
+		return false;
+
+	hctx->poll_sleeps++;
+	hrtimer_init_on_stack(&hs.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	hrtimer_init_sleeper(&hs, current);
+	hrtimer_start(&hs.timer, ns_to_ktime(nsec), HRTIMER_MODE_REL);
+	/* the completion we wait for wakes us up early */
+	if (hs.task)
+		io_schedule();
+	hrtimer_cancel(&hs.timer);
+	destroy_hrtimer_on_stack(&hs.timer);
+	__set_current_state(TASK_RUNNING);
+	return true;
+}
+
+/**
+ * blk_poll - poll for the completion of I/O the caller waits for
+ * @q:		the queue the I/O was submitted to
+ * @hybrid:	sleep before polling, if the queue is set up for that
+ *
+ * Description:
+ *	The caller sets its task state as it would before io_schedule(),
+ *	and the completion of its I/O sets it back to TASK_RUNNING.  The
+ *	hardware queue of the current CPU, where the caller's requests were
+ *	issued, is polled until that happens, a signal is pending or the
+ *	task needs to reschedule.
+ *
+ *	Returns true if the caller should recheck its condition and, if its
+ *	I/O is still in flight, poll again without @hybrid; false if it
+ *	should go to sleep.
+ */
+bool blk_poll(struct request_queue *q, bool hybrid)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_plug *plug;
+	long state;
+
+	if (!q->mq_ops || !q->mq_ops->poll || !blk_queue_poll(q))
+		return false;
+
+	plug = current->plug;
+	if (plug)
+		blk_flush_plug_list(plug, false);
+
+	hctx = q->mq_ops->map_queue(q, raw_smp_processor_id());
+	if (hybrid && blk_mq_poll_hybrid_sleep(q, hctx))
+		return true;
+
+	state = current->state;
+	while (!need_resched()) {
+		int ret;
+
+		hctx->poll_invoked++;
+
+		ret = q->mq_ops->poll(hctx);
+		if (ret > 0) {
+			hctx->poll_success++;
+			set_current_state(TASK_RUNNING);
+			return true;
+		}
+
+		if (signal_pending_state(state, current))
+			set_current_state(TASK_RUNNING);
+
+		if (current->state == TASK_RUNNING)
+			return true;
+		if (ret < 0)
+			break;
+		cpu_relax();
+	}
+
+	return false;
+}
+EXPORT_SYMBOL_GPL(blk_poll);
+
 static void __blk_mq_requeue_request(struct request *rq)
 {
 	struct request_queue *q = rq->q;
@@ -740,15 +859,68 @@ static void flush_busy_ctxs(struct blk_mq_hw_ctx *hctx, struct list_head *list)
 	}
 }
 
+/*
+ * Hand the requests flushed from the software queues to the I/O scheduler.
+ * Flush sequence requests use the elevator fields of the request for the
+ * flush state machine, so they are left on @list to go straight out.
+ */
+static void blk_mq_sched_insert(struct blk_mq_hw_ctx *hctx,
+				struct elevator_queue *e, struct list_head *list)
+{
+	struct request *rq, *next;
+	LIST_HEAD(sched_list);
+
+	list_for_each_entry_safe(rq, next, list, queuelist) {
+		if (!(rq->cmd_flags & REQ_FLUSH_SEQ))
+			list_move_tail(&rq->queuelist, &sched_list);
+	}
+
+	if (!list_empty(&sched_list))
+		e->type->mq_ops.insert_requests(e, hctx, &sched_list);
+}
+
+static bool blk_mq_sched_has_work(struct blk_mq_hw_ctx *hctx)
+{
+	struct elevator_queue *e;
+	bool ret = false;
+
+	rcu_read_lock();
+	e = rcu_dereference(hctx->queue->elevator);
+	if (e)
+		ret = e->type->mq_ops.has_work(e, hctx);
+	rcu_read_unlock();
+
+	return ret;
+}
+
+/*
+ * Called with the queue usage counter held, so the scheduler can't change.
+ */
+static unsigned int blk_mq_sched_limit_depth(struct blk_mq_hw_ctx *hctx,
+					     int rw)
+{
+	struct elevator_queue *e = hctx->queue->elevator;
+
+	if (e && e->type->mq_ops.limit_depth)
+		return e->type->mq_ops.limit_depth(e, hctx, rw);
+
+	return 0;
+}
+
 /*
  * Run this hardware queue, pulling any software queues mapped to it in.
  * Note that this function currently has various problems around ordering
  * of IO. In particular, we'd like FIFO behaviour on handling existing
  * items on the hctx->dispatch list. Ignore that for now.
+ *
+ * With an I/O scheduler attached, everything from the software queues goes
+ * to the scheduler first, and is pulled back out one request at a time for
+ * as long as the driver keeps accepting them.
  */
 static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 {
 	struct request_queue *q = hctx->queue;
+	struct elevator_queue *e;
 	struct request *rq;
 	LIST_HEAD(rq_list);
 	LIST_HEAD(driver_list);
@@ -762,10 +934,19 @@ static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 
 	hctx->run++;
 
+	/*
+	 * elevator_exit_mq() waits for a grace period before it frees the
+	 * scheduler.
+	 */
+	rcu_read_lock();
+	e = rcu_dereference(q->elevator);
+
 	/*
 	 * Touch any software queue that has pending entries.
 	 */
 	flush_busy_ctxs(hctx, &rq_list);
+	if (e)
+		blk_mq_sched_insert(hctx, e, &rq_list);
 
 	/*
 	 * If we have previous entries on our dispatch list, grab them
@@ -788,16 +969,26 @@ static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 	 * Now process all the entries, sending them to the driver.
 	 */
 	queued = 0;
-	while (!list_empty(&rq_list)) {
+	while (1) {
 		struct blk_mq_queue_data bd;
 		int ret;
 
+		if (list_empty(&rq_list)) {
+			rq = NULL;
+			if (e)
+				rq = e->type->mq_ops.dispatch_request(e, hctx);
+			if (!rq)
+				break;
+			list_add(&rq->queuelist, &rq_list);
+		}
+
 		rq = list_first_entry(&rq_list, struct request, queuelist);
 		list_del_init(&rq->queuelist);
 
 		bd.rq = rq;
 		bd.list = dptr;
-		bd.last = list_empty(&rq_list);
+		bd.last = list_empty(&rq_list) &&
+			  !(e && e->type->mq_ops.has_work(e, hctx));
 
 		ret = q->mq_ops->queue_rq(hctx, &bd);
 		switch (ret) {
@@ -851,6 +1042,8 @@ static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 		 **/
 		blk_mq_run_hw_queue(hctx, true);
 	}
+
+	rcu_read_unlock();
 }
 
 /*
@@ -908,7 +1101,8 @@ void blk_mq_run_hw_queues(struct request_queue *q, bool async)
 
 	queue_for_each_hw_ctx(q, hctx, i) {
 		if ((!blk_mq_hctx_has_pending(hctx) &&
-		    list_empty_careful(&hctx->dispatch)) ||
+		    list_empty_careful(&hctx->dispatch) &&
+		    !blk_mq_sched_has_work(hctx)) ||
 		    test_bit(BLK_MQ_S_STOPPED, &hctx->state))
 			continue;
 
@@ -1198,6 +1392,7 @@ static struct request *blk_mq_map_request(struct request_queue *q,
 	trace_block_getrq(q, bio, rw);
 	blk_mq_set_alloc_data(&alloc_data, q, GFP_ATOMIC, false, ctx,
 			hctx);
+	alloc_data.shallow_depth = blk_mq_sched_limit_depth(hctx, rw);
 	rq = __blk_mq_alloc_request(&alloc_data, rw);
 	if (unlikely(!rq)) {
 		__blk_mq_run_hw_queue(hctx);
@@ -1208,6 +1403,7 @@ static struct request *blk_mq_map_request(struct request_queue *q,
 		hctx = q->mq_ops->map_queue(q, ctx->cpu);
 		blk_mq_set_alloc_data(&alloc_data, q,
 				__GFP_WAIT|GFP_ATOMIC, false, ctx, hctx);
+		alloc_data.shallow_depth = blk_mq_sched_limit_depth(hctx, rw);
 		rq = __blk_mq_alloc_request(&alloc_data, rw);
 		ctx = alloc_data.ctx;
 		hctx = alloc_data.hctx;
@@ -1265,6 +1461,7 @@ static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
 	unsigned int request_count = 0;
 	struct blk_plug *plug;
 	struct request *same_queue_rq = NULL;
+	bool wb_acct;
 
 	blk_queue_bounce(q, &bio);
 
@@ -1277,9 +1474,16 @@ static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
 	    blk_attempt_plug_merge(q, bio, &request_count, &same_queue_rq))
 		return;
 
+	wb_acct = wbt_wait(q->rq_wb, bio, NULL);
+
 	rq = blk_mq_map_request(q, bio, &data);
-	if (unlikely(!rq))
+	if (unlikely(!rq)) {
+		if (wb_acct)
+			__wbt_done(q->rq_wb);
 		return;
+	}
+
+	wbt_track(rq, wb_acct);
 
 	if (unlikely(is_flush_fua)) {
 		blk_mq_bio_to_request(rq, bio);
@@ -1291,10 +1495,11 @@ static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
 	/*
 	 * If the driver supports defer issued based on 'last', then
 	 * queue it up like normal since we can potentially save some
-	 * CPU this way.
+	 * CPU this way.  With an I/O scheduler, everything has to go
+	 * through it.
 	 */
 	if (((plug && !blk_queue_nomerges(q)) || is_sync) &&
-	    !(data.hctx->flags & BLK_MQ_F_DEFER_ISSUE)) {
+	    !(data.hctx->flags & BLK_MQ_F_DEFER_ISSUE) && !q->elevator) {
 		struct request *old_rq = NULL;
 
 		blk_mq_bio_to_request(rq, bio);
@@ -1350,6 +1555,7 @@ static void blk_sq_make_request(struct request_queue *q, struct bio *bio)
 	unsigned int request_count = 0;
 	struct blk_map_ctx data;
 	struct request *rq;
+	bool wb_acct;
 
 	blk_queue_bounce(q, &bio);
 
@@ -1362,9 +1568,16 @@ static void blk_sq_make_request(struct request_queue *q, struct bio *bio)
 	    blk_attempt_plug_merge(q, bio, &request_count, NULL))
 		return;
 
+	wb_acct = wbt_wait(q->rq_wb, bio, NULL);
+
 	rq = blk_mq_map_request(q, bio, &data);
-	if (unlikely(!rq))
+	if (unlikely(!rq)) {
+		if (wb_acct)
+			__wbt_done(q->rq_wb);
 		return;
+	}
+
+	wbt_track(rq, wb_acct);
 
 	if (unlikely(is_flush_fua)) {
 		blk_mq_bio_to_request(rq, bio);
@@ -1769,6 +1982,8 @@ static void blk_mq_init_cpu_queues(struct request_queue *q,
 		spin_lock_init(&__ctx->lock);
 		INIT_LIST_HEAD(&__ctx->rq_list);
 		__ctx->queue = q;
+		blk_stat_init(&__ctx->stat[READ]);
+		blk_stat_init(&__ctx->stat[WRITE]);
 
 		/* If the cpu isn't online, the cpu is mapped to first hctx */
 		if (!cpu_online(i))
@@ -1995,6 +2210,7 @@ struct request_queue *blk_mq_init_allocated_queue(struct blk_mq_tag_set *set,
 
 	q->mq_ops = set->ops;
 	q->queue_flags |= QUEUE_FLAG_MQ_DEFAULT;
+	q->poll_nsec = -1;
 
 	if (!(set->flags & BLK_MQ_F_SG_MERGE))
 		q->queue_flags |= 1 << QUEUE_FLAG_NO_SG_MERGE;
@@ -2053,6 +2269,9 @@ void blk_mq_free_queue(struct request_queue *q)
 {
 	struct blk_mq_tag_set	*set = q->tag_set;
 
+	if (q->elevator)
+		elevator_exit_mq(q);
+
 	blk_mq_del_queue_tag_set(q);
 
 	blk_mq_exit_hw_queues(q, set, set->nr_hw_queues);
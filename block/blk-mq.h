@@ -1,6 +1,8 @@
 #ifndef INT_BLK_MQ_H
 #define INT_BLK_MQ_H
 
+#include "blk-stat.h"
+
 struct blk_mq_tag_set;
 
 struct blk_mq_ctx {
@@ -20,6 +22,7 @@ struct blk_mq_ctx {
 
 	/* incremented at completion time */
 	unsigned long		____cacheline_aligned_in_smp rq_completed[2];
+	struct blk_rq_stat	stat[2];
 
 	struct request_queue	*queue;
 	struct kobject		kobj;
@@ -100,6 +103,7 @@ struct blk_mq_alloc_data {
 	struct request_queue *q;
 	gfp_t gfp;
 	bool reserved;
+	unsigned int shallow_depth;	/* only use the first N tags, if set */
 
 	/* input & output parameter */
 	struct blk_mq_ctx *ctx;
@@ -114,6 +118,7 @@ static inline void blk_mq_set_alloc_data(struct blk_mq_alloc_data *data,
 	data->q = q;
 	data->gfp = gfp;
 	data->reserved = reserved;
+	data->shallow_depth = 0;
 	data->ctx = ctx;
 	data->hctx = hctx;
 }
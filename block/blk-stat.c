@@ -0,0 +1,225 @@
+/*
+ * Block stat tracking code
+ *
+ * Completion latency and size of requests, per data direction.  On blk-mq
+ * the stats live in the blk_mq_ctx of the CPU that submitted the request,
+ * and are updated without locking at completion time.  A completion racing
+ * with one on another CPU may lose a sample, which is fine for what they
+ * are used for.  Readers sum up the software queues that have seen a
+ * completion in the newest window.  request_fn queues complete under the
+ * queue lock and keep a single set of stats in the request_queue.
+ *
+ * Besides sysfs, these feed hybrid polling and writeback throttling.
+ */
+#include <linux/kernel.h>
+#include <linux/blk-mq.h>
+
+#include "blk-stat.h"
+#include "blk-mq.h"
+
+void blk_stat_init(struct blk_rq_stat *stat)
+{
+	memset(stat, 0, sizeof(*stat));
+	stat->min = -1ULL;
+}
+
+static inline unsigned int blk_stat_lat_bucket(u64 nsec)
+{
+	return min_t(unsigned int, fls64(nsec >> 10),
+		     BLK_STAT_LAT_BUCKETS - 1);
+}
+
+static inline unsigned int blk_stat_size_bucket(unsigned int sectors)
+{
+	return min_t(unsigned int, fls(sectors >> 3),
+		     BLK_STAT_SIZE_BUCKETS - 1);
+}
+
+void blk_stat_add(struct blk_rq_stat *stat, struct request *rq, u64 now)
+{
+	u64 lat;
+
+	if (now < rq->issue_time_ns)
+		return;
+	lat = now - rq->issue_time_ns;
+
+	if (stat->time != (now & BLK_STAT_NSEC_MASK)) {
+		blk_stat_init(stat);
+		stat->time = now & BLK_STAT_NSEC_MASK;
+	}
+
+	if (lat < stat->min)
+		stat->min = lat;
+	if (lat > stat->max)
+		stat->max = lat;
+	stat->sum += lat;
+	stat->nr_samples++;
+	stat->lat[blk_stat_lat_bucket(lat)]++;
+	stat->size[blk_stat_size_bucket(rq->issue_sectors)]++;
+}
+
+void blk_stat_sum(struct blk_rq_stat *dst, struct blk_rq_stat *src)
+{
+	int i;
+
+	if (!src->nr_samples)
+		return;
+
+	dst->min = min(dst->min, src->min);
+	dst->max = max(dst->max, src->max);
+	dst->sum += src->sum;
+	dst->nr_samples += src->nr_samples;
+	for (i = 0; i < BLK_STAT_LAT_BUCKETS; i++)
+		dst->lat[i] += src->lat[i];
+	for (i = 0; i < BLK_STAT_SIZE_BUCKETS; i++)
+		dst->size[i] += src->size[i];
+}
+
+static u64 blk_ctx_stat_newest(struct blk_mq_ctx *ctx, u64 newest)
+{
+	return max3(newest, ctx->stat[READ].time, ctx->stat[WRITE].time);
+}
+
+static void blk_ctx_stat_sum(struct blk_mq_ctx *ctx, struct blk_rq_stat *dst,
+			     u64 newest)
+{
+	int rw;
+
+	for (rw = READ; rw <= WRITE; rw++) {
+		if (ctx->stat[rw].time == newest)
+			blk_stat_sum(&dst[rw], &ctx->stat[rw]);
+	}
+}
+
+/*
+ * Fill in @dst[READ] and @dst[WRITE] with the completions of the newest
+ * window seen by the software queues of @hctx.
+ */
+void blk_hctx_stat_get(struct blk_mq_hw_ctx *hctx, struct blk_rq_stat *dst)
+{
+	struct blk_mq_ctx *ctx;
+	unsigned int i;
+	u64 newest = 0;
+
+	blk_stat_init(&dst[READ]);
+	blk_stat_init(&dst[WRITE]);
+
+	hctx_for_each_ctx(hctx, ctx, i)
+		newest = blk_ctx_stat_newest(ctx, newest);
+
+	hctx_for_each_ctx(hctx, ctx, i)
+		blk_ctx_stat_sum(ctx, dst, newest);
+
+	dst[READ].time = dst[WRITE].time = newest;
+}
+
+void blk_hctx_stat_clear(struct blk_mq_hw_ctx *hctx)
+{
+	struct blk_mq_ctx *ctx;
+	unsigned int i;
+
+	hctx_for_each_ctx(hctx, ctx, i) {
+		blk_stat_init(&ctx->stat[READ]);
+		blk_stat_init(&ctx->stat[WRITE]);
+	}
+}
+
+/*
+ * Same as blk_hctx_stat_get(), for all hardware queues of @q.
+ */
+void blk_queue_stat_get(struct request_queue *q, struct blk_rq_stat *dst)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	unsigned int i, j;
+	u64 newest = 0;
+
+	if (!q->mq_ops) {
+		unsigned long flags;
+
+		spin_lock_irqsave(q->queue_lock, flags);
+		dst[READ] = q->rq_stats[READ];
+		dst[WRITE] = q->rq_stats[WRITE];
+		spin_unlock_irqrestore(q->queue_lock, flags);
+		return;
+	}
+
+	blk_stat_init(&dst[READ]);
+	blk_stat_init(&dst[WRITE]);
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		hctx_for_each_ctx(hctx, ctx, j)
+			newest = blk_ctx_stat_newest(ctx, newest);
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		hctx_for_each_ctx(hctx, ctx, j)
+			blk_ctx_stat_sum(ctx, dst, newest);
+
+	dst[READ].time = dst[WRITE].time = newest;
+}
+
+static ssize_t print_stat(char *page, const char *pre, struct blk_rq_stat *stat)
+{
+	if (!stat->nr_samples)
+		return sprintf(page, "%s samples=0\n", pre);
+
+	return sprintf(page, "%s samples=%u, mean=%llu, min=%llu, max=%llu\n",
+		       pre, stat->nr_samples, blk_stat_mean(stat), stat->min,
+		       stat->max);
+}
+
+/*
+ * Latencies are in nsecs.
+ */
+ssize_t blk_stat_show(struct blk_rq_stat *stat, char *page)
+{
+	char *start_page = page;
+
+	page += print_stat(page, "read :", &stat[READ]);
+	page += print_stat(page, "write:", &stat[WRITE]);
+
+	return page - start_page;
+}
+
+/*
+ * One line per bucket: the lower bound in nsecs, then the read and the
+ * write count.
+ */
+ssize_t blk_stat_lat_show(struct blk_rq_stat *stat, char *page)
+{
+	char *start_page = page;
+	int i;
+
+	page += sprintf(page, "%10u\t%u\t%u\n", 0U, stat[READ].lat[0],
+			stat[WRITE].lat[0]);
+
+	for (i = 1; i < BLK_STAT_LAT_BUCKETS; i++) {
+		unsigned long nsec = 1024UL << (i - 1);
+
+		page += sprintf(page, "%10lu\t%u\t%u\n", nsec,
+				stat[READ].lat[i], stat[WRITE].lat[i]);
+	}
+
+	return page - start_page;
+}
+
+/*
+ * Same for request sizes, with the lower bound in KiB.
+ */
+ssize_t blk_stat_size_show(struct blk_rq_stat *stat, char *page)
+{
+	char *start_page = page;
+	int i;
+
+	page += sprintf(page, "%8u\t%u\t%u\n", 0U, stat[READ].size[0],
+			stat[WRITE].size[0]);
+
+	for (i = 1; i < BLK_STAT_SIZE_BUCKETS; i++) {
+		unsigned long kb = 4UL << (i - 1);
+
+		page += sprintf(page, "%8lu\t%u\t%u\n", kb,
+				stat[READ].size[i], stat[WRITE].size[i]);
+	}
+
+	return page - start_page;
+}
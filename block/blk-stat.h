@@ -0,0 +1,39 @@
+#ifndef BLK_STAT_H
+#define BLK_STAT_H
+
+#include <linux/kernel.h>
+#include <linux/blkdev.h>
+
+/*
+ * Completions are accounted in windows of ~134ms: the stats of a software
+ * queue start over once a completion lands in a newer window.
+ */
+#define BLK_STAT_NSEC		134217728ULL
+#define BLK_STAT_NSEC_MASK	~(BLK_STAT_NSEC - 1)
+
+void blk_stat_init(struct blk_rq_stat *);
+void blk_stat_add(struct blk_rq_stat *, struct request *, u64 now);
+void blk_stat_sum(struct blk_rq_stat *dst, struct blk_rq_stat *src);
+void blk_hctx_stat_get(struct blk_mq_hw_ctx *, struct blk_rq_stat *);
+void blk_hctx_stat_clear(struct blk_mq_hw_ctx *);
+void blk_queue_stat_get(struct request_queue *, struct blk_rq_stat *);
+ssize_t blk_stat_show(struct blk_rq_stat *, char *);
+ssize_t blk_stat_lat_show(struct blk_rq_stat *, char *);
+ssize_t blk_stat_size_show(struct blk_rq_stat *, char *);
+
+static inline u64 blk_stat_mean(const struct blk_rq_stat *stat)
+{
+	if (!stat->nr_samples)
+		return 0;
+	return div_u64(stat->sum, stat->nr_samples);
+}
+
+/*
+ * Whether @stat is from the window @now falls in, or from the one before.
+ */
+static inline bool blk_stat_is_recent(const struct blk_rq_stat *stat, u64 now)
+{
+	return stat->time + BLK_STAT_NSEC >= (now & BLK_STAT_NSEC_MASK);
+}
+
+#endif
@@ -13,6 +13,7 @@
 
 #include "blk.h"
 #include "blk-mq.h"
+#include "blk-wbt.h"
 
 struct queue_sysfs_entry {
 	struct attribute attr;
@@ -70,6 +71,7 @@ queue_requests_store(struct request_queue *q, const char *page, size_t count)
 	if (err)
 		return err;
 
+	wbt_update_limits(q->rq_wb);
 	return ret;
 }
 
@@ -286,6 +288,108 @@ queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+static ssize_t queue_poll_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(blk_queue_poll(q), page);
+}
+
+static ssize_t queue_poll_store(struct request_queue *q, const char *page,
+				size_t count)
+{
+	unsigned long poll_on;
+	ssize_t ret;
+
+	if (!q->mq_ops || !q->mq_ops->poll)
+		return -EINVAL;
+
+	ret = queue_var_store(&poll_on, page, count);
+	if (ret < 0)
+		return ret;
+
+	spin_lock_irq(q->queue_lock);
+	if (poll_on)
+		queue_flag_set(QUEUE_FLAG_POLL, q);
+	else
+		queue_flag_clear(QUEUE_FLAG_POLL, q);
+	spin_unlock_irq(q->queue_lock);
+
+	return ret;
+}
+
+/*
+ * io_poll_delay: -1 polls right away, 0 sleeps for half the mean
+ * completion time first, anything else for that many usecs.
+ */
+static ssize_t queue_poll_delay_show(struct request_queue *q, char *page)
+{
+	if (q->poll_nsec < 0)
+		return sprintf(page, "%d\n", -1);
+
+	return sprintf(page, "%d\n", q->poll_nsec / 1000);
+}
+
+static ssize_t queue_poll_delay_store(struct request_queue *q,
+				      const char *page, size_t count)
+{
+	int err, val;
+
+	if (!q->mq_ops || !q->mq_ops->poll)
+		return -EINVAL;
+
+	err = kstrtoint(page, 10, &val);
+	if (err)
+		return err;
+	if (val < -1 || val > INT_MAX / 1000)
+		return -EINVAL;
+
+	q->poll_nsec = val < 0 ? -1 : val * 1000;
+
+	return count;
+}
+
+static ssize_t queue_stats_show(struct request_queue *q, char *page)
+{
+	struct blk_rq_stat stat[2];
+
+	if (!q->request_fn && !q->mq_ops)
+		return -EINVAL;
+
+	blk_queue_stat_get(q, stat);
+	return blk_stat_show(stat, page);
+}
+
+static ssize_t queue_wb_lat_show(struct request_queue *q, char *page)
+{
+	if (!q->rq_wb)
+		return -EINVAL;
+
+	return sprintf(page, "%llu\n", div_u64(q->rq_wb->min_lat_nsec, 1000));
+}
+
+static ssize_t queue_wb_lat_store(struct request_queue *q, const char *page,
+				  size_t count)
+{
+	ssize_t ret;
+	s64 val;
+
+	ret = kstrtoll(page, 10, &val);
+	if (ret < 0)
+		return ret;
+	if (val < -1 || val > S64_MAX / 1000)
+		return -EINVAL;
+
+	if (!q->rq_wb) {
+		if (!q->request_fn && !q->mq_ops)
+			return -EINVAL;
+		ret = wbt_init(q);
+		if (ret)
+			return ret;
+	}
+
+	wbt_set_min_lat(q, val < 0 ? -1 : val * 1000);
+	return count;
+}
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -405,6 +509,29 @@ static struct queue_sysfs_entry queue_random_entry = {
 	.store = queue_store_random,
 };
 
+static struct queue_sysfs_entry queue_poll_entry = {
+	.attr = {.name = "io_poll", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_show,
+	.store = queue_poll_store,
+};
+
+static struct queue_sysfs_entry queue_poll_delay_entry = {
+	.attr = {.name = "io_poll_delay", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_delay_show,
+	.store = queue_poll_delay_store,
+};
+
+static struct queue_sysfs_entry queue_stats_entry = {
+	.attr = {.name = "stats", .mode = S_IRUGO },
+	.show = queue_stats_show,
+};
+
+static struct queue_sysfs_entry queue_wb_lat_entry = {
+	.attr = {.name = "wbt_lat_usec", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_wb_lat_show,
+	.store = queue_wb_lat_store,
+};
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
@@ -428,6 +555,10 @@ static struct attribute *default_attrs[] = {
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+	&queue_poll_entry.attr,
+	&queue_poll_delay_entry.attr,
+	&queue_stats_entry.attr,
+	&queue_wb_lat_entry.attr,
 	NULL,
 };
 
@@ -503,6 +634,7 @@ static void blk_release_queue(struct kobject *kobj)
 		container_of(kobj, struct request_queue, kobj);
 
 	blkcg_exit_queue(q);
+	wbt_exit(q);
 
 	if (q->elevator) {
 		spin_lock_irq(q->queue_lock);
@@ -532,6 +664,28 @@ static const struct sysfs_ops queue_sysfs_ops = {
 	.store	= queue_attr_store,
 };
 
+/*
+ * Writeback throttling is on by default where the kernel was configured
+ * for it, for blk-mq and for request_fn queues respectively.  Bio based
+ * drivers never see requests, so there is nothing to throttle there.
+ */
+static void blk_wb_init(struct request_queue *q)
+{
+#ifndef CONFIG_BLK_WBT_MQ
+	if (q->mq_ops)
+		return;
+#endif
+#ifndef CONFIG_BLK_WBT_SQ
+	if (q->request_fn)
+		return;
+#endif
+	if (!q->mq_ops && !q->request_fn)
+		return;
+
+	/* a failure just leaves throttling off */
+	wbt_init(q);
+}
+
 struct kobj_type blk_queue_ktype = {
 	.sysfs_ops	= &queue_sysfs_ops,
 	.default_attrs	= default_attrs,
@@ -578,7 +732,9 @@ int blk_register_queue(struct gendisk *disk)
 	if (q->mq_ops)
 		blk_mq_register_disk(disk);
 
-	if (!q->request_fn)
+	blk_wb_init(q);
+
+	if (!q->request_fn && !q->elevator)
 		return 0;
 
 	ret = elv_register_queue(q);
@@ -603,7 +759,7 @@ void blk_unregister_queue(struct gendisk *disk)
 	if (q->mq_ops)
 		blk_mq_unregister_disk(disk);
 
-	if (q->request_fn)
+	if (q->request_fn || q->elevator)
 		elv_unregister_queue(q);
 
 	kobject_uevent(&q->kobj, KOBJ_REMOVE);
@@ -0,0 +1,428 @@
+/*
+ * Buffered writeback throttling, based on the read latency of the device.
+ *
+ * Writeback can put enough requests on a queue to keep the device busy for
+ * seconds, and any read or fsync then waits behind all of it.  So the
+ * number of buffered writeback requests in flight on a queue is limited.
+ * Like CoDel, we look at the minimum read completion latency over a window
+ * of time, as accounted by blk-stat.  If that is above the target, the
+ * device queue is too deep and the writeback depth is halved.  The window
+ * is shortened as the depth goes down, so that a device that is overloaded
+ * recovers quickly.  Once reads make the target again the depth goes back
+ * up one step per window, and beyond the default if there are writes but
+ * no reads at all.
+ *
+ * Writes that are waited on (REQ_SYNC, which includes O_DIRECT and fsync
+ * writeback) are never throttled, and kswapd gets the full depth.
+ */
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/swap.h>
+#include <linux/ktime.h>
+
+#include "blk-wbt.h"
+#include "blk-stat.h"
+
+#define RWB_DEF_DEPTH		16		/* default max writeback depth */
+#define RWB_WINDOW_NSEC		(100 * 1000 * 1000ULL)
+#define RWB_UNKNOWN_BUMP	5		/* idle windows to go to default */
+#define RWB_NONROT_LAT_NSEC	(2 * 1000 * 1000ULL)
+#define RWB_ROT_LAT_NSEC	(75 * 1000 * 1000ULL)
+
+/* I/O other than writeback this recently limits writeback further */
+#define RWB_CLOSE_IO		(HZ / 10)
+
+enum {
+	LAT_OK = 1,
+	LAT_UNKNOWN,
+	LAT_UNKNOWN_WRITES,
+	LAT_EXCEEDED,
+};
+
+static inline bool rwb_enabled(struct rq_wb *rwb)
+{
+	return rwb && rwb->min_lat_nsec != 0;
+}
+
+/*
+ * Only dirty the cacheline when the value changes.
+ */
+static inline void wb_timestamp(struct rq_wb *rwb, unsigned long *var)
+{
+	if (rwb_enabled(rwb)) {
+		const unsigned long cur = jiffies;
+
+		if (cur != *var)
+			*var = cur;
+	}
+}
+
+static bool close_io(struct rq_wb *rwb)
+{
+	const unsigned long now = jiffies;
+
+	return time_before(now, rwb->last_issue + RWB_CLOSE_IO) ||
+		time_before(now, rwb->last_comp + RWB_CLOSE_IO);
+}
+
+static unsigned int get_limit(struct rq_wb *rwb)
+{
+	if (current_is_kswapd())
+		return READ_ONCE(rwb->wb_max);
+	if (close_io(rwb))
+		return READ_ONCE(rwb->wb_background);
+
+	return READ_ONCE(rwb->wb_normal);
+}
+
+void __wbt_done(struct rq_wb *rwb)
+{
+	unsigned int limit;
+	int inflight;
+
+	inflight = atomic_dec_return(&rwb->inflight);
+
+	/*
+	 * wbt got disabled with I/O in flight.  Wake up any waiters.
+	 */
+	if (!rwb_enabled(rwb)) {
+		wake_up_all(&rwb->wait);
+		return;
+	}
+
+	/*
+	 * Don't wake anyone up until we are below the normal limit, and
+	 * then let a few requests complete first so that the waiters get
+	 * woken in batches.
+	 */
+	limit = READ_ONCE(rwb->wb_normal);
+	if (inflight && inflight >= limit)
+		return;
+
+	if (waitqueue_active(&rwb->wait)) {
+		int diff = limit - inflight;
+
+		if (!inflight || diff >= rwb->wb_background / 2)
+			wake_up_all(&rwb->wait);
+	}
+}
+
+/*
+ * Called when a request is freed.  Gives back the writeback slot of
+ * throttled requests, and notes when the queue last completed other I/O.
+ */
+void wbt_done(struct rq_wb *rwb, struct request *rq)
+{
+	if (!rwb)
+		return;
+
+	if (rq->cmd_flags & REQ_WB_TRACKED) {
+		rq->cmd_flags &= ~REQ_WB_TRACKED;
+		__wbt_done(rwb);
+		return;
+	}
+
+	if (!rq->issue_time_ns)
+		return;
+
+	wb_timestamp(rwb, &rwb->last_comp);
+}
+
+static void calc_wb_limits(struct rq_wb *rwb)
+{
+	unsigned int depth;
+
+	if (!rwb->min_lat_nsec) {
+		rwb->wb_max = rwb->wb_normal = rwb->wb_background = 0;
+		return;
+	}
+
+	rwb->scaled_max = false;
+	depth = min_t(unsigned int, RWB_DEF_DEPTH, rwb->queue_depth);
+	if (rwb->scale_step > 0) {
+		depth = 1 + ((depth - 1) >> min(31, rwb->scale_step));
+	} else if (rwb->scale_step < 0) {
+		unsigned int maxd = max(3 * rwb->queue_depth / 4, 1U);
+
+		depth = 1 + ((depth - 1) << min(31, -rwb->scale_step));
+		if (depth >= maxd) {
+			depth = maxd;
+			rwb->scaled_max = true;
+		}
+	}
+
+	rwb->wb_max = depth;
+	rwb->wb_normal = (depth + 1) / 2;
+	rwb->wb_background = (depth + 3) / 4;
+}
+
+static void rwb_arm_timer(struct rq_wb *rwb)
+{
+	/*
+	 * Shrink the window as we scale down, so that we get through the
+	 * steps faster when the device is overloaded: win / sqrt(step + 1).
+	 */
+	if (rwb->scale_step > 0)
+		rwb->cur_win_nsec = div_u64(rwb->win_nsec << 4,
+					int_sqrt((rwb->scale_step + 1) << 8));
+	else
+		rwb->cur_win_nsec = rwb->win_nsec;
+
+	mod_timer(&rwb->window_timer,
+		  jiffies + max(nsecs_to_jiffies(rwb->cur_win_nsec), 1UL));
+}
+
+static void scale_up(struct rq_wb *rwb)
+{
+	if (rwb->scaled_max)
+		return;
+
+	rwb->scale_step--;
+	rwb->unknown_cnt = 0;
+	calc_wb_limits(rwb);
+	wake_up_all(&rwb->wait);
+}
+
+static void scale_down(struct rq_wb *rwb, bool hard_throttle)
+{
+	/*
+	 * Stop at one request in flight.  A hard throttle from above the
+	 * default depth drops straight to the default.
+	 */
+	if (rwb->wb_max == 1)
+		return;
+
+	if (rwb->scale_step < 0 && hard_throttle)
+		rwb->scale_step = 0;
+	else
+		rwb->scale_step++;
+
+	rwb->unknown_cnt = 0;
+	calc_wb_limits(rwb);
+}
+
+/*
+ * Reads are judged on the newest blk-stat window.  A window older than the
+ * one before the current one says nothing about the device anymore.  Our
+ * timer may fire several times per blk-stat window, but each window is
+ * acted on only once, so one bad window scales down only one step.
+ */
+static int latency_exceeded(struct rq_wb *rwb)
+{
+	struct blk_rq_stat stat[2];
+
+	blk_queue_stat_get(rwb->queue, stat);
+	if (stat[READ].nr_samples && stat[READ].time == rwb->last_stat_time)
+		return LAT_UNKNOWN;
+
+	if (!stat[READ].nr_samples ||
+	    !blk_stat_is_recent(&stat[READ], ktime_get_ns())) {
+		/*
+		 * No reads finished in this window.  If writeback is going,
+		 * we still don't know anything about read latency.
+		 */
+		if (atomic_read(&rwb->inflight))
+			return LAT_UNKNOWN_WRITES;
+		return LAT_UNKNOWN;
+	}
+
+	rwb->last_stat_time = stat[READ].time;
+	if (stat[READ].min > rwb->min_lat_nsec)
+		return LAT_EXCEEDED;
+
+	return LAT_OK;
+}
+
+static void wb_timer_fn(unsigned long data)
+{
+	struct rq_wb *rwb = (struct rq_wb *)data;
+	int status;
+
+	if (!rwb_enabled(rwb))
+		return;
+
+	status = latency_exceeded(rwb);
+	switch (status) {
+	case LAT_EXCEEDED:
+		scale_down(rwb, true);
+		break;
+	case LAT_OK:
+		scale_up(rwb);
+		break;
+	case LAT_UNKNOWN_WRITES:
+		/*
+		 * Writes but no reads: there is nobody to protect, so let
+		 * writeback go deeper.
+		 */
+		scale_up(rwb);
+		break;
+	case LAT_UNKNOWN:
+		if (++rwb->unknown_cnt < RWB_UNKNOWN_BUMP)
+			break;
+		/*
+		 * Idle for a while.  Drift back towards the default depth,
+		 * since what we learnt may no longer hold.
+		 */
+		if (rwb->scale_step > 0)
+			scale_up(rwb);
+		else if (rwb->scale_step < 0)
+			scale_down(rwb, false);
+		break;
+	}
+
+	/*
+	 * Keep going while there is writeback in flight, or we are away
+	 * from the default and need to get back to it.
+	 */
+	if (rwb->scale_step || atomic_read(&rwb->inflight))
+		rwb_arm_timer(rwb);
+}
+
+static bool atomic_inc_below(atomic_t *v, int below)
+{
+	int cur = atomic_read(v);
+
+	for (;;) {
+		int old;
+
+		if (cur >= below)
+			return false;
+		old = atomic_cmpxchg(v, cur, cur + 1);
+		if (old == cur)
+			break;
+		cur = old;
+	}
+
+	return true;
+}
+
+static inline bool may_queue(struct rq_wb *rwb)
+{
+	return atomic_inc_below(&rwb->inflight, get_limit(rwb));
+}
+
+static inline bool wbt_should_throttle(struct bio *bio)
+{
+	return (bio->bi_rw & REQ_WRITE) &&
+		!(bio->bi_rw & (REQ_SYNC | REQ_FLUSH | REQ_FUA | REQ_DISCARD));
+}
+
+/*
+ * Returns true if the bio was counted against the writeback depth, in
+ * which case the caller has to mark the request it ends up in with
+ * wbt_track(), or give the slot back with __wbt_done().  Sleeps until the
+ * bio fits in the current depth; @lock is dropped while sleeping, if set.
+ */
+bool wbt_wait(struct rq_wb *rwb, struct bio *bio, spinlock_t *lock)
+	__releases(lock)
+	__acquires(lock)
+{
+	DEFINE_WAIT(wait);
+
+	if (!rwb_enabled(rwb) || !wbt_should_throttle(bio))
+		return false;
+
+	if (!may_queue(rwb)) {
+		do {
+			prepare_to_wait_exclusive(&rwb->wait, &wait,
+						  TASK_UNINTERRUPTIBLE);
+			if (may_queue(rwb))
+				break;
+
+			if (lock)
+				spin_unlock_irq(lock);
+			io_schedule();
+			if (lock)
+				spin_lock_irq(lock);
+		} while (1);
+
+		finish_wait(&rwb->wait, &wait);
+	}
+
+	if (!timer_pending(&rwb->window_timer))
+		rwb_arm_timer(rwb);
+	return true;
+}
+
+/*
+ * Called when a request is started.  Notes when the queue last saw I/O
+ * other than throttled writeback.
+ */
+void wbt_issue(struct rq_wb *rwb, struct request *rq)
+{
+	if (!rwb_enabled(rwb) || (rq->cmd_flags & REQ_WB_TRACKED))
+		return;
+
+	wb_timestamp(rwb, &rwb->last_issue);
+}
+
+/*
+ * Start over from the default depth, e.g. after nr_requests changed.
+ */
+void wbt_update_limits(struct rq_wb *rwb)
+{
+	if (!rwb)
+		return;
+
+	rwb->queue_depth = max_t(unsigned long, rwb->queue->nr_requests, 1);
+	rwb->scale_step = 0;
+	rwb->unknown_cnt = 0;
+	calc_wb_limits(rwb);
+	wake_up_all(&rwb->wait);
+}
+
+/*
+ * Set the read latency target in nsecs: 0 turns throttling off, and -1
+ * picks the default for the device.
+ */
+void wbt_set_min_lat(struct request_queue *q, s64 val)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return;
+
+	if (val == -1)
+		val = blk_queue_nonrot(q) ? RWB_NONROT_LAT_NSEC :
+					    RWB_ROT_LAT_NSEC;
+
+	del_timer_sync(&rwb->window_timer);
+	rwb->min_lat_nsec = val;
+	wbt_update_limits(rwb);
+}
+
+int wbt_init(struct request_queue *q)
+{
+	struct rq_wb *rwb;
+
+	if (q->rq_wb)
+		return 0;
+
+	rwb = kzalloc(sizeof(*rwb), GFP_KERNEL);
+	if (!rwb)
+		return -ENOMEM;
+
+	atomic_set(&rwb->inflight, 0);
+	init_waitqueue_head(&rwb->wait);
+	setup_timer(&rwb->window_timer, wb_timer_fn, (unsigned long)rwb);
+	rwb->win_nsec = RWB_WINDOW_NSEC;
+	rwb->last_issue = rwb->last_comp = jiffies;
+	rwb->queue = q;
+
+	q->rq_wb = rwb;
+	wbt_set_min_lat(q, -1);
+	return 0;
+}
+
+void wbt_exit(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (rwb) {
+		del_timer_sync(&rwb->window_timer);
+		q->rq_wb = NULL;
+		kfree(rwb);
+	}
+}
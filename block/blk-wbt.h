@@ -0,0 +1,95 @@
+#ifndef BLK_WBT_H
+#define BLK_WBT_H
+
+#include <linux/kernel.h>
+#include <linux/atomic.h>
+#include <linux/wait.h>
+#include <linux/timer.h>
+#include <linux/blkdev.h>
+
+/*
+ * Writeback throttling state of a request queue.  Buffered writeback may
+ * only have so many requests in flight on the queue.  That depth is scaled
+ * down while reads on the queue miss their latency target, and back up
+ * once they make it again.
+ */
+struct rq_wb {
+	/*
+	 * Settings that govern how we throttle
+	 */
+	unsigned int wb_background;		/* other I/O recently */
+	unsigned int wb_normal;			/* normal writeback */
+	unsigned int wb_max;			/* kswapd, max depth */
+	int scale_step;				/* > 0 is below the default */
+	bool scaled_max;			/* can't scale up any more */
+	unsigned int queue_depth;
+
+	u64 min_lat_nsec;			/* read latency target, 0 is off */
+	u64 win_nsec;				/* default window */
+	u64 cur_win_nsec;			/* current window */
+	unsigned int unknown_cnt;		/* windows without any reads */
+	u64 last_stat_time;			/* blk-stat window acted on */
+
+	unsigned long last_issue;		/* other I/O, in jiffies */
+	unsigned long last_comp;
+
+	struct timer_list window_timer;
+	struct request_queue *queue;
+
+	atomic_t inflight;
+	wait_queue_head_t wait;
+};
+
+#ifdef CONFIG_BLK_WBT
+
+extern int wbt_init(struct request_queue *);
+extern void wbt_exit(struct request_queue *);
+extern void wbt_set_min_lat(struct request_queue *, s64);
+extern void wbt_update_limits(struct rq_wb *);
+extern bool wbt_wait(struct rq_wb *, struct bio *, spinlock_t *);
+extern void wbt_issue(struct rq_wb *, struct request *);
+extern void wbt_done(struct rq_wb *, struct request *);
+extern void __wbt_done(struct rq_wb *);
+
+static inline void wbt_track(struct request *rq, bool tracked)
+{
+	if (tracked)
+		rq->cmd_flags |= REQ_WB_TRACKED;
+}
+
+#else
+
+static inline int wbt_init(struct request_queue *q)
+{
+	return -EINVAL;
+}
+static inline void wbt_exit(struct request_queue *q)
+{
+}
+static inline void wbt_set_min_lat(struct request_queue *q, s64 val)
+{
+}
+static inline void wbt_update_limits(struct rq_wb *rwb)
+{
+}
+static inline bool wbt_wait(struct rq_wb *rwb, struct bio *bio,
+			    spinlock_t *lock)
+{
+	return false;
+}
+static inline void wbt_issue(struct rq_wb *rwb, struct request *rq)
+{
+}
+static inline void wbt_done(struct rq_wb *rwb, struct request *rq)
+{
+}
+static inline void __wbt_done(struct rq_wb *rwb)
+{
+}
+static inline void wbt_track(struct request *rq, bool tracked)
+{
+}
+
+#endif /* CONFIG_BLK_WBT */
+
+#endif
@@ -36,6 +36,7 @@
 #include <linux/uaccess.h>
 #include <linux/pm_runtime.h>
 #include <linux/blk-cgroup.h>
+#include <linux/blk-mq.h>
 
 #include <trace/events/block.h>
 
@@ -200,6 +201,10 @@ int elevator_init(struct request_queue *q, char *name)
 		e = elevator_get(name, true);
 		if (!e)
 			return -EINVAL;
+		if (e->uses_mq) {
+			elevator_put(e);
+			return -EINVAL;
+		}
 	}
 
 	/*
@@ -212,6 +217,10 @@ int elevator_init(struct request_queue *q, char *name)
 		if (!e)
 			printk(KERN_ERR "I/O scheduler %s not found\n",
 							chosen_elevator);
+		else if (e->uses_mq) {
+			elevator_put(e);
+			e = NULL;
+		}
 	}
 
 	if (!e) {
@@ -242,6 +251,21 @@ void elevator_exit(struct elevator_queue *e)
 }
 EXPORT_SYMBOL(elevator_exit);
 
+/*
+ * Detach the I/O scheduler from a blk-mq queue and free it.  The queue
+ * must be frozen or dead, so that no requests are left in the scheduler.
+ * Queue runs look at q->elevator under RCU, so wait for them before the
+ * scheduler data goes away.
+ */
+void elevator_exit_mq(struct request_queue *q)
+{
+	struct elevator_queue *e = q->elevator;
+
+	RCU_INIT_POINTER(q->elevator, NULL);
+	synchronize_rcu();
+	elevator_exit(e);
+}
+
 static inline void __elv_rqhash_del(struct request *rq)
 {
 	hash_del(&rq->hash);
@@ -944,6 +968,66 @@ fail_init:
 	return err;
 }
 
+/*
+ * blk-mq queues start out without a scheduler and can go back to "none".
+ * Freezing the queue empties the old scheduler before it is torn down.
+ */
+static int elevator_switch_mq(struct request_queue *q,
+			      struct elevator_type *new_e)
+{
+	int err = 0;
+
+	blk_mq_freeze_queue(q);
+
+	if (q->elevator) {
+		if (q->elevator->registered)
+			elv_unregister_queue(q);
+		elevator_exit_mq(q);
+	}
+
+	if (new_e) {
+		err = new_e->ops.elevator_init_fn(q, new_e);
+		if (err) {
+			elevator_put(new_e);
+		} else if (q->kobj.state_in_sysfs) {
+			err = elv_register_queue(q);
+			if (err)
+				elevator_exit_mq(q);
+		}
+	}
+
+	blk_mq_unfreeze_queue(q);
+
+	if (!err)
+		blk_add_trace_msg(q, "elv switch: %s",
+				  new_e ? new_e->elevator_name : "none");
+	return err;
+}
+
+static int __elevator_change_mq(struct request_queue *q, const char *name)
+{
+	struct elevator_type *e = NULL;
+
+	if (strcmp(name, "none")) {
+		e = elevator_get(name, true);
+		if (!e || !e->uses_mq) {
+			if (e)
+				elevator_put(e);
+			printk(KERN_ERR "elevator: type %s not found\n", name);
+			return -EINVAL;
+		}
+	}
+
+	if (q->elevator && e == q->elevator->type) {
+		elevator_put(e);
+		return 0;
+	}
+	if (!q->elevator && !e)
+		return 0;
+
+	return elevator_switch_mq(q, e);
+}
+
 /*
  * Switch this queue to the given IO scheduler.
  */
@@ -952,12 +1036,17 @@ static int __elevator_change(struct request_queue *q, const char *name)
 	char elevator_name[ELV_NAME_MAX];
 	struct elevator_type *e;
 
+	strlcpy(elevator_name, name, sizeof(elevator_name));
+	if (q->mq_ops)
+		return __elevator_change_mq(q, strstrip(elevator_name));
+
 	if (!q->elevator)
 		return -ENXIO;
 
-	strlcpy(elevator_name, name, sizeof(elevator_name));
 	e = elevator_get(strstrip(elevator_name), true);
-	if (!e) {
+	if (!e || e->uses_mq) {
+		if (e)
+			elevator_put(e);
 		printk(KERN_ERR "elevator: type %s not found\n", elevator_name);
 		return -EINVAL;
 	}
@@ -988,7 +1077,7 @@ ssize_t elv_iosched_store(struct request_queue *q, const char *name,
 {
 	int ret;
 
-	if (!q->elevator)
+	if (!q->elevator && !q->mq_ops)
 		return count;
 
 	ret = __elevator_change(q, name);
@@ -1006,14 +1095,18 @@ ssize_t elv_iosched_show(struct request_queue *q, char *name)
 	struct elevator_type *__e;
 	int len = 0;
 
-	if (!q->elevator || !blk_queue_stackable(q))
+	if (!q->mq_ops && (!q->elevator || !blk_queue_stackable(q)))
 		return sprintf(name, "none\n");
 
-	elv = e->type;
+	elv = e ? e->type : NULL;
+	if (q->mq_ops)
+		len += sprintf(name+len, elv ? "none " : "[none] ");
 
 	spin_lock(&elv_list_lock);
 	list_for_each_entry(__e, &elv_list, list) {
-		if (!strcmp(elv->elevator_name, __e->elevator_name))
+		if (__e->uses_mq != !!q->mq_ops)
+			continue;
+		if (elv && !strcmp(elv->elevator_name, __e->elevator_name))
 			len += sprintf(name+len, "[%s] ", elv->elevator_name);
 		else
 			len += sprintf(name+len, "%s ", __e->elevator_name);
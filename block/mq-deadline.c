@@ -0,0 +1,455 @@
+/*
+ *  Deadline i/o scheduler for blk-mq queues.
+ *
+ *  The same read/write FIFOs, sector sorted batches and write starvation
+ *  limit as the legacy deadline scheduler, kept per hardware context so
+ *  that submitters on different hardware queues never share a lock.  On
+ *  top of that, writes may only use part of the tag space, so that a
+ *  flood of writes can't leave a read waiting for a free request.
+ *
+ *  See Documentation/block/deadline-iosched.txt
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+
+static const int read_expire = HZ / 2;  /* max time before a read is submitted. */
+static const int write_expire = 5 * HZ; /* ditto for writes, these limits are SOFT! */
+static const int writes_starved = 2;    /* max times reads can starve a write */
+static const int fifo_batch = 16;       /* # of sequential requests treated as one
+				     by the above parameters. For throughput. */
+
+/*
+ * per hardware context run time data
+ */
+struct dd_hctx {
+	spinlock_t lock;
+
+	/*
+	 * requests are present on both sort_list and fifo_list
+	 */
+	struct rb_root sort_list[2];
+	struct list_head fifo_list[2];
+
+	/*
+	 * next in sort order. read, write or both are NULL
+	 */
+	struct request *next_rq[2];
+	unsigned int batching;		/* number of sequential requests made */
+	unsigned int starved;		/* times reads have starved writes */
+} ____cacheline_aligned_in_smp;
+
+struct deadline_data {
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int fifo_expire[2];
+	int fifo_batch;
+	int writes_starved;
+	int write_depth;		/* tags writes may use */
+
+	unsigned int nr_hctx;
+	struct dd_hctx *hctx[];		/* indexed by hctx->queue_num */
+};
+
+static inline struct dd_hctx *
+dd_hctx(struct elevator_queue *e, struct blk_mq_hw_ctx *hctx)
+{
+	struct deadline_data *dd = e->elevator_data;
+
+	return dd->hctx[hctx->queue_num];
+}
+
+/*
+ * get the request after `rq' in sector-sorted order
+ */
+static inline struct request *
+deadline_latter_request(struct request *rq)
+{
+	struct rb_node *node = rb_next(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void deadline_remove_request(struct dd_hctx *dh, struct request *rq)
+{
+	const int data_dir = rq_data_dir(rq);
+
+	if (dh->next_rq[data_dir] == rq)
+		dh->next_rq[data_dir] = deadline_latter_request(rq);
+
+	rq_fifo_clear(rq);
+	elv_rb_del(&dh->sort_list[data_dir], rq);
+}
+
+/*
+ * add requests to rbtree and fifo
+ */
+static void dd_insert_requests(struct elevator_queue *e,
+			       struct blk_mq_hw_ctx *hctx,
+			       struct list_head *list)
+{
+	struct deadline_data *dd = e->elevator_data;
+	struct dd_hctx *dh = dd_hctx(e, hctx);
+	struct request *rq;
+
+	spin_lock(&dh->lock);
+	while (!list_empty(list)) {
+		int data_dir;
+
+		rq = rq_entry_fifo(list->next);
+		rq_fifo_clear(rq);
+		data_dir = rq_data_dir(rq);
+
+		elv_rb_add(&dh->sort_list[data_dir], rq);
+
+		/*
+		 * set expire time and add to fifo list
+		 */
+		rq->fifo_time = jiffies + dd->fifo_expire[data_dir];
+		list_add_tail(&rq->queuelist, &dh->fifo_list[data_dir]);
+	}
+	spin_unlock(&dh->lock);
+}
+
+/*
+ * deadline_check_fifo returns 0 if there are no expired requests on the fifo,
+ * 1 otherwise. Requires !list_empty(&dh->fifo_list[data_dir])
+ */
+static inline int deadline_check_fifo(struct dd_hctx *dh, int ddir)
+{
+	struct request *rq = rq_entry_fifo(dh->fifo_list[ddir].next);
+
+	/*
+	 * rq is expired!
+	 */
+	if (time_after_eq(jiffies, rq->fifo_time))
+		return 1;
+
+	return 0;
+}
+
+/*
+ * __dd_dispatch_request selects the best request according to
+ * read/write expire, fifo_batch, etc
+ */
+static struct request *
+__dd_dispatch_request(struct deadline_data *dd, struct dd_hctx *dh)
+{
+	const int reads = !list_empty(&dh->fifo_list[READ]);
+	const int writes = !list_empty(&dh->fifo_list[WRITE]);
+	struct request *rq;
+	int data_dir;
+
+	/*
+	 * batches are currently reads XOR writes
+	 */
+	if (dh->next_rq[WRITE])
+		rq = dh->next_rq[WRITE];
+	else
+		rq = dh->next_rq[READ];
+
+	if (rq && dh->batching < dd->fifo_batch)
+		/* we have a next request are still entitled to batch */
+		goto dispatch_request;
+
+	/*
+	 * at this point we are not running a batch. select the appropriate
+	 * data direction (read / write)
+	 */
+
+	if (reads) {
+		BUG_ON(RB_EMPTY_ROOT(&dh->sort_list[READ]));
+
+		if (writes && (dh->starved++ >= dd->writes_starved))
+			goto dispatch_writes;
+
+		data_dir = READ;
+
+		goto dispatch_find_request;
+	}
+
+	/*
+	 * there are either no reads or writes have been starved
+	 */
+
+	if (writes) {
+dispatch_writes:
+		BUG_ON(RB_EMPTY_ROOT(&dh->sort_list[WRITE]));
+
+		dh->starved = 0;
+
+		data_dir = WRITE;
+
+		goto dispatch_find_request;
+	}
+
+	return NULL;
+
+dispatch_find_request:
+	/*
+	 * we are not running a batch, find best request for selected data_dir
+	 */
+	if (deadline_check_fifo(dh, data_dir) || !dh->next_rq[data_dir]) {
+		/*
+		 * A deadline has expired, the last request was in the other
+		 * direction, or we have run out of higher-sectored requests.
+		 * Start again from the request with the earliest expiry time.
+		 */
+		rq = rq_entry_fifo(dh->fifo_list[data_dir].next);
+	} else {
+		/*
+		 * The last req was the same dir and we have a next request in
+		 * sort order. No expired requests so continue on from here.
+		 */
+		rq = dh->next_rq[data_dir];
+	}
+
+	dh->batching = 0;
+
+dispatch_request:
+	/*
+	 * rq is the selected appropriate request.
+	 */
+	dh->batching++;
+	dh->next_rq[READ] = NULL;
+	dh->next_rq[WRITE] = NULL;
+	dh->next_rq[rq_data_dir(rq)] = deadline_latter_request(rq);
+	deadline_remove_request(dh, rq);
+
+	return rq;
+}
+
+static struct request *dd_dispatch_request(struct elevator_queue *e,
+					   struct blk_mq_hw_ctx *hctx)
+{
+	struct dd_hctx *dh = dd_hctx(e, hctx);
+	struct request *rq;
+
+	spin_lock(&dh->lock);
+	rq = __dd_dispatch_request(e->elevator_data, dh);
+	spin_unlock(&dh->lock);
+
+	return rq;
+}
+
+static bool dd_has_work(struct elevator_queue *e, struct blk_mq_hw_ctx *hctx)
+{
+	struct dd_hctx *dh = dd_hctx(e, hctx);
+
+	return !list_empty_careful(&dh->fifo_list[READ]) ||
+		!list_empty_careful(&dh->fifo_list[WRITE]);
+}
+
+/*
+ * Reads may use every tag, writes only the first write_depth of them.
+ */
+static unsigned int dd_limit_depth(struct elevator_queue *e,
+				   struct blk_mq_hw_ctx *hctx, int rw)
+{
+	struct deadline_data *dd = e->elevator_data;
+
+	if (!(rw & REQ_WRITE))
+		return 0;
+
+	return READ_ONCE(dd->write_depth);
+}
+
+static void dd_exit_queue(struct elevator_queue *e)
+{
+	struct deadline_data *dd = e->elevator_data;
+	unsigned int i;
+
+	if (!dd)
+		return;
+
+	for (i = 0; i < dd->nr_hctx; i++) {
+		if (!dd->hctx[i])
+			continue;
+		BUG_ON(!list_empty(&dd->hctx[i]->fifo_list[READ]));
+		BUG_ON(!list_empty(&dd->hctx[i]->fifo_list[WRITE]));
+		kfree(dd->hctx[i]);
+	}
+
+	kfree(dd);
+}
+
+/*
+ * initialize elevator private data (deadline_data), and the run time data
+ * of every hardware context on its own node.
+ */
+static int dd_init_queue(struct request_queue *q, struct elevator_type *e)
+{
+	struct deadline_data *dd;
+	struct elevator_queue *eq;
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	eq = elevator_alloc(q, e);
+	if (!eq)
+		return -ENOMEM;
+
+	dd = kzalloc_node(sizeof(*dd) + q->nr_hw_queues * sizeof(dd->hctx[0]),
+			  GFP_KERNEL, q->node);
+	if (!dd)
+		goto free_eq;
+	eq->elevator_data = dd;
+	dd->nr_hctx = q->nr_hw_queues;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		struct dd_hctx *dh;
+
+		dh = kzalloc_node(sizeof(*dh), GFP_KERNEL, hctx->numa_node);
+		if (!dh) {
+			dd_exit_queue(eq);
+			goto free_eq;
+		}
+		spin_lock_init(&dh->lock);
+		INIT_LIST_HEAD(&dh->fifo_list[READ]);
+		INIT_LIST_HEAD(&dh->fifo_list[WRITE]);
+		dh->sort_list[READ] = RB_ROOT;
+		dh->sort_list[WRITE] = RB_ROOT;
+		dd->hctx[i] = dh;
+	}
+
+	dd->fifo_expire[READ] = read_expire;
+	dd->fifo_expire[WRITE] = write_expire;
+	dd->writes_starved = writes_starved;
+	dd->fifo_batch = fifo_batch;
+	dd->write_depth = max(q->nr_requests * 3 / 4, 1UL);
+
+	/*
+	 * Queue runs find the per hctx data through q->elevator under RCU,
+	 * so it has to be set up before the elevator is visible.
+	 */
+	rcu_assign_pointer(q->elevator, eq);
+	return 0;
+
+free_eq:
+	/*
+	 * Not through kobject_put(): its release drops the elevator type
+	 * reference, which stays with the caller when we fail.
+	 */
+	kfree(eq);
+	return -ENOMEM;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+deadline_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+deadline_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct deadline_data *dd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return deadline_var_show(__data, (page));			\
+}
+SHOW_FUNCTION(deadline_read_expire_show, dd->fifo_expire[READ], 1);
+SHOW_FUNCTION(deadline_write_expire_show, dd->fifo_expire[WRITE], 1);
+SHOW_FUNCTION(deadline_writes_starved_show, dd->writes_starved, 0);
+SHOW_FUNCTION(deadline_fifo_batch_show, dd->fifo_batch, 0);
+SHOW_FUNCTION(deadline_write_depth_show, dd->write_depth, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct deadline_data *dd = e->elevator_data;			\
+	int __data;							\
+	int ret = deadline_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(deadline_read_expire_store, &dd->fifo_expire[READ], 0, INT_MAX, 1);
+STORE_FUNCTION(deadline_write_expire_store, &dd->fifo_expire[WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(deadline_writes_starved_store, &dd->writes_starved, INT_MIN, INT_MAX, 0);
+STORE_FUNCTION(deadline_fifo_batch_store, &dd->fifo_batch, 0, INT_MAX, 0);
+STORE_FUNCTION(deadline_write_depth_store, &dd->write_depth, 1, INT_MAX, 0);
+#undef STORE_FUNCTION
+
+#define DD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, deadline_##name##_show, \
+				      deadline_##name##_store)
+
+static struct elv_fs_entry deadline_attrs[] = {
+	DD_ATTR(read_expire),
+	DD_ATTR(write_expire),
+	DD_ATTR(writes_starved),
+	DD_ATTR(fifo_batch),
+	DD_ATTR(write_depth),
+	__ATTR_NULL
+};
+
+static struct elevator_type mq_deadline = {
+	.ops = {
+		.elevator_init_fn =		dd_init_queue,
+		.elevator_exit_fn =		dd_exit_queue,
+	},
+	.mq_ops = {
+		.insert_requests =		dd_insert_requests,
+		.dispatch_request =		dd_dispatch_request,
+		.has_work =			dd_has_work,
+		.limit_depth =			dd_limit_depth,
+	},
+
+	.uses_mq = true,
+	.elevator_attrs = deadline_attrs,
+	.elevator_name = "mq-deadline",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init deadline_init(void)
+{
+	return elv_register(&mq_deadline);
+}
+
+static void __exit deadline_exit(void)
+{
+	elv_unregister(&mq_deadline);
+}
+
+module_init(deadline_init);
+module_exit(deadline_exit);
+
+MODULE_AUTHOR("Jens Axboe");
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("MQ deadline IO scheduler");
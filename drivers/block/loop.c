@@ -164,6 +164,50 @@ static loff_t get_loop_size(struct loop_device *lo, struct file *file)
 	return get_size(lo->lo_offset, lo->lo_sizelimit, file);
 }
 
+/*
+ * Direct I/O to the backing file needs a file system that supports it, no
+ * transfer function in the way, and loop sectors that are aligned the way
+ * the backing device wants: the loop device has 512 byte logical blocks.
+ */
+static void __loop_update_dio(struct loop_device *lo, bool dio)
+{
+	struct file *file = lo->lo_backing_file;
+	struct address_space *mapping = file->f_mapping;
+	struct inode *inode = mapping->host;
+	struct block_device *bdev;
+	unsigned short sb_bsize = 0;
+	unsigned dio_align = 0;
+	bool use_dio;
+
+	bdev = S_ISBLK(inode->i_mode) ? inode->i_bdev : inode->i_sb->s_bdev;
+	if (bdev) {
+		sb_bsize = bdev_logical_block_size(bdev);
+		dio_align = sb_bsize - 1;
+	}
+
+	use_dio = dio && mapping->a_ops->direct_IO && !lo->transfer &&
+		queue_logical_block_size(lo->lo_queue) >= sb_bsize &&
+		!(lo->lo_offset & dio_align);
+
+	if (lo->use_dio == use_dio)
+		return;
+
+	/* write back what went through the page cache so far */
+	vfs_fsync(file, 0);
+
+	/*
+	 * Requests in flight have been set up for the old mode, so switch
+	 * with the queue frozen.
+	 */
+	blk_mq_freeze_queue(lo->lo_queue);
+	lo->use_dio = use_dio;
+	if (use_dio)
+		lo->lo_flags |= LO_FLAGS_DIRECT_IO;
+	else
+		lo->lo_flags &= ~LO_FLAGS_DIRECT_IO;
+	blk_mq_unfreeze_queue(lo->lo_queue);
+}
+
 static int
 figure_loop_size(struct loop_device *lo, loff_t offset, loff_t sizelimit)
 {
@@ -389,8 +433,122 @@ static int lo_req_flush(struct loop_device *lo, struct request *rq)
 	return ret;
 }
 
+/*
+ * Zero what a read from the backing file came up short of, past its end.
+ */
+static void lo_zero_fill_tail(struct request *rq, unsigned int done)
+{
+	struct bio_vec bvec;
+	struct req_iterator iter;
+	unsigned int pos = 0;
+
+	rq_for_each_segment(bvec, rq, iter) {
+		if (pos + bvec.bv_len > done) {
+			unsigned int skip = done > pos ? done - pos : 0;
+
+			zero_user(bvec.bv_page, bvec.bv_offset + skip,
+				  bvec.bv_len - skip);
+		}
+		pos += bvec.bv_len;
+	}
+}
+
+static void lo_rw_aio_complete(struct kiocb *iocb, long ret, long ret2)
+{
+	struct loop_cmd *cmd = container_of(iocb, struct loop_cmd, iocb);
+	struct request *rq = cmd->rq;
+	unsigned int bytes = blk_rq_bytes(rq);
+
+	kfree(cmd->bvec);
+	cmd->bvec = NULL;
+
+	if (ret >= 0 && ret < bytes && !(rq->cmd_flags & REQ_WRITE)) {
+		lo_zero_fill_tail(rq, ret);
+		ret = bytes;
+	}
+
+	rq->errors = 0;
+	if (unlikely(ret != bytes)) {
+		printk_ratelimited(KERN_ERR
+			"loop: Direct %s error at byte offset %llu, length %u.\n",
+			(rq->cmd_flags & REQ_WRITE) ? "write" : "read",
+			(unsigned long long)iocb->ki_pos, bytes);
+		rq->errors = -EIO;
+	}
+	blk_mq_complete_request(rq);
+}
+
+/*
+ * Submit the request to the backing file as one O_DIRECT kiocb, and
+ * complete it from the kiocb completion.  The I/O goes straight from and
+ * to the pages of the request, without a copy in the page cache of the
+ * backing file.
+ */
+static int lo_rw_aio(struct loop_device *lo, struct loop_cmd *cmd,
+		     loff_t pos, int rw)
+{
+	struct request *rq = cmd->rq;
+	struct bio *bio = rq->bio;
+	struct file *file = lo->lo_backing_file;
+	unsigned int offset = 0;
+	struct iov_iter iter;
+	struct bio_vec *bvec;
+	int nr_bvec = 0;
+	ssize_t ret;
+
+	if (rq->bio != rq->biotail) {
+		struct req_iterator rq_iter;
+		struct bio_vec tmp;
+
+		/*
+		 * A merged request: gather the bvecs of all its bios into
+		 * one array for the iov_iter.
+		 */
+		rq_for_each_segment(tmp, rq, rq_iter)
+			nr_bvec++;
+		bvec = kmalloc_array(nr_bvec, sizeof(*bvec), GFP_NOIO);
+		if (!bvec)
+			return -EIO;
+		cmd->bvec = bvec;
+
+		rq_for_each_segment(tmp, rq, rq_iter)
+			*bvec++ = tmp;
+		bvec = cmd->bvec;
+	} else {
+		/*
+		 * Use the bvec array of the bio as is.  A split bio may
+		 * start in the middle of its first bvec.
+		 */
+		cmd->bvec = NULL;
+		offset = bio->bi_iter.bi_bvec_done;
+		bvec = __bvec_iter_bvec(bio->bi_io_vec, bio->bi_iter);
+		nr_bvec = bio_segments(bio);
+	}
+
+	iov_iter_bvec(&iter, ITER_BVEC | rw, bvec, nr_bvec, blk_rq_bytes(rq));
+	iter.iov_offset = offset;
+
+	cmd->iocb.ki_pos = pos;
+	cmd->iocb.ki_filp = file;
+	cmd->iocb.ki_complete = lo_rw_aio_complete;
+	cmd->iocb.ki_flags = IOCB_DIRECT;
+
+	if (rw == WRITE) {
+		file_start_write(file);
+		ret = file->f_op->write_iter(&cmd->iocb, &iter);
+		file_end_write(file);
+	} else {
+		ret = file->f_op->read_iter(&cmd->iocb, &iter);
+	}
+
+	if (ret != -EIOCBQUEUED)
+		lo_rw_aio_complete(&cmd->iocb, ret, 0);
+	return 0;
+}
+
 static int do_req_filebacked(struct loop_device *lo, struct request *rq)
 {
+	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
 	loff_t pos;
 	int ret;
 
@@ -401,13 +559,17 @@ static int do_req_filebacked(struct loop_device *lo, struct request *rq)
 			ret = lo_req_flush(lo, rq);
 		else if (rq->cmd_flags & REQ_DISCARD)
 			ret = lo_discard(lo, rq, pos);
+		else if (cmd->use_aio)
+			ret = lo_rw_aio(lo, cmd, pos, WRITE);
 		else if (lo->transfer)
 			ret = lo_write_transfer(lo, rq, pos);
 		else
 			ret = lo_write_simple(lo, rq, pos);
 
 	} else {
-		if (lo->transfer)
+		if (cmd->use_aio)
+			ret = lo_rw_aio(lo, cmd, pos, READ);
+		else if (lo->transfer)
 			ret = lo_read_transfer(lo, rq, pos);
 		else
 			ret = lo_read_simple(lo, rq, pos);
@@ -543,6 +705,7 @@ static int loop_change_fd(struct loop_device *lo, struct block_device *bdev,
 		goto out_putf;
 
 	fput(old_file);
+	__loop_update_dio(lo, lo->use_dio);
 	if (lo->lo_flags & LO_FLAGS_PARTSCAN)
 		loop_reread_partitions(lo, bdev);
 	return 0;
@@ -627,11 +790,19 @@ static ssize_t loop_attr_partscan_show(struct loop_device *lo, char *buf)
 	return sprintf(buf, "%s\n", partscan ? "1" : "0");
 }
 
+static ssize_t loop_attr_dio_show(struct loop_device *lo, char *buf)
+{
+	int dio = (lo->lo_flags & LO_FLAGS_DIRECT_IO);
+
+	return sprintf(buf, "%s\n", dio ? "1" : "0");
+}
+
 LOOP_ATTR_RO(backing_file);
 LOOP_ATTR_RO(offset);
 LOOP_ATTR_RO(sizelimit);
 LOOP_ATTR_RO(autoclear);
 LOOP_ATTR_RO(partscan);
+LOOP_ATTR_RO(dio);
 
 static struct attribute *loop_attrs[] = {
 	&loop_attr_backing_file.attr,
@@ -639,6 +810,7 @@ static struct attribute *loop_attrs[] = {
 	&loop_attr_sizelimit.attr,
 	&loop_attr_autoclear.attr,
 	&loop_attr_partscan.attr,
+	&loop_attr_dio.attr,
 	NULL,
 };
 
@@ -766,9 +938,14 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 	lo->old_gfp_mask = mapping_gfp_mask(mapping);
 	mapping_set_gfp_mask(mapping, lo->old_gfp_mask & ~(__GFP_IO|__GFP_FS));
 
+	lo->use_dio = false;
+
 	if (!(lo_flags & LO_FLAGS_READ_ONLY) && file->f_op->fsync)
 		blk_queue_flush(lo->lo_queue, REQ_FLUSH);
 
+	/* a backing file opened with O_DIRECT asks for direct I/O */
+	__loop_update_dio(lo, (file->f_flags & O_DIRECT) != 0);
+
 	set_capacity(lo->lo_disk, size);
 	bd_set_size(bdev, size << 9);
 	loop_sysfs_init(lo);
@@ -878,6 +1055,7 @@ static int loop_clr_fd(struct loop_device *lo)
 	lo->lo_offset = 0;
 	lo->lo_sizelimit = 0;
 	lo->lo_encrypt_key_size = 0;
+	lo->use_dio = false;
 	memset(lo->lo_encrypt_key, 0, LO_KEY_SIZE);
 	memset(lo->lo_crypt_name, 0, LO_NAME_SIZE);
 	memset(lo->lo_file_name, 0, LO_NAME_SIZE);
@@ -988,6 +1166,9 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 		lo->lo_key_owner = uid;
 	}
 
+	/* a transfer function or the new offset may rule out direct I/O */
+	__loop_update_dio(lo, lo->use_dio);
+
 	return 0;
 }
 
@@ -1138,6 +1319,17 @@ static int loop_set_capacity(struct loop_device *lo, struct block_device *bdev)
 	return figure_loop_size(lo, lo->lo_offset, lo->lo_sizelimit);
 }
 
+static int loop_set_dio(struct loop_device *lo, unsigned long arg)
+{
+	if (lo->lo_state != Lo_bound)
+		return -ENXIO;
+
+	__loop_update_dio(lo, !!arg);
+	if (lo->use_dio == !!arg)
+		return 0;
+	return -EINVAL;
+}
+
 static int lo_ioctl(struct block_device *bdev, fmode_t mode,
 	unsigned int cmd, unsigned long arg)
 {
@@ -1181,6 +1373,11 @@ static int lo_ioctl(struct block_device *bdev, fmode_t mode,
 		if ((mode & FMODE_WRITE) || capable(CAP_SYS_ADMIN))
 			err = loop_set_capacity(lo, bdev);
 		break;
+	case LOOP_SET_DIRECT_IO:
+		err = -EPERM;
+		if ((mode & FMODE_WRITE) || capable(CAP_SYS_ADMIN))
+			err = loop_set_dio(lo, arg);
+		break;
 	default:
 		err = lo->ioctl ? lo->ioctl(lo, cmd, arg) : -EINVAL;
 	}
@@ -1335,6 +1532,7 @@ static int lo_compat_ioctl(struct block_device *bdev, fmode_t mode,
 		arg = (unsigned long) compat_ptr(arg);
 	case LOOP_SET_FD:
 	case LOOP_CHANGE_FD:
+	case LOOP_SET_DIRECT_IO:
 		err = lo_ioctl(bdev, mode, cmd, arg);
 		break;
 	default:
@@ -1461,6 +1659,9 @@ static int loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 	if (lo->lo_state != Lo_bound)
 		return -EIO;
 
+	cmd->use_aio = lo->use_dio &&
+		!(cmd->rq->cmd_flags & (REQ_FLUSH | REQ_DISCARD));
+
 	if (cmd->rq->cmd_flags & REQ_WRITE) {
 		struct loop_device *lo = cmd->rq->q->queuedata;
 		bool need_sched = true;
@@ -1494,6 +1695,9 @@ static void loop_handle_cmd(struct loop_cmd *cmd)
 	ret = do_req_filebacked(lo, cmd->rq);
 
  failed:
+	/* direct I/O completes from lo_rw_aio_complete() */
+	if (cmd->use_aio && !ret)
+		return;
 	if (ret)
 		cmd->rq->errors = -EIO;
 	blk_mq_complete_request(cmd->rq);
@@ -1539,6 +1743,7 @@ static int loop_init_request(void *data, struct request *rq,
 	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
 
 	cmd->rq = rq;
+	cmd->bvec = NULL;
 	INIT_WORK(&cmd->read_work, loop_queue_read_work);
 
 	return 0;
@@ -49,6 +49,7 @@ struct loop_device {
 	struct file *	lo_backing_file;
 	struct block_device *lo_device;
 	unsigned	lo_blocksize;
+	bool		use_dio;
 	void		*key_data; 
 
 	gfp_t		old_gfp_mask;
@@ -70,6 +71,9 @@ struct loop_cmd {
 	struct work_struct read_work;
 	struct request *rq;
 	struct list_head list;
+	bool use_aio;		/* O_DIRECT kiocb to the backing file */
+	struct kiocb iocb;
+	struct bio_vec *bvec;	/* for requests of more than one bio */
 };
 
 /* Support for loadable transfer modules */
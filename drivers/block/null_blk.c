@@ -17,6 +17,7 @@ struct nullb_cmd {
 	struct bio *bio;
 	unsigned int tag;
 	struct nullb_queue *nq;
+	u64 ready_ns;		/* when the timer mode "hardware" is done */
 };
 
 struct nullb_queue {
@@ -264,6 +265,7 @@ static void null_cmd_end_timer(struct nullb_cmd *cmd)
 {
 	struct completion_queue *cq = &per_cpu(completion_queues, get_cpu());
 
+	cmd->ready_ns = ktime_get_ns() + completion_nsec;
 	cmd->ll_list.next = NULL;
 	if (llist_add(&cmd->ll_list, &cq->list)) {
 		ktime_t kt = ktime_set(0, completion_nsec);
@@ -274,6 +276,44 @@ static void null_cmd_end_timer(struct nullb_cmd *cmd)
 	put_cpu();
 }
 
+/*
+ * In timer mode, commands sit on the completion queue of the CPU that
+ * issued them until the timer "interrupt" fires.  Polling completes the
+ * ones whose completion_nsec has passed without waiting for that.
+ */
+static int null_poll(struct blk_mq_hw_ctx *hctx)
+{
+	struct completion_queue *cq;
+	struct llist_node *entry, *next;
+	struct nullb_cmd *cmd;
+	u64 now = ktime_get_ns();
+	int found = 0;
+
+	if (irqmode != NULL_IRQ_TIMER)
+		return -EINVAL;
+
+	cq = &per_cpu(completion_queues, get_cpu());
+	entry = llist_del_all(&cq->list);
+	while (entry) {
+		cmd = container_of(entry, struct nullb_cmd, ll_list);
+		next = entry->next;
+		if (cmd->ready_ns <= now) {
+			end_cmd(cmd);
+			found++;
+		} else {
+			cmd->ll_list.next = NULL;
+			if (llist_add(&cmd->ll_list, &cq->list))
+				hrtimer_start(&cq->timer,
+					      ns_to_ktime(cmd->ready_ns - now),
+					      HRTIMER_MODE_REL_PINNED);
+		}
+		entry = next;
+	}
+	put_cpu();
+
+	return found;
+}
+
 static void null_softirq_done_fn(struct request *rq)
 {
 	if (queue_mode == NULL_Q_MQ)
@@ -404,6 +444,7 @@ static struct blk_mq_ops null_mq_ops = {
 	.map_queue      = blk_mq_map_queue,
 	.init_hctx	= null_init_hctx,
 	.complete	= null_softirq_done_fn,
+	.poll		= null_poll,
 };
 
 static void null_del_dev(struct nullb *nullb)
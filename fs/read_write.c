@@ -16,6 +16,8 @@
 #include <linux/pagemap.h>
 #include <linux/splice.h>
 #include <linux/compat.h>
+#include <linux/iocontext.h>
+#include <linux/ioprio.h>
 #include "internal.h"
 
 #include <asm/uaccess.h>
@@ -408,6 +410,20 @@ int rw_verify_area(int read_write, struct file *file, const loff_t *ppos, size_t
 	return count > MAX_RW_COUNT ? MAX_RW_COUNT : count;
 }
 
+/*
+ * Synchronous reads and writes from tasks in the realtime I/O class are
+ * high priority: direct I/O polls for their completion if the device
+ * queue is set up for it.
+ */
+static void init_sync_kiocb_prio(struct kiocb *kiocb, struct file *filp)
+{
+	struct io_context *ioc = current->io_context;
+
+	init_sync_kiocb(kiocb, filp);
+	if (ioc && IOPRIO_PRIO_CLASS(ioc->ioprio) == IOPRIO_CLASS_RT)
+		kiocb->ki_flags |= IOCB_HIPRI;
+}
+
 static ssize_t new_sync_read(struct file *filp, char __user *buf, size_t len, loff_t *ppos)
 {
 	struct iovec iov = { .iov_base = buf, .iov_len = len };
@@ -415,7 +431,7 @@ static ssize_t new_sync_read(struct file *filp, char __user *buf, size_t len, lo
 	struct iov_iter iter;
 	ssize_t ret;
 
-	init_sync_kiocb(&kiocb, filp);
+	init_sync_kiocb_prio(&kiocb, filp);
 	kiocb.ki_pos = *ppos;
 	iov_iter_init(&iter, READ, &iov, 1, len);
 
@@ -471,7 +487,7 @@ static ssize_t new_sync_write(struct file *filp, const char __user *buf, size_t
 	struct iov_iter iter;
 	ssize_t ret;
 
-	init_sync_kiocb(&kiocb, filp);
+	init_sync_kiocb_prio(&kiocb, filp);
 	kiocb.ki_pos = *ppos;
 	iov_iter_init(&iter, WRITE, &iov, 1, len);
 
@@ -658,7 +674,7 @@ static ssize_t do_iter_readv_writev(struct file *filp, struct iov_iter *iter,
 	struct kiocb kiocb;
 	ssize_t ret;
 
-	init_sync_kiocb(&kiocb, filp);
+	init_sync_kiocb_prio(&kiocb, filp);
 	kiocb.ki_pos = *ppos;
 
 	ret = fn(&kiocb, iter);
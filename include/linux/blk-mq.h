@@ -49,6 +49,9 @@ struct blk_mq_hw_ctx {
 
 	unsigned long		queued;
 	unsigned long		run;
+	unsigned long		poll_invoked;
+	unsigned long		poll_success;
+	unsigned long		poll_sleeps;
 #define BLK_MQ_MAX_DISPATCH_ORDER	10
 	unsigned long		dispatched[BLK_MQ_MAX_DISPATCH_ORDER];
 
@@ -93,6 +96,7 @@ typedef int (init_request_fn)(void *, struct request *, unsigned int,
 		unsigned int, unsigned int);
 typedef void (exit_request_fn)(void *, struct request *, unsigned int,
 		unsigned int);
+typedef int (poll_fn)(struct blk_mq_hw_ctx *);
 
 typedef void (busy_iter_fn)(struct blk_mq_hw_ctx *, struct request *, void *,
 		bool);
@@ -116,6 +120,13 @@ struct blk_mq_ops {
 
 	softirq_done_fn		*complete;
 
+	/*
+	 * Called to poll for completions on a hardware queue, returns the
+	 * number of requests completed, or a negative errno if polling is
+	 * pointless.  Used by blk_poll().
+	 */
+	poll_fn			*poll;
+
 	/*
 	 * Called when the block layer side of a hardware queue has been
 	 * set up, allowing the driver to allocate/init matching structures.
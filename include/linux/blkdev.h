@@ -35,6 +35,7 @@ struct sg_io_hdr;
 struct bsg_job;
 struct blkcg_gq;
 struct blk_flush_queue;
+struct rq_wb;
 
 #define BLKDEV_MIN_RQ	4
 #define BLKDEV_MAX_RQ	128	/* Default maximum */
@@ -156,6 +157,8 @@ struct request {
 	unsigned long long start_time_ns;
 	unsigned long long io_start_time_ns;    /* when passed to hardware */
 #endif
+	u64 issue_time_ns;	/* when started, for blk-stat */
+	unsigned int issue_sectors;	/* size when started, for blk-stat */
 	/* Number of scatter-gather DMA addr+len pairs after
 	 * physical address coalescing is performed.
 	 */
@@ -283,6 +286,27 @@ struct queue_limits {
 	unsigned char		raid_partial_stripes_expensive;
 };
 
+/*
+ * Latency buckets: < 1024 nsec, then powers of two up to 1024 << 18 nsec
+ * (~268ms) and over.  Size buckets: < 4KiB, then powers of two up to
+ * 512KiB and over.
+ */
+#define BLK_STAT_LAT_BUCKETS	20
+#define BLK_STAT_SIZE_BUCKETS	9
+
+/*
+ * Completion statistics of one data direction, see block/blk-stat.c.
+ */
+struct blk_rq_stat {
+	u64 time;			/* start of the window */
+	u64 min;
+	u64 max;
+	u64 sum;
+	unsigned int nr_samples;
+	unsigned int lat[BLK_STAT_LAT_BUCKETS];
+	unsigned int size[BLK_STAT_SIZE_BUCKETS];
+};
+
 struct request_queue {
 	/*
 	 * Together with queue_head for cacheline sharing
@@ -462,6 +486,17 @@ struct request_queue {
 
 	struct blk_mq_tag_set	*tag_set;
 	struct list_head	tag_set_list;
+
+	/*
+	 * Polled completions: how long to sleep before polling, in nsecs
+	 * (-1 to poll right away, 0 for half the mean completion time).
+	 */
+	int			poll_nsec;
+
+	/* completion stats of request_fn queues, under queue_lock */
+	struct blk_rq_stat	rq_stats[2];
+
+	struct rq_wb		*rq_wb;		/* writeback throttling */
 };
 
 #define QUEUE_FLAG_QUEUED	1	/* uses generic tag queueing */
@@ -487,6 +522,7 @@ struct request_queue {
 #define QUEUE_FLAG_INIT_DONE   20	/* queue is initialized */
 #define QUEUE_FLAG_NO_SG_MERGE 21	/* don't attempt to merge SG segments*/
 #define QUEUE_FLAG_SG_GAPS     22	/* queue doesn't support SG gaps */
+#define QUEUE_FLAG_POLL	       23	/* IO polling enabled if set */
 
 #define QUEUE_FLAG_DEFAULT	((1 << QUEUE_FLAG_IO_STAT) |		\
 				 (1 << QUEUE_FLAG_STACKABLE)	|	\
@@ -575,6 +611,7 @@ static inline void queue_flag_clear(unsigned int flag, struct request_queue *q)
 #define blk_queue_discard(q)	test_bit(QUEUE_FLAG_DISCARD, &(q)->queue_flags)
 #define blk_queue_secdiscard(q)	(blk_queue_discard(q) && \
 	test_bit(QUEUE_FLAG_SECDISCARD, &(q)->queue_flags))
+#define blk_queue_poll(q)	test_bit(QUEUE_FLAG_POLL, &(q)->queue_flags)
 
 #define blk_noretry_request(rq) \
 	((rq)->cmd_flags & (REQ_FAILFAST_DEV|REQ_FAILFAST_TRANSPORT| \
@@ -1060,6 +1097,7 @@ extern struct blk_plug_cb *blk_check_plugged(blk_plug_cb_fn unplug,
 extern void blk_start_plug(struct blk_plug *);
 extern void blk_finish_plug(struct blk_plug *);
 extern void blk_flush_plug_list(struct blk_plug *, bool);
+extern bool blk_poll(struct request_queue *q, bool hybrid);
 
 static inline void blk_flush_plug(struct task_struct *tsk)
 {
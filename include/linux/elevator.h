@@ -41,6 +41,37 @@ typedef int (elevator_init_fn) (struct request_queue *,
 typedef void (elevator_exit_fn) (struct elevator_queue *);
 typedef void (elevator_registered_fn) (struct request_queue *);
 
+struct blk_mq_hw_ctx;
+
+/*
+ * Schedulers for blk-mq queues.  Requests reach the scheduler when the
+ * hardware queue is run and are pulled out one at a time while the driver
+ * accepts them, so that everything the device can't take yet stays in the
+ * scheduler.  These are called per hardware context, under RCU from the
+ * queue run, and only need to serialize against themselves on that
+ * context.  elevator_init_fn sets up all hardware contexts before it
+ * attaches the elevator_queue to the queue.
+ */
+typedef void (elevator_insert_requests_fn) (struct elevator_queue *,
+					    struct blk_mq_hw_ctx *,
+					    struct list_head *);
+typedef struct request *(elevator_dispatch_request_fn) (struct elevator_queue *,
+							struct blk_mq_hw_ctx *);
+typedef bool (elevator_has_work_fn) (struct elevator_queue *,
+				     struct blk_mq_hw_ctx *);
+typedef unsigned int (elevator_limit_depth_fn) (struct elevator_queue *,
+						struct blk_mq_hw_ctx *, int);
+
+struct elevator_mq_ops
+{
+	elevator_insert_requests_fn *insert_requests;
+	elevator_dispatch_request_fn *dispatch_request;
+	elevator_has_work_fn *has_work;
+
+	/* tags a new request with these rw flags may use, 0 for all */
+	elevator_limit_depth_fn *limit_depth;
+};
+
 struct elevator_ops
 {
 	elevator_merge_fn *elevator_merge_fn;
@@ -90,6 +121,8 @@ struct elevator_type
 
 	/* fields provided by elevator implementation */
 	struct elevator_ops ops;
+	struct elevator_mq_ops mq_ops;	/* blk-mq queues, if uses_mq */
+	bool uses_mq;
 	size_t icq_size;	/* see iocontext.h */
 	size_t icq_align;	/* ditto */
 	struct elv_fs_entry *elevator_attrs;
@@ -156,6 +189,7 @@ extern ssize_t elv_iosched_store(struct request_queue *, const char *, size_t);
 
 extern int elevator_init(struct request_queue *, char *);
 extern void elevator_exit(struct elevator_queue *);
+extern void elevator_exit_mq(struct request_queue *);
 extern int elevator_change(struct request_queue *, const char *);
 extern bool elv_rq_merge_ok(struct request *, struct bio *);
 extern struct elevator_queue *elevator_alloc(struct request_queue *,
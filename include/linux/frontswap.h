@@ -8,6 +8,8 @@
 struct frontswap_ops {
 	void (*init)(unsigned); /* this swap type was just swapon'ed */
 	int (*store)(unsigned, pgoff_t, struct page *); /* store a page */
+	/* optional: store a page in the background, see frontswap_store_end */
+	int (*store_async)(unsigned, pgoff_t, struct page *);
 	int (*load)(unsigned, pgoff_t, struct page *); /* load a page */
 	void (*invalidate_page)(unsigned, pgoff_t); /* page no longer needed */
 	void (*invalidate_area)(unsigned); /* swap type just swapoff'ed */
@@ -25,6 +27,8 @@ extern void frontswap_tmem_exclusive_gets(bool);
 extern bool __frontswap_test(struct swap_info_struct *, pgoff_t);
 extern void __frontswap_init(unsigned type, unsigned long *map);
 extern int __frontswap_store(struct page *page);
+extern int __frontswap_store_async(struct page *page);
+extern void frontswap_store_end(struct page *page, int ret);
 extern int __frontswap_load(struct page *page);
 extern void __frontswap_invalidate_page(unsigned, pgoff_t);
 extern void __frontswap_invalidate_area(unsigned);
@@ -77,6 +81,15 @@ static inline int frontswap_store(struct page *page)
 	return ret;
 }
 
+static inline int frontswap_store_async(struct page *page)
+{
+	int ret = -1;
+
+	if (frontswap_enabled)
+		ret = __frontswap_store_async(page);
+	return ret;
+}
+
 static inline int frontswap_load(struct page *page)
 {
 	int ret = -1;
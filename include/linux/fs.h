@@ -319,6 +319,7 @@ struct writeback_control;
 #define IOCB_EVENTFD		(1 << 0)
 #define IOCB_APPEND		(1 << 1)
 #define IOCB_DIRECT		(1 << 2)
+#define IOCB_HIPRI		(1 << 3)
 
 struct kiocb {
 	struct file		*ki_filp;
@@ -813,6 +814,21 @@ struct fown_struct {
 	int signum;		/* posix.1b rt signal to be delivered on IO */
 };
 
+/*
+ * Number of interleaved sequential streams tracked per file on top of
+ * the current readahead window.
+ */
+#define RA_STREAMS	4
+
+/*
+ * A parked readahead window, see struct file_ra_state.
+ */
+struct ra_stream {
+	pgoff_t start;
+	unsigned int size;
+	unsigned int async_size;
+};
+
 /*
  * Track a single file's readahead state
  */
@@ -825,6 +841,14 @@ struct file_ra_state {
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
 	loff_t prev_pos;		/* Cache last read() position */
+
+	pgoff_t prev_miss;		/* offset of the last readahead miss */
+	long stride;			/* distance between the last misses */
+	unsigned char pattern;		/* detected access pattern */
+	unsigned char confidence;	/* # of misses confirming stride */
+	unsigned char late;		/* readahead I/O found still in flight */
+	unsigned char next_stream;	/* next streams[] slot to reuse */
+	struct ra_stream streams[RA_STREAMS];	/* other sequential streams */
 };
 
 /*
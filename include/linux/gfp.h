@@ -318,6 +318,43 @@ static inline struct page *alloc_pages_exact_node(int nid, gfp_t gfp_mask,
 	return __alloc_pages(gfp_mask, order, node_zonelist(nid, gfp_mask));
 }
 
+unsigned long
+__alloc_pages_bulk(gfp_t gfp_mask, struct zonelist *zonelist,
+		   nodemask_t *nodemask, unsigned long nr_pages,
+		   struct list_head *page_list, struct page **page_array);
+
+/* Allocate up to @nr_pages order-0 pages and add them to @list */
+static inline unsigned long alloc_pages_bulk_node(int nid, gfp_t gfp_mask,
+						  unsigned long nr_pages,
+						  struct list_head *list)
+{
+	/* Unknown node is current node */
+	if (nid < 0)
+		nid = numa_node_id();
+
+	return __alloc_pages_bulk(gfp_mask, node_zonelist(nid, gfp_mask), NULL,
+				  nr_pages, list, NULL);
+}
+
+/* Fill the NULL entries among the first @nr_pages of @array */
+static inline unsigned long alloc_pages_bulk_array_node(int nid,
+							gfp_t gfp_mask,
+							unsigned long nr_pages,
+							struct page **array)
+{
+	/* Unknown node is current node */
+	if (nid < 0)
+		nid = numa_node_id();
+
+	return __alloc_pages_bulk(gfp_mask, node_zonelist(nid, gfp_mask), NULL,
+				  nr_pages, NULL, array);
+}
+
+#define alloc_pages_bulk(gfp_mask, nr_pages, list)			\
+	alloc_pages_bulk_node(NUMA_NO_NODE, gfp_mask, nr_pages, list)
+#define alloc_pages_bulk_array(gfp_mask, nr_pages, array)		\
+	alloc_pages_bulk_array_node(NUMA_NO_NODE, gfp_mask, nr_pages, array)
+
 #ifdef CONFIG_NUMA
 extern struct page *alloc_pages_current(gfp_t gfp_mask, unsigned order);
 
@@ -40,6 +40,36 @@ static __always_inline void del_page_from_lru_list(struct page *page,
 	__mod_zone_page_state(lruvec_zone(lruvec), NR_LRU_BASE + lru, -nr_pages);
 }
 
+/*
+ * relock_page_lruvec_irq - switch to the lruvec lock covering @page
+ * @page: the next page of a batch
+ * @locked: the lruvec whose lock is held, or NULL
+ *
+ * Batched LRU operations use this to move between lruvecs; the pages of a
+ * batch usually belong to the same memcg, so the lock is mostly kept.
+ */
+static inline struct lruvec *relock_page_lruvec_irq(struct page *page,
+						    struct lruvec *locked)
+{
+	if (locked) {
+		if (mem_cgroup_page_lruvec(page, page_zone(page)) == locked)
+			return locked;
+		spin_unlock_irq(&locked->lru_lock);
+	}
+	return lock_page_lruvec_irq(page);
+}
+
+static inline struct lruvec *relock_page_lruvec_irqsave(struct page *page,
+				struct lruvec *locked, unsigned long *flags)
+{
+	if (locked) {
+		if (mem_cgroup_page_lruvec(page, page_zone(page)) == locked)
+			return locked;
+		spin_unlock_irqrestore(&locked->lru_lock, *flags);
+	}
+	return lock_page_lruvec_irqsave(page, flags);
+}
+
 /**
  * page_lru_base_type - which LRU list type should a page be on?
  * @page: the page to test
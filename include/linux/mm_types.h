@@ -116,7 +116,7 @@ struct page {
 	/* Third double word block */
 	union {
 		struct list_head lru;	/* Pageout list, eg. active_list
-					 * protected by zone->lru_lock !
+					 * protected by lruvec->lru_lock !
 					 * Can be used as a generic list
 					 * by the page owner.
 					 */
@@ -356,6 +356,7 @@ struct mm_rss_stat {
 };
 
 struct kioctx_table;
+struct futex_private_hash;
 struct mm_struct {
 	struct vm_area_struct *mmap;		/* list of VMAs */
 	struct rb_root mm_rb;
@@ -423,6 +424,10 @@ struct mm_struct {
 	spinlock_t			ioctx_lock;
 	struct kioctx_table __rcu	*ioctx_table;
 #endif
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+	/* hash table for the futexes private to this mm, see futex.c */
+	struct futex_private_hash	*futex_hash;
+#endif
 #ifdef CONFIG_MEMCG
 	/*
 	 * "owner" points to a task that is regarded as the canonical
@@ -97,9 +97,9 @@ struct free_area {
 struct pglist_data;
 
 /*
- * zone->lock and zone->lru_lock are two of the hottest locks in the kernel.
- * So add a wild amount of padding here to ensure that they fall into separate
- * cachelines.  There are very few zone structures in the machine, so space
+ * zone->lock and the zone's lruvec lock are two of the hottest locks in the
+ * kernel.  So add a wild amount of padding here to ensure that they fall into
+ * separate cachelines.  There are very few zone structures in the machine, so space
  * consumption is not a concern here.
  */
 #if defined(CONFIG_SMP)
@@ -214,6 +214,12 @@ struct zone_reclaim_stat {
 };
 
 struct lruvec {
+	/*
+	 * With memcg, every cgroup has its own lruvec in each zone, so
+	 * that containers faulting and reclaiming on the same node do
+	 * not all serialise on one lock.
+	 */
+	spinlock_t lru_lock;
 	struct list_head lists[NR_LRU_LISTS];
 	struct zone_reclaim_stat reclaim_stat;
 #ifdef CONFIG_MEMCG
@@ -488,7 +494,6 @@ struct zone {
 	/* Write-intensive fields used by page reclaim */
 
 	/* Fields commonly accessed by the page reclaim scanner */
-	spinlock_t		lru_lock;
 	struct lruvec		lruvec;
 
 	/* Evictions & activations on the inactive file list */
@@ -752,6 +757,11 @@ typedef struct pglist_data {
 					   mem_hotplug_begin/end() */
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
+#ifdef CONFIG_COMPACTION
+	wait_queue_head_t kcompactd_wait;
+	struct task_struct *kcompactd;	/* Protected by
+					   mem_hotplug_begin/end() */
+#endif
 #ifdef CONFIG_NUMA_BALANCING
 	/* Lock serializing the migrate rate limiting window */
 	spinlock_t numabalancing_migrate_lock;
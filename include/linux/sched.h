@@ -1003,6 +1003,31 @@ extern int sched_domain_level_max;
 
 struct sched_group;
 
+/*
+ * State shared between all CPUs of a sched_domain, currently only used for
+ * the LLC domain to track which CPUs and cores are idle so that
+ * select_idle_sibling() does not need to scan the domain.
+ */
+struct sched_domain_shared {
+	atomic_t	ref;
+
+	/*
+	 * Two cpumasks follow: the idle CPUs and the CPUs of fully idle
+	 * cores. NOTE: variable length, see sds_idle_cpus().
+	 */
+	unsigned long	cpumasks[0];
+};
+
+static inline struct cpumask *sds_idle_cpus(struct sched_domain_shared *sds)
+{
+	return to_cpumask(sds->cpumasks);
+}
+
+static inline struct cpumask *sds_idle_cores(struct sched_domain_shared *sds)
+{
+	return to_cpumask(sds->cpumasks + BITS_TO_LONGS(nr_cpumask_bits));
+}
+
 struct sched_domain {
 	/* These fields must be setup */
 	struct sched_domain *parent;	/* top domain must be null terminated */
@@ -1033,6 +1058,9 @@ struct sched_domain {
 	u64 max_newidle_lb_cost;
 	unsigned long next_decay_max_lb_cost;
 
+	/* select_idle_sibling() stats */
+	u64 avg_scan_cost;
+
 #ifdef CONFIG_SCHEDSTATS
 	/* load_balance() stats */
 	unsigned int lb_count[CPU_MAX_IDLE_TYPES];
@@ -1071,6 +1099,7 @@ struct sched_domain {
 		void *private;		/* used during construction */
 		struct rcu_head rcu;	/* used during destruction */
 	};
+	struct sched_domain_shared *shared;
 
 	unsigned int span_weight;
 	/*
@@ -1104,6 +1133,7 @@ typedef int (*sched_domain_flags_f)(void);
 
 struct sd_data {
 	struct sched_domain **__percpu sd;
+	struct sched_domain_shared **__percpu sds;
 	struct sched_group **__percpu sg;
 	struct sched_group_capacity **__percpu sgc;
 };
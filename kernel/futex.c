@@ -64,6 +64,7 @@
 #include <linux/hugetlb.h>
 #include <linux/freezer.h>
 #include <linux/bootmem.h>
+#include <linux/vmalloc.h>
 
 #include <asm/futex.h>
 
@@ -258,6 +259,46 @@ static unsigned long __read_mostly futex_hashsize;
 
 static struct futex_hash_bucket *futex_queues;
 
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+/*
+ * Per-process futex hash.
+ *
+ * Futexes whose key is based on the mm (PROCESS_PRIVATE futexes and futexes
+ * on private mappings) can only ever be used by the threads of that mm. They
+ * can thus be hashed into a table private to the mm, which is allocated on
+ * the node the process runs on. Only inode based (shared) futexes go through
+ * the global futex_queues.
+ *
+ * The table is never resized, so it is sized for the number of threads the
+ * process may end up running concurrently rather than the number it has
+ * when it is set up: four buckets per possible CPU, or per thread if there
+ * are more threads than that.
+ *
+ * The mm decides once whether it uses a private table, on the first futex
+ * key taken on it while it has more than one user. A single threaded
+ * process keeps using the global table: with nobody to wait on them its
+ * futexes never block for long, and it does not pay for a table it would
+ * not use. No thread of the mm can be queued on a futex while the mm has a
+ * single user, so no waiter is ever left behind in the global table when
+ * the switch happens. If the sysctl is off or the allocation fails,
+ * FUTEX_HASH_GLOBAL records that the global table is used for the life of
+ * the mm.
+ */
+struct futex_private_hash {
+	unsigned long hashsize;
+	struct futex_hash_bucket queues[0];
+};
+
+#define FUTEX_HASH_GLOBAL	((struct futex_private_hash *)1UL)
+
+/* Buckets per possible CPU or thread of the process. */
+#define FUTEX_PRIVATE_HASH_SCALE	4
+/* Smallest private table. */
+#define FUTEX_PRIVATE_HASH_MIN		16
+
+int sysctl_futex_private_hash __read_mostly = 1;
+#endif
+
 static inline void futex_get_mm(union futex_key *key)
 {
 	atomic_inc(&key->private.mm->mm_count);
@@ -311,9 +352,101 @@ static struct futex_hash_bucket *hash_futex(union futex_key *key)
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+	if (!(key->both.offset & FUT_OFF_INODE)) {
+		struct futex_private_hash *fph;
+
+		fph = lockless_dereference(key->private.mm->futex_hash);
+		if (fph && fph != FUTEX_HASH_GLOBAL)
+			return &fph->queues[hash & (fph->hashsize - 1)];
+	}
+#endif
 	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+static struct futex_private_hash *futex_private_hash_alloc(struct mm_struct *mm)
+{
+	struct futex_private_hash *fph;
+	unsigned long hashsize, i;
+	int nid = numa_node_id();
+	size_t size;
+
+#ifdef CONFIG_NUMA_BALANCING
+	if (current->numa_preferred_nid != -1)
+		nid = current->numa_preferred_nid;
+#endif
+
+	hashsize = max_t(unsigned long, num_possible_cpus(),
+			 atomic_read(&mm->mm_users));
+	hashsize = roundup_pow_of_two(hashsize * FUTEX_PRIVATE_HASH_SCALE);
+	hashsize = clamp(hashsize, (unsigned long)FUTEX_PRIVATE_HASH_MIN,
+			 futex_hashsize);
+
+	size = sizeof(*fph) + hashsize * sizeof(struct futex_hash_bucket);
+	if (size <= (PAGE_SIZE << PAGE_ALLOC_COSTLY_ORDER))
+		fph = kmalloc_node(size, GFP_KERNEL | __GFP_NOWARN, nid);
+	else
+		fph = vmalloc_node(size, nid);
+	if (!fph)
+		return NULL;
+
+	fph->hashsize = hashsize;
+	for (i = 0; i < hashsize; i++) {
+		atomic_set(&fph->queues[i].waiters, 0);
+		plist_head_init(&fph->queues[i].chain);
+		spin_lock_init(&fph->queues[i].lock);
+	}
+
+	return fph;
+}
+
+/*
+ * Called for every mm based futex key before it gets hashed; decides which
+ * table the futexes of @mm go to if that did not happen yet and @mm got a
+ * second user.
+ */
+static void futex_private_hash_setup(struct mm_struct *mm)
+{
+	struct futex_private_hash *fph = NULL;
+
+	if (likely(READ_ONCE(mm->futex_hash)))
+		return;
+	if (atomic_read(&mm->mm_users) <= 1)
+		return;
+
+	if (sysctl_futex_private_hash)
+		fph = futex_private_hash_alloc(mm);
+	if (!fph)
+		fph = FUTEX_HASH_GLOBAL;
+
+	if (cmpxchg(&mm->futex_hash, NULL, fph) && fph != FUTEX_HASH_GLOBAL)
+		kvfree(fph);
+}
+
+void futex_mm_init(struct mm_struct *mm)
+{
+	mm->futex_hash = NULL;
+}
+
+/*
+ * Called when the last user of @mm is gone, so no thread can have a futex
+ * queued on its private table anymore.
+ */
+void futex_mm_free(struct mm_struct *mm)
+{
+	struct futex_private_hash *fph = mm->futex_hash;
+
+	if (fph && fph != FUTEX_HASH_GLOBAL)
+		kvfree(fph);
+	mm->futex_hash = NULL;
+}
+#else
+static inline void futex_private_hash_setup(struct mm_struct *mm)
+{
+}
+#endif
+
 /*
  * Return 1 if two futex_keys are equal, 0 otherwise.
  */
@@ -421,6 +554,7 @@ get_futex_key(u32 __user *uaddr, int fshared, union futex_key *key, int rw)
 	 *        but access_ok() should be faster than find_vma()
 	 */
 	if (!fshared) {
+		futex_private_hash_setup(mm);
 		key->private.mm = mm;
 		key->private.address = address;
 		get_futex_key_refs(key);  /* implies MB (B) */
@@ -535,6 +669,9 @@ again:
 out:
 	unlock_page(page_head);
 	put_page(page_head);
+
+	if (!err && (key->both.offset & FUT_OFF_MMSHARED))
+		futex_private_hash_setup(mm);
 	return err;
 }
 
@@ -27,6 +27,7 @@
 #include <linux/rwlock.h>
 #include <linux/mutex.h>
 #include <linux/rwsem.h>
+#include <linux/rtmutex.h>
 #include <linux/smp.h>
 #include <linux/interrupt.h>
 #include <linux/sched.h>
@@ -54,6 +55,10 @@ torture_param(int, stat_interval, 60,
 torture_param(int, stutter, 5, "Number of jiffies to run/halt test, 0=disable");
 torture_param(bool, verbose, true,
 	     "Enable verbose debugging printk()s");
+torture_param(bool, bench, false,
+	     "Benchmark mode: fixed critical sections, report throughput and latency");
+torture_param(int, bench_hold_ns, 500,
+	     "Critical section length in benchmark mode (ns)");
 
 static char *torture_type = "spin_lock";
 module_param(torture_type, charp, 0444);
@@ -70,8 +75,13 @@ static bool lock_is_read_held;
 struct lock_stress_stats {
 	long n_lock_fail;
 	long n_lock_acquired;
+	u64 lat_sum;	/* benchmark mode: total time spent acquiring (ns) */
+	u64 lat_max;	/* benchmark mode: longest acquisition (ns) */
 };
 
+/* Start of the measurement in benchmark mode. */
+static u64 bench_start;
+
 #if defined(MODULE)
 #define LOCKTORTURE_RUNNABLE_INIT 1
 #else
@@ -361,6 +371,36 @@ static struct lock_torture_ops mutex_lock_ops = {
 	.name		= "mutex_lock"
 };
 
+#ifdef CONFIG_RT_MUTEXES
+static DEFINE_RT_MUTEX(torture_rtmutex);
+
+static int torture_rtmutex_lock(void) __acquires(torture_rtmutex)
+{
+	rt_mutex_lock(&torture_rtmutex);
+	return 0;
+}
+
+static void torture_rtmutex_unlock(void) __releases(torture_rtmutex)
+{
+	rt_mutex_unlock(&torture_rtmutex);
+}
+
+/*
+ * Share the spinlock delay: its short busy-waiting holds keep the owner
+ * running, so that rt_mutex waiters get to spin on the owner rather than
+ * always going to sleep.
+ */
+static struct lock_torture_ops rtmutex_lock_ops = {
+	.writelock	= torture_rtmutex_lock,
+	.write_delay	= torture_spin_lock_write_delay,
+	.writeunlock	= torture_rtmutex_unlock,
+	.readlock       = NULL,
+	.read_delay     = NULL,
+	.readunlock     = NULL,
+	.name		= "rtmutex_lock"
+};
+#endif
+
 static DECLARE_RWSEM(torture_rwsem);
 static int torture_rwsem_down_write(void) __acquires(torture_rwsem)
 {
@@ -426,6 +466,27 @@ static struct lock_torture_ops rwsem_lock_ops = {
 	.name		= "rwsem_lock"
 };
 
+/*
+ * Benchmark mode: time a lock acquisition and account it to @lsp.
+ */
+static u64 lock_torture_bench_start(void)
+{
+	return bench ? local_clock() : 0;
+}
+
+static void lock_torture_bench_end(struct lock_stress_stats *lsp, u64 start)
+{
+	u64 lat;
+
+	if (!bench)
+		return;
+
+	lat = local_clock() - start;
+	lsp->lat_sum += lat;
+	if (lat > lsp->lat_max)
+		lsp->lat_max = lat;
+}
+
 /*
  * Lock torture writer kthread.  Repeatedly acquires and releases
  * the lock, checking for duplicate acquisitions.
@@ -434,6 +495,7 @@ static int lock_torture_writer(void *arg)
 {
 	struct lock_stress_stats *lwsp = arg;
 	static DEFINE_TORTURE_RANDOM(rand);
+	u64 start;
 
 	VERBOSE_TOROUT_STRING("lock_torture_writer task started");
 	set_user_nice(current, MAX_NICE);
@@ -442,7 +504,9 @@ static int lock_torture_writer(void *arg)
 		if ((torture_random(&rand) & 0xfffff) == 0)
 			schedule_timeout_uninterruptible(1);
 
+		start = lock_torture_bench_start();
 		cxt.cur_ops->writelock();
+		lock_torture_bench_end(lwsp, start);
 		if (WARN_ON_ONCE(lock_is_write_held))
 			lwsp->n_lock_fail++;
 		lock_is_write_held = 1;
@@ -450,7 +514,10 @@ static int lock_torture_writer(void *arg)
 			lwsp->n_lock_fail++; /* rare, but... */
 
 		lwsp->n_lock_acquired++;
-		cxt.cur_ops->write_delay(&rand);
+		if (bench)
+			ndelay(bench_hold_ns);
+		else
+			cxt.cur_ops->write_delay(&rand);
 		lock_is_write_held = 0;
 		cxt.cur_ops->writeunlock();
 
@@ -468,6 +535,7 @@ static int lock_torture_reader(void *arg)
 {
 	struct lock_stress_stats *lrsp = arg;
 	static DEFINE_TORTURE_RANDOM(rand);
+	u64 start;
 
 	VERBOSE_TOROUT_STRING("lock_torture_reader task started");
 	set_user_nice(current, MAX_NICE);
@@ -476,13 +544,18 @@ static int lock_torture_reader(void *arg)
 		if ((torture_random(&rand) & 0xfffff) == 0)
 			schedule_timeout_uninterruptible(1);
 
+		start = lock_torture_bench_start();
 		cxt.cur_ops->readlock();
+		lock_torture_bench_end(lrsp, start);
 		lock_is_read_held = 1;
 		if (WARN_ON_ONCE(lock_is_write_held))
 			lrsp->n_lock_fail++; /* rare, but... */
 
 		lrsp->n_lock_acquired++;
-		cxt.cur_ops->read_delay(&rand);
+		if (bench)
+			ndelay(bench_hold_ns);
+		else
+			cxt.cur_ops->read_delay(&rand);
 		lock_is_read_held = 0;
 		cxt.cur_ops->readunlock();
 
@@ -503,12 +576,16 @@ static void __torture_print_stats(char *page,
 	long max = 0;
 	long min = statp[0].n_lock_acquired;
 	long long sum = 0;
+	u64 lat_sum = 0, lat_max = 0;
 
 	n_stress = write ? cxt.nrealwriters_stress : cxt.nrealreaders_stress;
 	for (i = 0; i < n_stress; i++) {
 		if (statp[i].n_lock_fail)
 			fail = true;
 		sum += statp[i].n_lock_acquired;
+		lat_sum += statp[i].lat_sum;
+		if (lat_max < statp[i].lat_max)
+			lat_max = statp[i].lat_max;
 		if (max < statp[i].n_lock_fail)
 			max = statp[i].n_lock_fail;
 		if (min > statp[i].n_lock_fail)
@@ -519,6 +596,16 @@ static void __torture_print_stats(char *page,
 			write ? "Writes" : "Reads ",
 			sum, max, min, max / 2 > min ? "???" : "",
 			fail, fail ? "!!!" : "");
+	if (bench) {
+		u64 elapsed_ms = div64_u64(local_clock() - bench_start,
+					   NSEC_PER_MSEC) ?: 1;
+
+		page += sprintf(page,
+				"%s:  Throughput: %llu/s  Latency avg/max: %llu/%llu ns\n",
+				write ? "Writes" : "Reads ",
+				div64_u64(sum * MSEC_PER_SEC, elapsed_ms),
+				sum ? div64_u64(lat_sum, sum) : 0, lat_max);
+	}
 	if (fail)
 		atomic_inc(&cxt.n_lock_torture_errors);
 }
@@ -588,11 +675,11 @@ lock_torture_print_module_parms(struct lock_torture_ops *cur_ops,
 				const char *tag)
 {
 	pr_alert("%s" TORTURE_FLAG
-		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d\n",
+		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d bench=%d bench_hold_ns=%d\n",
 		 torture_type, tag, cxt.debug_lock ? " [debug]": "",
 		 cxt.nrealwriters_stress, cxt.nrealreaders_stress, stat_interval,
 		 verbose, shuffle_interval, stutter, shutdown_secs,
-		 onoff_interval, onoff_holdoff);
+		 onoff_interval, onoff_holdoff, bench, bench_hold_ns);
 }
 
 static void lock_torture_cleanup(void)
@@ -642,6 +729,9 @@ static int __init lock_torture_init(void)
 		&spin_lock_ops, &spin_lock_irq_ops,
 		&rw_lock_ops, &rw_lock_irq_ops,
 		&mutex_lock_ops,
+#ifdef CONFIG_RT_MUTEXES
+		&rtmutex_lock_ops,
+#endif
 		&rwsem_lock_ops,
 	};
 
@@ -694,6 +784,8 @@ static int __init lock_torture_init(void)
 	for (i = 0; i < cxt.nrealwriters_stress; i++) {
 		cxt.lwsa[i].n_lock_fail = 0;
 		cxt.lwsa[i].n_lock_acquired = 0;
+		cxt.lwsa[i].lat_sum = 0;
+		cxt.lwsa[i].lat_max = 0;
 	}
 
 	if (cxt.cur_ops->readlock) {
@@ -722,9 +814,12 @@ static int __init lock_torture_init(void)
 		for (i = 0; i < cxt.nrealreaders_stress; i++) {
 			cxt.lrsa[i].n_lock_fail = 0;
 			cxt.lrsa[i].n_lock_acquired = 0;
+			cxt.lrsa[i].lat_sum = 0;
+			cxt.lrsa[i].lat_max = 0;
 		}
 	}
 	lock_torture_print_module_parms(cxt.cur_ops, "Start of test");
+	bench_start = local_clock();
 
 	/* Prepare torture context. */
 	if (onoff_interval > 0) {
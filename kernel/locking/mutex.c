@@ -27,6 +27,9 @@
 #include <linux/debug_locks.h>
 #include <linux/osq_lock.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/lock.h>
+
 /*
  * In the DEBUG case we are using the "NULL fastpath" for mutexes,
  * which forces all calls into the slowpath:
@@ -517,8 +520,14 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 	preempt_disable();
 	mutex_acquire_nest(&lock->dep_map, subclass, 0, nest_lock, ip);
 
+	/*
+	 * One contention_begin for the whole slowpath, spinning and then
+	 * sleeping, and one contention_end on each way out of it.
+	 */
+	trace_contention_begin(lock, LCB_F_MUTEX | LCB_F_SPIN);
 	if (mutex_optimistic_spin(lock, ww_ctx, use_ww_ctx)) {
 		/* got the lock, yay! */
+		trace_contention_end(lock, 0);
 		preempt_enable();
 		return 0;
 	}
@@ -529,8 +538,10 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 	 * Once more, try to acquire the lock. Only try-lock the mutex if
 	 * it is unlocked to reduce unnecessary xchg() operations.
 	 */
-	if (!mutex_is_locked(lock) && (atomic_xchg(&lock->count, 0) == 1))
+	if (!mutex_is_locked(lock) && (atomic_xchg(&lock->count, 0) == 1)) {
+		trace_contention_end(lock, 0);
 		goto skip_wait;
+	}
 
 	debug_mutex_lock_common(lock, &waiter);
 	debug_mutex_add_waiter(lock, &waiter, task_thread_info(task));
@@ -585,6 +596,7 @@ __mutex_lock_common(struct mutex *lock, long state, unsigned int subclass,
 	if (likely(list_empty(&lock->wait_list)))
 		atomic_set(&lock->count, 0);
 	debug_mutex_free_waiter(&waiter);
+	trace_contention_end(lock, 0);
 
 skip_wait:
 	/* got the lock - cleanup and rejoice! */
@@ -602,6 +614,7 @@ skip_wait:
 
 err:
 	mutex_remove_waiter(lock, &waiter, task_thread_info(task));
+	trace_contention_end(lock, ret);
 	spin_unlock_mutex(&lock->wait_lock, flags);
 	debug_mutex_free_waiter(&waiter);
 	mutex_release(&lock->dep_map, 1, ip);
@@ -29,6 +29,7 @@
 #include <linux/mutex.h>
 #include <asm/byteorder.h>
 #include <asm/qspinlock.h>
+#include <trace/events/lock.h>
 
 /*
  * The basic principle of a queue-based spinlock can best be understood
@@ -367,6 +368,8 @@ queue:
 	node->next = NULL;
 	pv_init_node(node);
 
+	trace_contention_begin(lock, LCB_F_SPIN);
+
 	/*
 	 * We touched a (possibly) cold cacheline in the per-cpu queue node;
 	 * attempt the trylock once more in the hope someone let go while we
@@ -443,6 +446,8 @@ queue:
 	pv_kick_node(next);
 
 release:
+	trace_contention_end(lock, 0);
+
 	/*
 	 * release the node
 	 */
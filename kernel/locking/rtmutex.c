@@ -12,6 +12,7 @@
  */
 #include <linux/spinlock.h>
 #include <linux/export.h>
+#include <linux/moduleparam.h>
 #include <linux/sched.h>
 #include <linux/sched/rt.h>
 #include <linux/sched/deadline.h>
@@ -19,6 +20,11 @@
 
 #include "rtmutex_common.h"
 
+#ifdef MODULE_PARAM_PREFIX
+#undef MODULE_PARAM_PREFIX
+#endif
+#define MODULE_PARAM_PREFIX "rtmutex."
+
 /*
  * lock->owner state tracking:
  *
@@ -1080,6 +1086,66 @@ void rt_mutex_adjust_pi(struct task_struct *task)
 				   next_lock, NULL, task);
 }
 
+#ifdef CONFIG_RT_MUTEX_SPIN_ON_OWNER
+static bool spin_on_owner = true;
+module_param(spin_on_owner, bool, 0644);
+
+/*
+ * Adaptive waiting: an owner which is running on another cpu will likely
+ * release the lock before we would have gone to sleep and been woken up
+ * again, so spin instead. Only the top waiter spins, everybody else is
+ * queued behind it anyway, and only as long as that owner keeps running
+ * and we are not asked to reschedule.
+ *
+ * Called with wait_lock held, which is dropped while spinning. Returns true
+ * if the owner changed, i.e. the caller should try to take the lock again
+ * rather than go to sleep.
+ */
+static bool rt_mutex_spin_on_owner(struct rt_mutex *lock,
+				   struct rt_mutex_waiter *waiter)
+{
+	struct task_struct *owner;
+	bool ret = true;
+
+	if (!spin_on_owner || rt_mutex_top_waiter(lock) != waiter)
+		return false;
+
+	owner = rt_mutex_owner(lock);
+	if (!owner)
+		return true;
+
+	rcu_read_lock();
+	raw_spin_unlock(&lock->wait_lock);
+
+	while (rt_mutex_owner(lock) == owner) {
+		/*
+		 * Ensure we emit the owner->on_cpu, dereference _after_
+		 * checking lock->owner still matches owner, if that fails,
+		 * owner might point to free()d memory, if it still matches,
+		 * the rcu_read_lock() ensures the memory stays valid.
+		 */
+		barrier();
+
+		if (!owner->on_cpu || need_resched()) {
+			ret = false;
+			break;
+		}
+
+		cpu_relax_lowlatency();
+	}
+	rcu_read_unlock();
+
+	raw_spin_lock(&lock->wait_lock);
+	return ret;
+}
+#else
+static inline bool rt_mutex_spin_on_owner(struct rt_mutex *lock,
+					  struct rt_mutex_waiter *waiter)
+{
+	return false;
+}
+#endif
+
 /**
  * __rt_mutex_slowlock() - Perform the wait-wake-try-to-take loop
  * @lock:		 the rt_mutex to take
@@ -1116,6 +1182,11 @@ __rt_mutex_slowlock(struct rt_mutex *lock, int state,
 				break;
 		}
 
+		if (rt_mutex_spin_on_owner(lock, waiter)) {
+			set_current_state(state);
+			continue;
+		}
+
 		raw_spin_unlock(&lock->wait_lock);
 
 		debug_rt_mutex_print_deadlock(waiter);
@@ -13,11 +13,18 @@
 #include <linux/sched.h>
 #include <linux/init.h>
 #include <linux/export.h>
+#include <linux/moduleparam.h>
 #include <linux/sched/rt.h>
 #include <linux/osq_lock.h>
+#include <trace/events/lock.h>
 
 #include "rwsem.h"
 
+#ifdef MODULE_PARAM_PREFIX
+#undef MODULE_PARAM_PREFIX
+#endif
+#define MODULE_PARAM_PREFIX "rwsem."
+
 /*
  * Guide to the rw_semaphore's count field for common values.
  * (32-bit case illustrated, similar for 64-bit)
@@ -207,6 +214,9 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 	return sem;
 }
 
+static bool rwsem_optimistic_spin_read(struct rw_semaphore *sem,
+				       long *adjustment);
+
 /*
  * Wait for the read lock to be granted
  */
@@ -214,17 +224,28 @@ __visible
 struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 {
 	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
+	bool waiting = true; /* any queued threads before us */
 	struct rwsem_waiter waiter;
 	struct task_struct *tsk = current;
 
+	trace_contention_begin(sem, LCB_F_READ);
+
+	/* a running writer will likely be done soon, spin rather than sleep */
+	if (rwsem_optimistic_spin_read(sem, &adjustment)) {
+		trace_contention_end(sem, 0);
+		return sem;
+	}
+
 	/* set up my own style of waitqueue */
 	waiter.task = tsk;
 	waiter.type = RWSEM_WAITING_FOR_READ;
 	get_task_struct(tsk);
 
 	raw_spin_lock_irq(&sem->wait_lock);
-	if (list_empty(&sem->wait_list))
+	if (list_empty(&sem->wait_list)) {
 		adjustment += RWSEM_WAITING_BIAS;
+		waiting = false;
+	}
 	list_add_tail(&waiter.list, &sem->wait_list);
 
 	/* we're now waiting on the lock, but no longer actively locking */
@@ -236,8 +257,7 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 	 * wake our own waiter to join the existing active readers !
 	 */
 	if (count == RWSEM_WAITING_BIAS ||
-	    (count > RWSEM_WAITING_BIAS &&
-	     adjustment != -RWSEM_ACTIVE_READ_BIAS))
+	    (count > RWSEM_WAITING_BIAS && !waiting))
 		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY);
 
 	raw_spin_unlock_irq(&sem->wait_lock);
@@ -251,6 +271,7 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 	}
 
 	__set_task_state(tsk, TASK_RUNNING);
+	trace_contention_end(sem, 0);
 	return sem;
 }
 EXPORT_SYMBOL(rwsem_down_read_failed);
@@ -295,6 +316,27 @@ static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 	}
 }
 
+/*
+ * Try to acquire read lock before the reader has been put on wait queue.
+ * Only succeeds if there is neither an active writer nor anybody waiting,
+ * spinning readers must not overtake queued writers.
+ */
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = READ_ONCE(sem->count);
+
+	while (count >= 0) {
+		old = cmpxchg(&sem->count, count,
+			      count + RWSEM_ACTIVE_READ_BIAS);
+		if (old == count)
+			return true;
+
+		count = old;
+	}
+
+	return false;
+}
+
 static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
 {
 	struct task_struct *owner;
@@ -409,6 +451,51 @@ done:
 	return taken;
 }
 
+/*
+ * Readers may spin too, but only while the lock is owned by a writer which
+ * runs on another cpu, and only for that one write critical section: once
+ * the writer let go of the lock we either join the active readers or go to
+ * sleep. The reader drops its active bias before spinning, *adjustment is
+ * updated with what remains to be undone by the sleeping slowpath.
+ */
+static bool reader_spin = true;
+module_param(reader_spin, bool, 0644);
+
+static bool rwsem_optimistic_spin_read(struct rw_semaphore *sem,
+				       long *adjustment)
+{
+	struct task_struct *owner;
+	bool taken = false;
+
+	if (!reader_spin)
+		return false;
+
+	preempt_disable();
+
+	rcu_read_lock();
+	owner = READ_ONCE(sem->owner);
+	if (!owner || !owner->on_cpu || need_resched()) {
+		rcu_read_unlock();
+		goto done;
+	}
+	rcu_read_unlock();
+
+	/* we're no longer actively locking while we wait for the writer */
+	rwsem_atomic_update(-RWSEM_ACTIVE_READ_BIAS, sem);
+	*adjustment += RWSEM_ACTIVE_READ_BIAS;
+
+	if (!osq_lock(&sem->osq))
+		goto done;
+
+	rwsem_spin_on_owner(sem, owner);
+	taken = rwsem_try_read_lock_unqueued(sem);
+
+	osq_unlock(&sem->osq);
+done:
+	preempt_enable();
+	return taken;
+}
+
 /*
  * Return true if the rwsem has active spinner
  */
@@ -423,6 +510,12 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 	return false;
 }
 
+static bool rwsem_optimistic_spin_read(struct rw_semaphore *sem,
+				       long *adjustment)
+{
+	return false;
+}
+
 static inline bool rwsem_has_spinner(struct rw_semaphore *sem)
 {
 	return false;
@@ -439,12 +532,16 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 	bool waiting = true; /* any queued threads before us */
 	struct rwsem_waiter waiter;
 
+	trace_contention_begin(sem, LCB_F_WRITE);
+
 	/* undo write bias from down_write operation, stop active locking */
 	count = rwsem_atomic_update(-RWSEM_ACTIVE_WRITE_BIAS, sem);
 
 	/* do optimistic spinning and steal lock if possible */
-	if (rwsem_optimistic_spin(sem))
+	if (rwsem_optimistic_spin(sem)) {
+		trace_contention_end(sem, 0);
 		return sem;
+	}
 
 	/*
 	 * Optimistic spinning failed, proceed to the slowpath
@@ -495,6 +592,7 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 
 	list_del(&waiter.list);
 	raw_spin_unlock_irq(&sem->wait_lock);
+	trace_contention_end(sem, 0);
 
 	return sem;
 }
@@ -59,6 +59,13 @@ DEFINE_PER_CPU(char, rcu_cpu_has_work);
 static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
 static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
 static bool __read_mostly rcu_nocb_poll;    /* Offload kthread are to poll. */
+static bool __read_mostly rcu_nocb_batch;   /* Leaders invoke group's CBs. */
+module_param(rcu_nocb_batch, bool, 0444);
+static bool rcu_nocb_group_node;	    /* Never group across nodes. */
+module_param(rcu_nocb_group_node, bool, 0444);
+/* Group callback backlog that makes leaders force quiescent states. */
+static long rcu_nocb_accel_thresh = 10000;
+module_param(rcu_nocb_accel_thresh, long, 0644);
 #endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 
 /*
@@ -2105,7 +2112,7 @@ static bool __maybe_unused rcu_nocb_adopt_orphan_cbs(struct rcu_state *rsp,
  * If necessary, kick off a new grace period, and either way wait
  * for a subsequent grace period to complete.
  */
-static void rcu_nocb_wait_gp(struct rcu_data *rdp)
+static void rcu_nocb_wait_gp(struct rcu_data *rdp, bool accel)
 {
 	unsigned long c;
 	bool d;
@@ -2122,13 +2129,25 @@ static void rcu_nocb_wait_gp(struct rcu_data *rdp)
 
 	/*
 	 * Wait for the grace period.  Do so interruptibly to avoid messing
-	 * up the load average.
+	 * up the load average.  If the group has a large callback backlog,
+	 * push the grace period along rather than waiting for the normal
+	 * force-quiescent-state interval, just as __call_rcu_core() does
+	 * for callback floods on non-offloaded CPUs.
 	 */
 	trace_rcu_future_gp(rnp, rdp, c, TPS("StartWait"));
 	for (;;) {
-		wait_event_interruptible(
-			rnp->nocb_gp_wq[c & 0x1],
-			(d = ULONG_CMP_GE(READ_ONCE(rnp->completed), c)));
+		if (accel) {
+			force_quiescent_state(rdp->rsp);
+			trace_rcu_future_gp(rnp, rdp, c, TPS("AccelWait"));
+			wait_event_interruptible_timeout(
+				rnp->nocb_gp_wq[c & 0x1],
+				(d = ULONG_CMP_GE(READ_ONCE(rnp->completed), c)),
+				1);
+		} else {
+			wait_event_interruptible(
+				rnp->nocb_gp_wq[c & 0x1],
+				(d = ULONG_CMP_GE(READ_ONCE(rnp->completed), c)));
+		}
 		if (likely(d))
 			break;
 		WARN_ON(signal_pending(current));
@@ -2146,6 +2165,8 @@ static void nocb_leader_wait(struct rcu_data *my_rdp)
 {
 	bool firsttime = true;
 	bool gotcbs;
+	bool gotdone;
+	long pending;
 	struct rcu_data *rdp;
 	struct rcu_head **tail;
 
@@ -2168,7 +2189,9 @@ wait_again:
 	 * nocb_gp_head, where they await a grace period.
 	 */
 	gotcbs = false;
+	pending = 0;
 	for (rdp = my_rdp; rdp; rdp = rdp->nocb_next_follower) {
+		pending += atomic_long_read(&rdp->nocb_q_count);
 		rdp->nocb_gp_head = READ_ONCE(rdp->nocb_head);
 		if (!rdp->nocb_gp_head)
 			continue;  /* No CBs here, try next follower. */
@@ -2202,8 +2225,8 @@ wait_again:
 		goto wait_again;
 	}
 
-	/* Wait for one grace period. */
-	rcu_nocb_wait_gp(my_rdp);
+	/* Wait for one grace period, hurrying it if CBs are piling up. */
+	rcu_nocb_wait_gp(my_rdp, pending > READ_ONCE(rcu_nocb_accel_thresh));
 
 	/*
 	 * We left ->nocb_leader_sleep unset to reduce cache thrashing.
@@ -2214,6 +2237,7 @@ wait_again:
 	smp_mb(); /* Ensure _sleep true before scan of ->nocb_head. */
 
 	/* Each pass through the following loop wakes a follower, if needed. */
+	gotdone = false;
 	for (rdp = my_rdp; rdp; rdp = rdp->nocb_next_follower) {
 		if (READ_ONCE(rdp->nocb_head))
 			my_rdp->nocb_leader_sleep = false;/* No need to sleep.*/
@@ -2223,7 +2247,10 @@ wait_again:
 		/* Append callbacks to follower's "done" list. */
 		tail = xchg(&rdp->nocb_follower_tail, rdp->nocb_gp_tail);
 		*tail = rdp->nocb_gp_head;
+		gotdone = true;
 		smp_mb__after_atomic(); /* Store *tail before wakeup. */
+		if (rcu_nocb_batch)
+			continue; /* We invoke the followers' CBs ourselves. */
 		if (rdp != my_rdp && tail == &rdp->nocb_follower_head) {
 			/*
 			 * List was empty, wake up the follower.
@@ -2233,8 +2260,11 @@ wait_again:
 		}
 	}
 
-	/* If we (the leader) don't have CBs, go wait some more. */
-	if (!my_rdp->nocb_follower_head)
+	/*
+	 * If we (the leader) don't have CBs, go wait some more.  When
+	 * batching, CBs ready anywhere in the group are ours to invoke.
+	 */
+	if (rcu_nocb_batch ? !gotdone : !my_rdp->nocb_follower_head)
 		goto wait_again;
 }
 
@@ -2270,18 +2300,66 @@ static void nocb_follower_wait(struct rcu_data *rdp)
 }
 
 /*
- * Per-rcu_data kthread, but only for no-CBs CPUs.  Each kthread invokes
- * callbacks queued by the corresponding no-CBs CPU, however, there is
- * an optional leader-follower relationship so that the grace-period
- * kthreads don't have to do quite so many wakeups.
+ * Invoke the callbacks on the specified CPU's ready-to-invoke list, if any.
  */
-static int rcu_nocb_kthread(void *arg)
+static void nocb_invoke_callbacks(struct rcu_data *rdp)
 {
 	int c, cl;
 	struct rcu_head *list;
 	struct rcu_head *next;
 	struct rcu_head **tail;
+
+	/* Pull the ready-to-invoke callbacks onto local list. */
+	list = READ_ONCE(rdp->nocb_follower_head);
+	if (!list)
+		return;
+	trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu, "WokeNonEmpty");
+	WRITE_ONCE(rdp->nocb_follower_head, NULL);
+	tail = xchg(&rdp->nocb_follower_tail, &rdp->nocb_follower_head);
+
+	/* Each pass through the following loop invokes a callback. */
+	trace_rcu_batch_start(rdp->rsp->name,
+			      atomic_long_read(&rdp->nocb_q_count_lazy),
+			      atomic_long_read(&rdp->nocb_q_count), -1);
+	c = cl = 0;
+	while (list) {
+		next = list->next;
+		/* Wait for enqueuing to complete, if needed. */
+		while (next == NULL && &list->next != tail) {
+			trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
+					    TPS("WaitQueue"));
+			schedule_timeout_interruptible(1);
+			trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
+					    TPS("WokeQueue"));
+			next = list->next;
+		}
+		debug_rcu_head_unqueue(list);
+		local_bh_disable();
+		if (__rcu_reclaim(rdp->rsp->name, list))
+			cl++;
+		c++;
+		local_bh_enable();
+		list = next;
+	}
+	trace_rcu_batch_end(rdp->rsp->name, c, !!list, 0, 0, 1);
+	smp_mb__before_atomic();  /* _add after CB invocation. */
+	atomic_long_add(-c, &rdp->nocb_q_count);
+	atomic_long_add(-cl, &rdp->nocb_q_count_lazy);
+	rdp->n_nocbs_invoked += c;
+}
+
+/*
+ * Per-rcu_data kthread, but only for no-CBs CPUs.  Each kthread invokes
+ * callbacks queued by the corresponding no-CBs CPU, however, there is
+ * an optional leader-follower relationship so that the grace-period
+ * kthreads don't have to do quite so many wakeups.  With rcu_nocb_batch,
+ * followers have no kthread of their own and the leader invokes the
+ * callbacks of its whole group.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
 	struct rcu_data *rdp = arg;
+	struct rcu_data *rdpf;
 
 	/* Each pass through this loop invokes one batch of callbacks */
 	for (;;) {
@@ -2291,42 +2369,15 @@ static int rcu_nocb_kthread(void *arg)
 		else
 			nocb_follower_wait(rdp);
 
-		/* Pull the ready-to-invoke callbacks onto local list. */
-		list = READ_ONCE(rdp->nocb_follower_head);
-		BUG_ON(!list);
-		trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu, "WokeNonEmpty");
-		WRITE_ONCE(rdp->nocb_follower_head, NULL);
-		tail = xchg(&rdp->nocb_follower_tail, &rdp->nocb_follower_head);
-
-		/* Each pass through the following loop invokes a callback. */
-		trace_rcu_batch_start(rdp->rsp->name,
-				      atomic_long_read(&rdp->nocb_q_count_lazy),
-				      atomic_long_read(&rdp->nocb_q_count), -1);
-		c = cl = 0;
-		while (list) {
-			next = list->next;
-			/* Wait for enqueuing to complete, if needed. */
-			while (next == NULL && &list->next != tail) {
-				trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
-						    TPS("WaitQueue"));
-				schedule_timeout_interruptible(1);
-				trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
-						    TPS("WokeQueue"));
-				next = list->next;
-			}
-			debug_rcu_head_unqueue(list);
-			local_bh_disable();
-			if (__rcu_reclaim(rdp->rsp->name, list))
-				cl++;
-			c++;
-			local_bh_enable();
-			list = next;
+		if (!rcu_nocb_batch) {
+			BUG_ON(!READ_ONCE(rdp->nocb_follower_head));
+			nocb_invoke_callbacks(rdp);
+			continue;
+		}
+		for (rdpf = rdp; rdpf; rdpf = rdpf->nocb_next_follower) {
+			nocb_invoke_callbacks(rdpf);
+			cond_resched_rcu_qs();
 		}
-		trace_rcu_batch_end(rdp->rsp->name, c, !!list, 0, 0, 1);
-		smp_mb__before_atomic();  /* _add after CB invocation. */
-		atomic_long_add(-c, &rdp->nocb_q_count);
-		atomic_long_add(-cl, &rdp->nocb_q_count_lazy);
-		rdp->n_nocbs_invoked += c;
 	}
 	return 0;
 }
@@ -2397,6 +2448,9 @@ void __init rcu_init_nohz(void)
 		cpumask_pr_args(rcu_nocb_mask));
 	if (rcu_nocb_poll)
 		pr_info("\tPoll for callbacks from no-CBs CPUs.\n");
+	if (rcu_nocb_batch)
+		pr_info("\tOffload kthread per group of no-CBs CPUs%s.\n",
+			rcu_nocb_group_node ? ", grouped by node" : "");
 
 	for_each_rcu_flavor(rsp) {
 		for_each_cpu(cpu, rcu_nocb_mask)
@@ -2454,6 +2508,13 @@ static void rcu_spawn_one_nocb_kthread(struct rcu_state *rsp, int cpu)
 		rdp_spawn->nocb_next_follower = rdp_old_leader;
 	}
 
+	/* When batching, followers are serviced by the leader's kthread. */
+	if (rcu_nocb_batch && rdp_spawn->nocb_leader != rdp_spawn) {
+		WRITE_ONCE(rdp_spawn->nocb_kthread,
+			   rdp_spawn->nocb_leader->nocb_kthread);
+		return;
+	}
+
 	/* Spawn the kthread for this CPU and RCU flavor. */
 	t = kthread_run(rcu_nocb_kthread, rdp_spawn,
 			"rcuo%c/%d", rsp->abbr, cpu);
@@ -2488,10 +2549,55 @@ static void __init rcu_spawn_nocb_kthreads(void)
 		rcu_spawn_all_nocb_kthreads(cpu);
 }
 
-/* How many follower CPU IDs per leader?  Default of -1 for sqrt(nr_cpu_ids). */
+/*
+ * How many follower CPU IDs per leader?  Default of -1 for sqrt(nr_cpu_ids),
+ * or for one group per node if rcu_nocb_group_node is set.
+ */
 static int rcu_nocb_leader_stride = -1;
 module_param(rcu_nocb_leader_stride, int, 0444);
 
+/* Node of a possible CPU, falling back to the first node if unknown. */
+static int __init rcu_nocb_cpu_node(int cpu)
+{
+	int nid = cpu_to_node(cpu);
+
+	return nid == NUMA_NO_NODE ? first_node(node_possible_map) : nid;
+}
+
+/*
+ * Group the no-CBs CPUs of each node separately, so that a leader never
+ * handles callbacks (and, with rcu_nocb_batch, never touches callback
+ * memory) belonging to another node.  Within a node, every ls-th no-CBs
+ * CPU starts a new group.
+ */
+static void __init rcu_organize_nocb_kthreads_node(struct rcu_state *rsp,
+						   int ls)
+{
+	int cpu;
+	int n;
+	int nid;
+	struct rcu_data *rdp;
+	struct rcu_data *rdp_leader = NULL;  /* Suppress misguided gcc warn. */
+	struct rcu_data *rdp_prev = NULL;
+
+	for_each_node(nid) {
+		n = 0;
+		for_each_cpu(cpu, rcu_nocb_mask) {
+			if (rcu_nocb_cpu_node(cpu) != nid)
+				continue;
+			rdp = per_cpu_ptr(rsp->rda, cpu);
+			if (n++ % ls == 0) {
+				rdp->nocb_leader = rdp;
+				rdp_leader = rdp;
+			} else {
+				rdp->nocb_leader = rdp_leader;
+				rdp_prev->nocb_next_follower = rdp;
+			}
+			rdp_prev = rdp;
+		}
+	}
+}
+
 /*
  * Initialize leader-follower relationships for all no-CBs CPU.
  */
@@ -2506,10 +2612,14 @@ static void __init rcu_organize_nocb_kthreads(struct rcu_state *rsp)
 
 	if (!have_rcu_nocb_mask)
 		return;
-	if (ls == -1) {
-		ls = int_sqrt(nr_cpu_ids);
+	if (ls <= 0) {
+		ls = rcu_nocb_group_node ? nr_cpu_ids : int_sqrt(nr_cpu_ids);
 		rcu_nocb_leader_stride = ls;
 	}
+	if (rcu_nocb_group_node) {
+		rcu_organize_nocb_kthreads_node(rsp, ls);
+		return;
+	}
 
 	/*
 	 * Each pass through this loop sets up one rcu_data structure and
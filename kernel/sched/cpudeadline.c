@@ -14,6 +14,7 @@
 #include <linux/gfp.h>
 #include <linux/kernel.h>
 #include <linux/slab.h>
+#include <linux/log2.h>
 #include "cpudeadline.h"
 
 static inline int parent(int i)
@@ -36,17 +37,17 @@ static inline int dl_time_before(u64 a, u64 b)
 	return (s64)(a - b) < 0;
 }
 
-static void cpudl_exchange(struct cpudl *cp, int a, int b)
+static void cpudl_exchange(struct cpudl_heap *h, int a, int b)
 {
-	int cpu_a = cp->elements[a].cpu, cpu_b = cp->elements[b].cpu;
+	int key_a = h->elements[a].cpu, key_b = h->elements[b].cpu;
 
-	swap(cp->elements[a].cpu, cp->elements[b].cpu);
-	swap(cp->elements[a].dl , cp->elements[b].dl );
+	swap(h->elements[a].cpu, h->elements[b].cpu);
+	swap(h->elements[a].dl , h->elements[b].dl );
 
-	swap(cp->elements[cpu_a].idx, cp->elements[cpu_b].idx);
+	swap(h->elements[key_a].idx, h->elements[key_b].idx);
 }
 
-static void cpudl_heapify(struct cpudl *cp, int idx)
+static void cpudl_heapify(struct cpudl_heap *h, int idx)
 {
 	int l, r, largest;
 
@@ -56,46 +57,132 @@ static void cpudl_heapify(struct cpudl *cp, int idx)
 		r = right_child(idx);
 		largest = idx;
 
-		if ((l < cp->size) && dl_time_before(cp->elements[idx].dl,
-							cp->elements[l].dl))
+		if ((l < h->size) && dl_time_before(h->elements[idx].dl,
+							h->elements[l].dl))
 			largest = l;
-		if ((r < cp->size) && dl_time_before(cp->elements[largest].dl,
-							cp->elements[r].dl))
+		if ((r < h->size) && dl_time_before(h->elements[largest].dl,
+							h->elements[r].dl))
 			largest = r;
 		if (largest == idx)
 			break;
 
 		/* Push idx down the heap one level and bump one up */
-		cpudl_exchange(cp, largest, idx);
+		cpudl_exchange(h, largest, idx);
 		idx = largest;
 	}
 }
 
-static void cpudl_change_key(struct cpudl *cp, int idx, u64 new_dl)
+static void cpudl_change_key(struct cpudl_heap *h, int idx, u64 new_dl)
 {
-	WARN_ON(idx == IDX_INVALID || !cpu_present(idx));
+	WARN_ON(idx == IDX_INVALID || idx >= h->size);
 
-	if (dl_time_before(new_dl, cp->elements[idx].dl)) {
-		cp->elements[idx].dl = new_dl;
-		cpudl_heapify(cp, idx);
+	if (dl_time_before(new_dl, h->elements[idx].dl)) {
+		h->elements[idx].dl = new_dl;
+		cpudl_heapify(h, idx);
 	} else {
-		cp->elements[idx].dl = new_dl;
-		while (idx > 0 && dl_time_before(cp->elements[parent(idx)].dl,
-					cp->elements[idx].dl)) {
-			cpudl_exchange(cp, idx, parent(idx));
+		h->elements[idx].dl = new_dl;
+		while (idx > 0 && dl_time_before(h->elements[parent(idx)].dl,
+					h->elements[idx].dl)) {
+			cpudl_exchange(h, idx, parent(idx));
 			idx = parent(idx);
 		}
 	}
 }
 
-static inline int cpudl_maximum(struct cpudl *cp)
+/*
+ * cpudl_heap_set - insert, update or remove @key in @h
+ *
+ * Notes: assumes h->lock is held
+ */
+static void cpudl_heap_set(struct cpudl_heap *h, int key, u64 dl, int is_valid)
+{
+	int old_idx, new_key;
+
+	old_idx = h->elements[key].idx;
+	if (!is_valid) {
+		/* remove item */
+		if (old_idx == IDX_INVALID) {
+			/*
+			 * Nothing to remove if old_idx was invalid.
+			 * This could happen if a rq_offline_dl is
+			 * called for a CPU without -dl tasks running.
+			 */
+			return;
+		}
+		new_key = h->elements[h->size - 1].cpu;
+		h->elements[old_idx].dl = h->elements[h->size - 1].dl;
+		h->elements[old_idx].cpu = new_key;
+		h->size--;
+		h->elements[new_key].idx = old_idx;
+		h->elements[key].idx = IDX_INVALID;
+		while (old_idx > 0 && dl_time_before(
+				h->elements[parent(old_idx)].dl,
+				h->elements[old_idx].dl)) {
+			cpudl_exchange(h, old_idx, parent(old_idx));
+			old_idx = parent(old_idx);
+		}
+		cpudl_heapify(h, old_idx);
+		return;
+	}
+
+	if (old_idx == IDX_INVALID) {
+		h->size++;
+		h->elements[h->size - 1].dl = 0;
+		h->elements[h->size - 1].cpu = key;
+		h->elements[key].idx = h->size - 1;
+		cpudl_change_key(h, h->size - 1, dl);
+	} else {
+		cpudl_change_key(h, old_idx, dl);
+	}
+}
+
+/*
+ * cpudl_set() takes the top heap's lock with a group lock held, so the top
+ * lock needs a lockdep class of its own.
+ */
+static struct lock_class_key cpudl_top_lock_key;
+
+static int cpudl_heap_init(struct cpudl_heap *h, int nr_keys)
+{
+	int i;
+
+	raw_spin_lock_init(&h->lock);
+	h->size = 0;
+	h->elements = kcalloc(nr_keys, sizeof(struct cpudl_item), GFP_KERNEL);
+	if (!h->elements)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_keys; i++)
+		h->elements[i].idx = IDX_INVALID;
+
+	return 0;
+}
+
+/*
+ * cpudl_maximum - the CPU with the latest earliest-deadline, or -1
+ *
+ * Lockless: like the single heap before it, the answer may be stale by
+ * the time it is used; the push/pull paths recheck under the rq locks.
+ */
+static inline int cpudl_maximum(struct cpudl *cp, u64 *dl)
 {
-	return cp->elements[0].cpu;
+	struct cpudl_heap *g;
+	int group, cpu;
+
+	if (!READ_ONCE(cp->top.size))
+		return -1;
+
+	group = READ_ONCE(cp->top.elements[0].cpu);
+	g = &cp->groups[group];
+	cpu = (group << cp->group_shift) + READ_ONCE(g->elements[0].cpu);
+	*dl = READ_ONCE(g->elements[0].dl);
+
+	return cpu < nr_cpu_ids ? cpu : -1;
 }
 
 /*
  * cpudl_find - find the best (later-dl) CPU in the system
- * @cp: the cpudl max-heap context
+ * @cp: the cpudl context
  * @p: the task
  * @later_mask: a mask to fill in with the selected CPUs (or NULL)
  *
@@ -104,16 +191,20 @@ static inline int cpudl_maximum(struct cpudl *cp)
 int cpudl_find(struct cpudl *cp, struct task_struct *p,
 	       struct cpumask *later_mask)
 {
-	int best_cpu = -1;
+	int best_cpu = -1, max_cpu;
 	const struct sched_dl_entity *dl_se = &p->dl;
+	u64 max_dl;
 
 	if (later_mask &&
 	    cpumask_and(later_mask, cp->free_cpus, &p->cpus_allowed)) {
 		best_cpu = cpumask_any(later_mask);
 		goto out;
-	} else if (cpumask_test_cpu(cpudl_maximum(cp), &p->cpus_allowed) &&
-			dl_time_before(dl_se->deadline, cp->elements[0].dl)) {
-		best_cpu = cpudl_maximum(cp);
+	}
+
+	max_cpu = cpudl_maximum(cp, &max_dl);
+	if (max_cpu != -1 && cpumask_test_cpu(max_cpu, &p->cpus_allowed) &&
+	    dl_time_before(dl_se->deadline, max_dl)) {
+		best_cpu = max_cpu;
 		if (later_mask)
 			cpumask_set_cpu(best_cpu, later_mask);
 	}
@@ -125,8 +216,8 @@ out:
 }
 
 /*
- * cpudl_set - update the cpudl max-heap
- * @cp: the cpudl max-heap context
+ * cpudl_set - update the cpudl heaps
+ * @cp: the cpudl context
  * @cpu: the target cpu
  * @dl: the new earliest deadline for this cpu
  *
@@ -136,59 +227,43 @@ out:
  */
 void cpudl_set(struct cpudl *cp, int cpu, u64 dl, int is_valid)
 {
-	int old_idx, new_cpu;
+	int group = cpu >> cp->group_shift;
+	int key = cpu & ((1 << cp->group_shift) - 1);
+	struct cpudl_heap *g = &cp->groups[group];
+	bool was_valid, was_queued;
 	unsigned long flags;
+	u64 old_max;
 
 	WARN_ON(!cpu_present(cpu));
 
-	raw_spin_lock_irqsave(&cp->lock, flags);
-	old_idx = cp->elements[cpu].idx;
-	if (!is_valid) {
-		/* remove item */
-		if (old_idx == IDX_INVALID) {
-			/*
-			 * Nothing to remove if old_idx was invalid.
-			 * This could happen if a rq_offline_dl is
-			 * called for a CPU without -dl tasks running.
-			 */
-			goto out;
-		}
-		new_cpu = cp->elements[cp->size - 1].cpu;
-		cp->elements[old_idx].dl = cp->elements[cp->size - 1].dl;
-		cp->elements[old_idx].cpu = new_cpu;
-		cp->size--;
-		cp->elements[new_cpu].idx = old_idx;
-		cp->elements[cpu].idx = IDX_INVALID;
-		while (old_idx > 0 && dl_time_before(
-				cp->elements[parent(old_idx)].dl,
-				cp->elements[old_idx].dl)) {
-			cpudl_exchange(cp, old_idx, parent(old_idx));
-			old_idx = parent(old_idx);
-		}
-		cpumask_set_cpu(cpu, cp->free_cpus);
-                cpudl_heapify(cp, old_idx);
-
-		goto out;
+	raw_spin_lock_irqsave(&g->lock, flags);
+	was_valid = g->size;
+	was_queued = g->elements[key].idx != IDX_INVALID;
+	old_max = g->elements[0].dl;
+
+	cpudl_heap_set(g, key, dl, is_valid);
+
+	/*
+	 * Propagate the group's latest deadline to the top heap.  This is
+	 * done under the group lock so updates for a group cannot reorder.
+	 */
+	if (was_valid != !!g->size || (g->size && old_max != g->elements[0].dl)) {
+		raw_spin_lock(&cp->top.lock);
+		cpudl_heap_set(&cp->top, group, g->elements[0].dl, g->size);
+		raw_spin_unlock(&cp->top.lock);
 	}
 
-	if (old_idx == IDX_INVALID) {
-		cp->size++;
-		cp->elements[cp->size - 1].dl = 0;
-		cp->elements[cp->size - 1].cpu = cpu;
-		cp->elements[cpu].idx = cp->size - 1;
-		cpudl_change_key(cp, cp->size - 1, dl);
+	if (is_valid && !was_queued)
 		cpumask_clear_cpu(cpu, cp->free_cpus);
-	} else {
-		cpudl_change_key(cp, old_idx, dl);
-	}
+	else if (!is_valid && was_queued)
+		cpumask_set_cpu(cpu, cp->free_cpus);
 
-out:
-	raw_spin_unlock_irqrestore(&cp->lock, flags);
+	raw_spin_unlock_irqrestore(&g->lock, flags);
 }
 
 /*
  * cpudl_set_freecpu - Set the cpudl.free_cpus
- * @cp: the cpudl max-heap context
+ * @cp: the cpudl context
  * @cpu: rd attached cpu
  */
 void cpudl_set_freecpu(struct cpudl *cp, int cpu)
@@ -198,7 +273,7 @@ void cpudl_set_freecpu(struct cpudl *cp, int cpu)
 
 /*
  * cpudl_clear_freecpu - Clear the cpudl.free_cpus
- * @cp: the cpudl max-heap context
+ * @cp: the cpudl context
  * @cpu: rd attached cpu
  */
 void cpudl_clear_freecpu(struct cpudl *cp, int cpu)
@@ -208,39 +283,61 @@ void cpudl_clear_freecpu(struct cpudl *cp, int cpu)
 
 /*
  * cpudl_init - initialize the cpudl structure
- * @cp: the cpudl max-heap context
+ * @cp: the cpudl context
+ *
+ * Groups are sized to about sqrt(nr_cpu_ids) so that both the per-group
+ * and the top heap stay small.
  */
 int cpudl_init(struct cpudl *cp)
 {
 	int i;
 
 	memset(cp, 0, sizeof(*cp));
-	raw_spin_lock_init(&cp->lock);
-	cp->size = 0;
 
-	cp->elements = kcalloc(nr_cpu_ids,
-			       sizeof(struct cpudl_item),
-			       GFP_KERNEL);
-	if (!cp->elements)
-		return -ENOMEM;
+	cp->group_shift = ilog2(roundup_pow_of_two(int_sqrt(nr_cpu_ids)));
+	cp->nr_groups = DIV_ROUND_UP(nr_cpu_ids, 1 << cp->group_shift);
 
-	if (!zalloc_cpumask_var(&cp->free_cpus, GFP_KERNEL)) {
-		kfree(cp->elements);
+	if (!zalloc_cpumask_var(&cp->free_cpus, GFP_KERNEL))
 		return -ENOMEM;
-	}
 
-	for_each_possible_cpu(i)
-		cp->elements[i].idx = IDX_INVALID;
+	cp->groups = kcalloc(cp->nr_groups, sizeof(struct cpudl_heap),
+			     GFP_KERNEL);
+	if (!cp->groups)
+		goto free_cpus;
+
+	if (cpudl_heap_init(&cp->top, cp->nr_groups))
+		goto free_groups;
+	lockdep_set_class(&cp->top.lock, &cpudl_top_lock_key);
+
+	for (i = 0; i < cp->nr_groups; i++) {
+		if (cpudl_heap_init(&cp->groups[i], 1 << cp->group_shift))
+			goto free_heaps;
+	}
 
 	return 0;
+
+free_heaps:
+	while (--i >= 0)
+		kfree(cp->groups[i].elements);
+	kfree(cp->top.elements);
+free_groups:
+	kfree(cp->groups);
+free_cpus:
+	free_cpumask_var(cp->free_cpus);
+	return -ENOMEM;
 }
 
 /*
  * cpudl_cleanup - clean up the cpudl structure
- * @cp: the cpudl max-heap context
+ * @cp: the cpudl context
  */
 void cpudl_cleanup(struct cpudl *cp)
 {
+	int i;
+
 	free_cpumask_var(cp->free_cpus);
-	kfree(cp->elements);
+	for (i = 0; i < cp->nr_groups; i++)
+		kfree(cp->groups[i].elements);
+	kfree(cp->groups);
+	kfree(cp->top.elements);
 }
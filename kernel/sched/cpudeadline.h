@@ -11,13 +11,32 @@ struct cpudl_item {
 	int idx;
 };
 
-struct cpudl {
+/*
+ * A max-heap of deadlines.  Items are identified by a small key in
+ * [0, nr_keys): elements[i].cpu holds the key stored at heap position i,
+ * elements[key].idx the heap position of key.
+ */
+struct cpudl_heap {
 	raw_spinlock_t lock;
 	int size;
-	cpumask_var_t free_cpus;
 	struct cpudl_item *elements;
 };
 
+/*
+ * CPUs are split into groups of (1 << group_shift) consecutive ids, each
+ * with its own heap and lock.  The top heap holds one item per non-empty
+ * group, keyed by the group's latest deadline, and is only touched when
+ * that changes.  This keeps cpudl_set() from serialising all CPUs of a
+ * large root domain on a single lock.
+ */
+struct cpudl {
+	struct cpudl_heap top;
+	struct cpudl_heap *groups;
+	int group_shift;
+	int nr_groups;
+	cpumask_var_t free_cpus;
+};
+
 
 #ifdef CONFIG_SMP
 int cpudl_find(struct cpudl *cp, struct task_struct *p,
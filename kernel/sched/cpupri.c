@@ -73,7 +73,11 @@ int cpupri_find(struct cpupri *cp, struct task_struct *p,
 
 	BUG_ON(task_pri >= CPUPRI_NR_PRIORITIES);
 
-	for (idx = 0; idx < task_pri; idx++) {
+	/*
+	 * Only visit priorities that currently have CPUs.  The bitmap is
+	 * as racy as the counts below and the same reasoning applies.
+	 */
+	for_each_set_bit(idx, cp->pri_active, task_pri) {
 		struct cpupri_vec *vec  = &cp->pri_to_cpu[idx];
 		int skip = 0;
 
@@ -103,23 +107,17 @@ int cpupri_find(struct cpupri *cp, struct task_struct *p,
 		if (skip)
 			continue;
 
-		if (cpumask_any_and(&p->cpus_allowed, vec->mask) >= nr_cpu_ids)
-			continue;
-
 		if (lowest_mask) {
-			cpumask_and(lowest_mask, &p->cpus_allowed, vec->mask);
-
 			/*
-			 * We have to ensure that we have at least one bit
-			 * still set in the array, since the map could have
-			 * been concurrently emptied between the first and
-			 * second reads of vec->mask.  If we hit this
-			 * condition, simply act as though we never hit this
+			 * Build the mask in one pass and only trust what we
+			 * built: the map could be concurrently emptied, in
+			 * which case simply act as though we never hit this
 			 * priority level and continue on.
 			 */
-			if (cpumask_any(lowest_mask) >= nr_cpu_ids)
+			if (!cpumask_and(lowest_mask, &p->cpus_allowed, vec->mask))
 				continue;
-		}
+		} else if (cpumask_any_and(&p->cpus_allowed, vec->mask) >= nr_cpu_ids)
+			continue;
 
 		return 1;
 	}
@@ -166,7 +164,8 @@ void cpupri_set(struct cpupri *cp, int cpu, int newpri)
 		 * make sure the vector is visible when count is set.
 		 */
 		smp_mb__before_atomic();
-		atomic_inc(&(vec)->count);
+		if (atomic_inc_return(&(vec)->count) == 1)
+			set_bit(newpri, cp->pri_active);
 		do_mb = 1;
 	}
 	if (likely(oldpri != CPUPRI_INVALID)) {
@@ -191,7 +190,17 @@ void cpupri_set(struct cpupri *cp, int cpu, int newpri)
 		 * When removing from the vector, we decrement the counter first
 		 * do a memory barrier and then clear the mask.
 		 */
-		atomic_dec(&(vec)->count);
+		if (atomic_dec_and_test(&(vec)->count)) {
+			clear_bit(oldpri, cp->pri_active);
+			/*
+			 * A racing cpupri_set() may have raised the count
+			 * again and set the bit before we cleared it; make
+			 * sure a populated priority never stays hidden.
+			 */
+			smp_mb__after_atomic();
+			if (atomic_read(&(vec)->count))
+				set_bit(oldpri, cp->pri_active);
+		}
 		smp_mb__after_atomic();
 		cpumask_clear_cpu(cpu, vec->mask);
 	}
@@ -17,6 +17,8 @@ struct cpupri_vec {
 
 struct cpupri {
 	struct cpupri_vec pri_to_cpu[CPUPRI_NR_PRIORITIES];
+	/* priorities with a non-zero count, lets cpupri_find skip empty ones */
+	DECLARE_BITMAP(pri_active, CPUPRI_NR_PRIORITIES);
 	int *cpu_to_pri;
 };
 
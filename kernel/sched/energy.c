@@ -635,7 +635,7 @@ static void __distribute_energy_task(struct energy_task* e_task) {
 }
 
 static inline void __switch_from_energy(struct rq* rq, struct energy_task* e_task, char reason) {
-	trace_sched_energy_switch_from(grq.nr_threads, nr_running(), e_task ? e_task->task : NULL, reason);
+	trace_sched_energy_switch_from(grq.nr_threads, nr_running_approx(), e_task ? e_task->task : NULL, reason);
 
 	grq.running = 0;
 	grq.stop_running = ktime_get();
@@ -644,7 +644,7 @@ static inline void __switch_from_energy(struct rq* rq, struct energy_task* e_tas
 }
 
 static inline void __switch_to_energy(struct rq* rq, struct energy_task* e_task, char reason) {
-	trace_sched_energy_switch_to(grq.nr_threads, nr_running(), e_task ? e_task->task : NULL, reason);
+	trace_sched_energy_switch_to(grq.nr_threads, nr_running_approx(), e_task ? e_task->task : NULL, reason);
 
 	grq.running = 1;
 	grq.major_cpu = smp_processor_id();
@@ -1217,6 +1217,21 @@ static inline u64 sched_slice_other(unsigned long nr_total) {
 	return nr_total < grq.nr_threads ? 0 : (nr_total - grq.nr_threads) * THREAD_SCHED_SLICE;
 }
 
+static inline bool nr_in_bounds(unsigned long nr, unsigned long lo,
+		unsigned long hi) {
+	return lo <= nr && nr <= hi;
+}
+
+/* Can the exact number of runnable threads be @nr? If the bounds on it rule
+ * this out, there is no need to walk the runqueues.
+ */
+static inline bool nr_running_may_be(unsigned long nr) {
+	unsigned long lo, hi;
+
+	nr_running_bounds(&lo, &hi);
+	return nr_in_bounds(nr, lo, hi);
+}
+
 /* Decide if we should switch to the energy sched class from another one.
  *
  * @rq:		the runqueue of the current CPU.
@@ -1224,12 +1239,32 @@ static inline u64 sched_slice_other(unsigned long nr_total) {
  * @returns:	whether we should switch or not.
  */
 static inline bool should_switch_to_energy(struct rq* rq, char* reason) {
-	unsigned long nr_total = nr_running();
+	unsigned long nr_total, lo, hi;
+	bool exact;
 
 	if (grq.nr_threads == 0) {
 		/* We have no threads to schedule currently. */
 		return false;
-	} else if (nr_total == grq.nr_threads) {
+	}
+
+	/* The common case is that other threads are running and their slice is
+	 * not over yet. Rule that out with bounds on the number of runnable
+	 * threads, which are cheap to get. Anything that could end up switching
+	 * is decided on the exact count, so the decisions are the same as with
+	 * nr_running() alone. */
+	exact = nr_running_bounds(&lo, &hi);
+	if (!exact && !nr_in_bounds(grq.nr_threads, lo, hi) &&
+			!nr_in_bounds(rq->en.nr_assigned, lo, hi) && lo > 0) {
+		u64 not_running = ktime_us_delta(ktime_get(), grq.stop_running);
+
+		/* sched_slice_other() grows with the count, lo is a lower bound. */
+		if (not_running <= sched_slice_other(lo))
+			return false;
+	}
+
+	nr_total = exact ? lo : nr_running();
+
+	if (nr_total == grq.nr_threads) {
 		/* There are only threads of energy tasks in the system. */
 		if (reason) *reason = 'N';
 		return true;
@@ -1238,7 +1273,7 @@ static inline bool should_switch_to_energy(struct rq* rq, char* reason) {
 		 * threads from energy tasks. */
 		if (reason) *reason = 'n';
 		return true;
-	} else if (nr_running() == 0) {
+	} else if (nr_total == 0) {
 		/* Everyone runs the idle thread, but there are energy tasks available. */
 		if (reason) *reason = 'Z';
 		return true;
@@ -1275,8 +1310,10 @@ static inline bool should_switch_from_energy(struct rq* rq, char* reason) {
 		/* We have no threads to schedule currently. */
 		if (reason) *reason = 'Z';
 		return true;
-	} else if (nr_running() == grq.nr_threads) {
-		/* There are only threads of energy tasks in the system. */
+	} else if (nr_running_may_be(grq.nr_threads) &&
+			nr_running() == grq.nr_threads) {
+		/* There are only threads of energy tasks in the system. Only look at
+		 * the exact number if the bounds can not rule this out. */
 		return false;
 	} else {
 		ktime_t now = ktime_get();
@@ -4932,13 +4932,160 @@ find_idlest_cpu(struct sched_group *group, struct task_struct *p, int this_cpu)
 	return shallowest_idle_cpu != -1 ? shallowest_idle_cpu : least_loaded_cpu;
 }
 
+/*
+ * Idle CPU tracking for select_idle_sibling().
+ *
+ * Each LLC keeps two masks in its sched_domain_shared: the CPUs currently
+ * running their idle task and the CPUs of cores whose SMT siblings are all
+ * idle. Both are only hints, a CPU found in them still has to pass
+ * idle_cpu(). To keep the shared cachelines quiet the bits are only written
+ * when they actually change.
+ */
+static inline const struct cpumask *idle_core_mask(int cpu)
+{
+#ifdef CONFIG_SCHED_SMT
+	return cpu_smt_mask(cpu);
+#else
+	return cpumask_of(cpu);
+#endif
+}
+
+void update_idle_cpu(int cpu, bool idle)
+{
+	struct sched_domain_shared *sds;
+	struct cpumask *cores;
+	int sibling;
+
+	rcu_read_lock();
+	sds = rcu_dereference(per_cpu(sd_llc_shared, cpu));
+	if (!sds)
+		goto unlock;
+
+	cores = sds_idle_cores(sds);
+
+	if (idle) {
+		if (!cpumask_test_cpu(cpu, sds_idle_cpus(sds)))
+			cpumask_set_cpu(cpu, sds_idle_cpus(sds));
+
+		/* The last sibling to go idle makes the whole core idle. */
+		if (cpumask_test_cpu(cpu, cores) ||
+		    !cpumask_subset(idle_core_mask(cpu), sds_idle_cpus(sds)))
+			goto unlock;
+
+		for_each_cpu(sibling, idle_core_mask(cpu))
+			cpumask_set_cpu(sibling, cores);
+	} else {
+		if (cpumask_test_cpu(cpu, sds_idle_cpus(sds)))
+			cpumask_clear_cpu(cpu, sds_idle_cpus(sds));
+
+		if (!cpumask_test_cpu(cpu, cores))
+			goto unlock;
+
+		for_each_cpu(sibling, idle_core_mask(cpu))
+			cpumask_clear_cpu(sibling, cores);
+	}
+unlock:
+	rcu_read_unlock();
+}
+
+/*
+ * Find the first CPU at or after @target (wrapping around) which is set in
+ * @mask, allowed for @p and idle, looking at no more than @nr candidates.
+ */
+static int select_idle_mask(struct task_struct *p, const struct cpumask *mask,
+			    int target, int nr)
+{
+	int cpu = target;
+
+	while (nr--) {
+		cpu = cpumask_next_and(cpu, mask, tsk_cpus_allowed(p));
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first_and(mask, tsk_cpus_allowed(p));
+		if (cpu >= nr_cpu_ids || cpu == target)
+			break;
+
+		if (idle_cpu(cpu))
+			return cpu;
+	}
+
+	return -1;
+}
+
+/*
+ * Look for a fully idle core; a task placed there does not have to share
+ * the core's resources with anybody.
+ */
+static int select_idle_core(struct task_struct *p, struct sched_domain *sd,
+			    int target)
+{
+	struct cpumask *cores = sds_idle_cores(sd->shared);
+	int core, cpu;
+
+	core = cpumask_next_and(target, cores, tsk_cpus_allowed(p));
+	if (core >= nr_cpu_ids)
+		core = cpumask_first_and(cores, tsk_cpus_allowed(p));
+	if (core >= nr_cpu_ids || core == target)
+		return -1;
+
+	for_each_cpu(cpu, idle_core_mask(core)) {
+		if (idle_cpu(cpu))
+			continue;
+
+		/*
+		 * The hint is stale; drop the core until its last sibling
+		 * goes idle again, so the next wakeup doesn't try it too.
+		 */
+		for_each_cpu(cpu, idle_core_mask(core)) {
+			if (cpumask_test_cpu(cpu, cores))
+				cpumask_clear_cpu(cpu, cores);
+		}
+		return -1;
+	}
+
+	return core;
+}
+
+/*
+ * Look for any idle CPU in the LLC. The number of candidates we look at is
+ * bounded by how long this CPU is idle on average compared to what a scan
+ * costs, such that a short idle period is not wasted on scanning.
+ */
+static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd,
+			   int target)
+{
+	int cpu, nr = sd->span_weight;
+	u64 time;
+
+	if (sched_feat(SIS_PROP)) {
+		/*
+		 * Due to large variance we need a large fuzz factor on the
+		 * average idle time.
+		 */
+		u64 avg_idle = this_rq()->avg_idle / 512;
+		u64 avg_cost = sd->avg_scan_cost + 1;
+		u64 span_avg = sd->span_weight * avg_idle;
+
+		if (span_avg > 4 * avg_cost)
+			nr = div64_u64(span_avg, avg_cost);
+		else
+			nr = 4;
+	}
+
+	time = local_clock();
+	cpu = select_idle_mask(p, sds_idle_cpus(sd->shared), target, nr);
+	time = local_clock() - time;
+
+	sd->avg_scan_cost += ((s64)time - (s64)sd->avg_scan_cost) >> 3;
+
+	return cpu;
+}
+
 /*
  * Try and locate an idle CPU in the sched_domain.
  */
 static int select_idle_sibling(struct task_struct *p, int target)
 {
 	struct sched_domain *sd;
-	struct sched_group *sg;
 	int i = task_cpu(p);
 
 	if (idle_cpu(target))
@@ -4951,29 +5098,21 @@ static int select_idle_sibling(struct task_struct *p, int target)
 		return i;
 
 	/*
-	 * Otherwise, iterate the domains and find an elegible idle cpu.
+	 * Otherwise, use the idle state of the LLC to find an idle core
+	 * first, and any idle cpu after that.
 	 */
 	sd = rcu_dereference(per_cpu(sd_llc, target));
-	for_each_lower_domain(sd) {
-		sg = sd->groups;
-		do {
-			if (!cpumask_intersects(sched_group_cpus(sg),
-						tsk_cpus_allowed(p)))
-				goto next;
+	if (!sd || !sd->shared)
+		return target;
 
-			for_each_cpu(i, sched_group_cpus(sg)) {
-				if (i == target || !idle_cpu(i))
-					goto next;
-			}
+	i = select_idle_core(p, sd, target);
+	if (i >= 0)
+		return i;
+
+	i = select_idle_cpu(p, sd, target);
+	if (i >= 0)
+		return i;
 
-			target = cpumask_first_and(sched_group_cpus(sg),
-					tsk_cpus_allowed(p));
-			goto done;
-next:
-			sg = sg->next;
-		} while (sg != sd->groups);
-	}
-done:
 	return target;
 }
 /*
@@ -6015,6 +6154,44 @@ static void attach_tasks(struct lb_env *env)
 }
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
+/*
+ * A group cfs_rq whose own and entity averages have all decayed to zero
+ * contributes nothing to its parent or to tg->load_avg any more, so there
+ * is no point in having update_blocked_averages() visit it until it gets
+ * a task enqueued again (see list_add_leaf_cfs_rq()).
+ */
+static inline bool cfs_rq_is_decayed(struct cfs_rq *cfs_rq,
+				     struct sched_entity *se)
+{
+	if (cfs_rq->nr_running)
+		return false;
+
+	if (cfs_rq->runnable_load_avg || cfs_rq->blocked_load_avg ||
+	    cfs_rq->utilization_load_avg || cfs_rq->tg_load_contrib ||
+	    atomic_long_read(&cfs_rq->removed_load))
+		return false;
+
+	return !se->avg.load_avg_contrib && !se->avg.utilization_avg_contrib;
+}
+
+/*
+ * The runnable fraction the cfs_rq folded into tg->runnable_avg only goes
+ * back to zero from update_entity_load_avg() on the group entity, long
+ * after its load has.  Fold it out in one go when the cfs_rq leaves the
+ * leaf list; its entity's runnable sum starts over from zero with the next
+ * enqueue.
+ */
+static inline void cfs_rq_clear_runnable(struct cfs_rq *cfs_rq,
+					 struct sched_entity *se)
+{
+	if (cfs_rq->tg_runnable_contrib) {
+		atomic_sub(cfs_rq->tg_runnable_contrib,
+			   &cfs_rq->tg->runnable_avg);
+		cfs_rq->tg_runnable_contrib = 0;
+	}
+	se->avg.runnable_avg_sum = 0;
+}
+
 /*
  * update tg->load_weight by folding this cpu's load_avg
  */
@@ -6032,16 +6209,17 @@ static void __update_blocked_averages_cpu(struct task_group *tg, int cpu)
 	if (se) {
 		update_entity_load_avg(se, 1);
 		/*
-		 * We pivot on our runnable average having decayed to zero for
-		 * list removal.  This generally implies that all our children
-		 * have also been removed (modulo rounding error or bandwidth
-		 * control); however, such cases are rare and we can fix these
-		 * at enqueue.
-		 *
-		 * TODO: fix up out-of-order children on enqueue.
+		 * We pivot on our contributions having decayed to zero for
+		 * list removal, which happens long before the raw runnable
+		 * sum reaches zero.  Our blocked load includes our children's
+		 * contributions, so they have generally been removed already
+		 * (they come first in the list); bandwidth control is the rare
+		 * exception, which is fixed up at enqueue.
 		 */
-		if (!se->avg.runnable_avg_sum && !cfs_rq->nr_running)
+		if (cfs_rq_is_decayed(cfs_rq, se)) {
+			cfs_rq_clear_runnable(cfs_rq, se);
 			list_del_leaf_cfs_rq(cfs_rq);
+		}
 	} else {
 		struct rq *rq = rq_of(cfs_rq);
 		update_rq_runnable_avg(rq, rq->nr_running);
@@ -6054,8 +6232,17 @@ static void update_blocked_averages(int cpu)
 	struct cfs_rq *cfs_rq;
 	unsigned long flags;
 
+	/*
+	 * idle_balance() may call us many times per tick; the averages only
+	 * decay in ~1ms steps anyway, so walking the list once per jiffy is
+	 * plenty.
+	 */
+	if (READ_ONCE(rq->last_blocked_load_update) == jiffies)
+		return;
+
 	raw_spin_lock_irqsave(&rq->lock, flags);
 	update_rq_clock(rq);
+	rq->last_blocked_load_update = jiffies;
 	/*
 	 * Iterates the task_group tree in a bottom up fashion, see
 	 * list_add_leaf_cfs_rq() for details.
@@ -73,6 +73,12 @@ SCHED_FEAT(FORCE_SD_OVERLAP, false)
 SCHED_FEAT(RT_RUNTIME_SHARE, true)
 SCHED_FEAT(LB_MIN, false)
 
+/*
+ * Limit the number of CPUs select_idle_sibling() looks at by the average
+ * idle time of the waking CPU relative to the average scan cost.
+ */
+SCHED_FEAT(SIS_PROP, true)
+
 /*
  * Apply the automatic NUMA scheduling policy. Enabled automatically
  * at runtime if running on a NUMA machine. Can be controlled via
@@ -27,6 +27,7 @@ static struct task_struct *
 pick_next_task_idle(struct rq *rq, struct task_struct *prev)
 {
 	put_prev_task(rq, prev);
+	update_idle_cpu(cpu_of(rq), true);
 
 	schedstat_inc(rq, sched_goidle);
 	return rq->idle;
@@ -48,6 +49,7 @@ dequeue_task_idle(struct rq *rq, struct task_struct *p, int flags)
 static void put_prev_task_idle(struct rq *rq, struct task_struct *prev)
 {
 	idle_exit_fair(rq);
+	update_idle_cpu(cpu_of(rq), false);
 	rq_last_tick_reset(rq);
 }
 
@@ -27,6 +27,14 @@ extern __read_mostly int scheduler_running;
 extern unsigned long calc_load_update;
 extern atomic_long_t calc_load_tasks;
 
+/* one node's share of the batched runnable count, see account_nr_running() */
+struct nr_running_node {
+	atomic_long_t sum;
+	atomic_t unfolded;
+} ____cacheline_aligned_in_smp;
+
+extern struct nr_running_node nr_running_nodes[MAX_NUMNODES];
+
 extern void calc_global_load_tick(struct rq *this_rq);
 extern long calc_load_fold_active(struct rq *this_rq);
 
@@ -612,6 +620,10 @@ struct rq {
 	 * remote CPUs use both these fields when doing load calculation.
 	 */
 	unsigned int nr_running;
+	/* not yet folded into the node's count, see account_nr_running() */
+	int nr_running_delta;
+	bool nr_running_dirty;
+	struct nr_running_node *nr_running_node;
 #ifdef CONFIG_NUMA_BALANCING
 	unsigned int nr_numa_running;
 	unsigned int nr_preferred_running;
@@ -639,6 +651,8 @@ struct rq {
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this cpu: */
 	struct list_head leaf_cfs_rq_list;
+	/* jiffies of the last update_blocked_averages() walk of that list */
+	unsigned long last_blocked_load_update;
 
 	struct sched_avg avg;
 #endif /* CONFIG_FAIR_GROUP_SCHED */
@@ -883,6 +897,7 @@ static inline struct sched_domain *lowest_flag_domain(int cpu, int flag)
 DECLARE_PER_CPU(struct sched_domain *, sd_llc);
 DECLARE_PER_CPU(int, sd_llc_size);
 DECLARE_PER_CPU(int, sd_llc_id);
+DECLARE_PER_CPU(struct sched_domain_shared *, sd_llc_shared);
 DECLARE_PER_CPU(struct sched_domain *, sd_numa);
 DECLARE_PER_CPU(struct sched_domain *, sd_busy);
 DECLARE_PER_CPU(struct sched_domain *, sd_asym);
@@ -1313,11 +1328,15 @@ extern void trigger_load_balance(struct rq *rq);
 extern void idle_enter_fair(struct rq *this_rq);
 extern void idle_exit_fair(struct rq *this_rq);
 
+extern void update_idle_cpu(int cpu, bool idle);
+
 #else
 
 static inline void idle_enter_fair(struct rq *rq) { }
 static inline void idle_exit_fair(struct rq *rq) { }
 
+static inline void update_idle_cpu(int cpu, bool idle) { }
+
 #endif
 
 #ifdef CONFIG_CPU_IDLE
@@ -1367,11 +1386,102 @@ unsigned long to_ratio(u64 period, u64 runtime);
 
 extern void init_task_runnable_average(struct task_struct *p);
 
+/*
+ * System-wide runnable count.
+ *
+ * nr_running() has to sum rq->nr_running over all online CPUs, touching a
+ * remote cacheline per CPU. Hot paths which only need to know whether the
+ * total is (close to) some value can use nr_running_approx() instead, which
+ * reads one cacheline per node.
+ *
+ * Each runqueue accumulates its nr_running changes in rq->nr_running_delta
+ * and folds them into the sum of its node once they reach NR_RUNNING_BATCH,
+ * when the runqueue becomes empty, and on every tick.
+ *
+ * A runqueue with changes that are not folded yet is counted in the
+ * unfolded count of its node, from its first change after a fold until the
+ * next fold. Its delta is below NR_RUNNING_BATCH in size all that time, so
+ * the total is off by at most (NR_RUNNING_BATCH - 1) times the number of
+ * such runqueues, see nr_running_bounds().
+ *
+ * A runqueue going from empty to one task and back, the most common change
+ * on a mostly idle machine, thus does two atomic operations on its node's
+ * counters. Keeping them per node keeps that cacheline within the node.
+ */
+#define NR_RUNNING_BATCH	4
+
+static inline void fold_nr_running(struct rq *rq)
+{
+	if (!rq->nr_running_dirty)
+		return;
+
+	if (rq->nr_running_delta)
+		atomic_long_add(rq->nr_running_delta, &rq->nr_running_node->sum);
+	rq->nr_running_delta = 0;
+	rq->nr_running_dirty = false;
+	/* pairs with the smp_rmb() in nr_running_bounds() */
+	smp_mb__before_atomic();
+	atomic_dec(&rq->nr_running_node->unfolded);
+}
+
+static inline void account_nr_running(struct rq *rq, int delta)
+{
+	if (!rq->nr_running_dirty) {
+		rq->nr_running_dirty = true;
+		atomic_inc(&rq->nr_running_node->unfolded);
+	}
+	rq->nr_running_delta += delta;
+
+	if (!rq->nr_running || abs(rq->nr_running_delta) >= NR_RUNNING_BATCH)
+		fold_nr_running(rq);
+}
+
+static inline long __nr_running_approx(void)
+{
+	long nr = 0;
+	int node;
+
+	for_each_node(node)
+		nr += atomic_long_read(&nr_running_nodes[node].sum);
+	return nr;
+}
+
+static inline unsigned long nr_running_approx(void)
+{
+	long nr = __nr_running_approx();
+
+	return nr < 0 ? 0 : nr;
+}
+
+/*
+ * Bounds on nr_running(), from the per node counters. Like nr_running()
+ * itself, this is only a snapshot while runqueues change concurrently.
+ *
+ * Returns true if the bounds are exact, i.e. *@lo == *@hi == nr_running().
+ */
+static inline bool nr_running_bounds(unsigned long *lo, unsigned long *hi)
+{
+	long slack = 0, nr;
+	int node;
+
+	/* read the unfolded counts first, a fold in between only widens it */
+	for_each_node(node)
+		slack += atomic_read(&nr_running_nodes[node].unfolded);
+	slack *= NR_RUNNING_BATCH - 1;
+	smp_rmb();
+	nr = __nr_running_approx();
+
+	*lo = nr > slack ? nr - slack : 0;
+	*hi = nr + slack > 0 ? nr + slack : 0;
+	return !slack;
+}
+
 static inline void add_nr_running(struct rq *rq, unsigned count)
 {
 	unsigned prev_nr = rq->nr_running;
 
 	rq->nr_running = prev_nr + count;
+	account_nr_running(rq, count);
 
 	if (prev_nr < 2 && rq->nr_running >= 2) {
 #ifdef CONFIG_SMP
@@ -1398,6 +1508,7 @@ static inline void add_nr_running(struct rq *rq, unsigned count)
 static inline void sub_nr_running(struct rq *rq, unsigned count)
 {
 	rq->nr_running -= count;
+	account_nr_running(rq, -(int)count);
 }
 
 static inline void rq_last_tick_reset(struct rq *rq)
@@ -273,7 +273,7 @@ struct workqueue_struct {
 	/* hot fields used during command issue, aligned to cacheline */
 	unsigned int		flags ____cacheline_aligned; /* WQ: WQ_* flags */
 	struct pool_workqueue __percpu *cpu_pwqs; /* I: per-cpu pwqs */
-	struct pool_workqueue __rcu *numa_pwq_tbl[]; /* PWR: unbound pwqs indexed by node */
+	struct pool_workqueue __rcu *numa_pwq_tbl[]; /* PWR: unbound pwqs indexed by pod */
 };
 
 static struct kmem_cache *pwq_cache;
@@ -290,6 +290,19 @@ module_param_named(power_efficient, wq_power_efficient, bool, 0444);
 
 static bool wq_numa_enabled;		/* unbound NUMA affinity enabled */
 
+/*
+ * Unbound workqueues get one pwq per affinity pod.  Pods are NUMA nodes
+ * unless workqueue.llc_pods is set, in which case CPUs sharing a last
+ * level cache form a pod: work then stays cache-local while still being
+ * spread over, and picked up by any idle worker of, the whole LLC.
+ */
+static bool wq_llc_pods;
+module_param_named(llc_pods, wq_llc_pods, bool, 0444);
+
+static int wq_nr_pods;			/* number of valid pods */
+static cpumask_var_t *wq_pod_cpus;	/* possible CPUs of each pod */
+static int *wq_pod_of_cpu;		/* pod of each possible CPU, or NULL */
+
 /* buf for wq_update_unbound_numa_attrs(), protected by CPU hotplug exclusion */
 static struct workqueue_attrs *wq_update_unbound_numa_attrs_buf;
 
@@ -552,23 +565,44 @@ static int worker_pool_assign_id(struct worker_pool *pool)
 	return ret;
 }
 
+/*
+ * Number of numa_pwq_tbl[] slots.  LLC pods are only known once all boot
+ * CPUs are up, after the early workqueues have been created, so reserve
+ * room for the largest possible number of pods from the start.
+ */
+static int wq_nr_pod_slots(void)
+{
+	return wq_llc_pods ? max_t(int, nr_node_ids, nr_cpu_ids) : nr_node_ids;
+}
+
+#define for_each_pod_slot(pod)						\
+	for ((pod) = 0; (pod) < wq_nr_pod_slots(); (pod)++)
+
+/* the affinity pod of @cpu; NUMA node until wq_llc_pods_init() runs */
+static int wq_cpu_pod(int cpu)
+{
+	int *pod_of_cpu = READ_ONCE(wq_pod_of_cpu);
+
+	return pod_of_cpu ? pod_of_cpu[cpu] : cpu_to_node(cpu);
+}
+
 /**
- * unbound_pwq_by_node - return the unbound pool_workqueue for the given node
+ * unbound_pwq_by_pod - return the unbound pool_workqueue for the given pod
  * @wq: the target workqueue
- * @node: the node ID
+ * @pod: the pod ID
  *
  * This must be called with any of wq_pool_mutex, wq->mutex or sched RCU
  * read locked.
  * If the pwq needs to be used beyond the locking in effect, the caller is
  * responsible for guaranteeing that the pwq stays online.
  *
- * Return: The unbound pool_workqueue for @node.
+ * Return: The unbound pool_workqueue for @pod.
  */
-static struct pool_workqueue *unbound_pwq_by_node(struct workqueue_struct *wq,
-						  int node)
+static struct pool_workqueue *unbound_pwq_by_pod(struct workqueue_struct *wq,
+						 int pod)
 {
 	assert_rcu_or_wq_mutex_or_pool_mutex(wq);
-	return rcu_dereference_raw(wq->numa_pwq_tbl[node]);
+	return rcu_dereference_raw(wq->numa_pwq_tbl[pod]);
 }
 
 static unsigned int work_color_to_flags(int color)
@@ -1325,7 +1359,7 @@ retry:
 	if (!(wq->flags & WQ_UNBOUND))
 		pwq = per_cpu_ptr(wq->cpu_pwqs, cpu);
 	else
-		pwq = unbound_pwq_by_node(wq, cpu_to_node(cpu));
+		pwq = unbound_pwq_by_pod(wq, wq_cpu_pod(cpu));
 
 	/*
 	 * If @work was previously on a different pool, it might still be
@@ -3403,43 +3437,44 @@ static struct pool_workqueue *alloc_unbound_pwq(struct workqueue_struct *wq,
 }
 
 /**
- * wq_calc_node_cpumask - calculate a wq_attrs' cpumask for the specified node
+ * wq_calc_pod_cpumask - calculate a wq_attrs' cpumask for the specified pod
  * @attrs: the wq_attrs of the default pwq of the target workqueue
- * @node: the target NUMA node
+ * @pod: the target affinity pod
  * @cpu_going_down: if >= 0, the CPU to consider as offline
  * @cpumask: outarg, the resulting cpumask
  *
- * Calculate the cpumask a workqueue with @attrs should use on @node.  If
+ * Calculate the cpumask a workqueue with @attrs should use on @pod.  If
  * @cpu_going_down is >= 0, that cpu is considered offline during
  * calculation.  The result is stored in @cpumask.
  *
  * If NUMA affinity is not enabled, @attrs->cpumask is always used.  If
- * enabled and @node has online CPUs requested by @attrs, the returned
- * cpumask is the intersection of the possible CPUs of @node and
+ * enabled and @pod has online CPUs requested by @attrs, the returned
+ * cpumask is the intersection of the possible CPUs of @pod and
  * @attrs->cpumask.
  *
- * The caller is responsible for ensuring that the cpumask of @node stays
+ * The caller is responsible for ensuring that the cpumask of @pod stays
  * stable.
  *
  * Return: %true if the resulting @cpumask is different from @attrs->cpumask,
  * %false if equal.
  */
-static bool wq_calc_node_cpumask(const struct workqueue_attrs *attrs, int node,
-				 int cpu_going_down, cpumask_t *cpumask)
+static bool wq_calc_pod_cpumask(const struct workqueue_attrs *attrs, int pod,
+				int cpu_going_down, cpumask_t *cpumask)
 {
-	if (!wq_numa_enabled || attrs->no_numa)
+	if (!wq_numa_enabled || attrs->no_numa || pod >= wq_nr_pods)
 		goto use_dfl;
 
-	/* does @node have any online CPUs @attrs wants? */
-	cpumask_and(cpumask, cpumask_of_node(node), attrs->cpumask);
+	/* does @pod have any online CPUs @attrs wants? */
+	cpumask_and(cpumask, wq_pod_cpus[pod], cpu_online_mask);
+	cpumask_and(cpumask, cpumask, attrs->cpumask);
 	if (cpu_going_down >= 0)
 		cpumask_clear_cpu(cpu_going_down, cpumask);
 
 	if (cpumask_empty(cpumask))
 		goto use_dfl;
 
-	/* yeap, return possible CPUs in @node that @attrs wants */
-	cpumask_and(cpumask, attrs->cpumask, wq_numa_possible_cpumask[node]);
+	/* yeap, return possible CPUs in @pod that @attrs wants */
+	cpumask_and(cpumask, attrs->cpumask, wq_pod_cpus[pod]);
 	return !cpumask_equal(cpumask, attrs->cpumask);
 
 use_dfl:
@@ -3447,9 +3482,9 @@ use_dfl:
 	return false;
 }
 
-/* install @pwq into @wq's numa_pwq_tbl[] for @node and return the old pwq */
+/* install @pwq into @wq's numa_pwq_tbl[] for @pod and return the old pwq */
 static struct pool_workqueue *numa_pwq_tbl_install(struct workqueue_struct *wq,
-						   int node,
+						   int pod,
 						   struct pool_workqueue *pwq)
 {
 	struct pool_workqueue *old_pwq;
@@ -3460,8 +3495,8 @@ static struct pool_workqueue *numa_pwq_tbl_install(struct workqueue_struct *wq,
 	/* link_pwq() can handle duplicate calls */
 	link_pwq(pwq);
 
-	old_pwq = rcu_access_pointer(wq->numa_pwq_tbl[node]);
-	rcu_assign_pointer(wq->numa_pwq_tbl[node], pwq);
+	old_pwq = rcu_access_pointer(wq->numa_pwq_tbl[pod]);
+	rcu_assign_pointer(wq->numa_pwq_tbl[pod], pwq);
 	return old_pwq;
 }
 
@@ -3478,10 +3513,10 @@ struct apply_wqattrs_ctx {
 static void apply_wqattrs_cleanup(struct apply_wqattrs_ctx *ctx)
 {
 	if (ctx) {
-		int node;
+		int pod;
 
-		for_each_node(node)
-			put_pwq_unlocked(ctx->pwq_tbl[node]);
+		for_each_pod_slot(pod)
+			put_pwq_unlocked(ctx->pwq_tbl[pod]);
 		put_pwq_unlocked(ctx->dfl_pwq);
 
 		free_workqueue_attrs(ctx->attrs);
@@ -3497,11 +3532,11 @@ apply_wqattrs_prepare(struct workqueue_struct *wq,
 {
 	struct apply_wqattrs_ctx *ctx;
 	struct workqueue_attrs *new_attrs, *tmp_attrs;
-	int node;
+	int pod;
 
 	lockdep_assert_held(&wq_pool_mutex);
 
-	ctx = kzalloc(sizeof(*ctx) + nr_node_ids * sizeof(ctx->pwq_tbl[0]),
+	ctx = kzalloc(sizeof(*ctx) + wq_nr_pod_slots() * sizeof(ctx->pwq_tbl[0]),
 		      GFP_KERNEL);
 
 	new_attrs = alloc_workqueue_attrs(GFP_KERNEL);
@@ -3535,14 +3570,14 @@ apply_wqattrs_prepare(struct workqueue_struct *wq,
 	if (!ctx->dfl_pwq)
 		goto out_free;
 
-	for_each_node(node) {
-		if (wq_calc_node_cpumask(new_attrs, node, -1, tmp_attrs->cpumask)) {
-			ctx->pwq_tbl[node] = alloc_unbound_pwq(wq, tmp_attrs);
-			if (!ctx->pwq_tbl[node])
+	for_each_pod_slot(pod) {
+		if (wq_calc_pod_cpumask(new_attrs, pod, -1, tmp_attrs->cpumask)) {
+			ctx->pwq_tbl[pod] = alloc_unbound_pwq(wq, tmp_attrs);
+			if (!ctx->pwq_tbl[pod])
 				goto out_free;
 		} else {
 			ctx->dfl_pwq->refcnt++;
-			ctx->pwq_tbl[node] = ctx->dfl_pwq;
+			ctx->pwq_tbl[pod] = ctx->dfl_pwq;
 		}
 	}
 
@@ -3565,7 +3600,7 @@ out_free:
 /* set attrs and install prepared pwqs, @ctx points to old pwqs on return */
 static void apply_wqattrs_commit(struct apply_wqattrs_ctx *ctx)
 {
-	int node;
+	int pod;
 
 	/* all pwqs have been created successfully, let's install'em */
 	mutex_lock(&ctx->wq->mutex);
@@ -3573,9 +3608,9 @@ static void apply_wqattrs_commit(struct apply_wqattrs_ctx *ctx)
 	copy_workqueue_attrs(ctx->wq->unbound_attrs, ctx->attrs);
 
 	/* save the previous pwq and install the new one */
-	for_each_node(node)
-		ctx->pwq_tbl[node] = numa_pwq_tbl_install(ctx->wq, node,
-							  ctx->pwq_tbl[node]);
+	for_each_pod_slot(pod)
+		ctx->pwq_tbl[pod] = numa_pwq_tbl_install(ctx->wq, pod,
+							 ctx->pwq_tbl[pod]);
 
 	/* @dfl_pwq might not have been used, ensure it's linked */
 	link_pwq(ctx->dfl_pwq);
@@ -3630,9 +3665,9 @@ static int apply_workqueue_attrs_locked(struct workqueue_struct *wq,
  * @attrs: the workqueue_attrs to apply, allocated with alloc_workqueue_attrs()
  *
  * Apply @attrs to an unbound workqueue @wq.  Unless disabled, on NUMA
- * machines, this function maps a separate pwq to each NUMA node with
- * possibles CPUs in @attrs->cpumask so that work items are affine to the
- * NUMA node it was issued on.  Older pwqs are released as in-flight work
+ * machines, this function maps a separate pwq to each affinity pod (NUMA
+ * node or LLC) with possibles CPUs in @attrs->cpumask so that work items
+ * are affine to the pod they were issued on.  Older pwqs are released as in-flight work
  * items finish.  Note that a work item which repeatedly requeues itself
  * back-to-back will stay on its current pwq.
  *
@@ -3677,7 +3712,7 @@ int apply_workqueue_attrs(struct workqueue_struct *wq,
 static void wq_update_unbound_numa(struct workqueue_struct *wq, int cpu,
 				   bool online)
 {
-	int node = cpu_to_node(cpu);
+	int pod = wq_cpu_pod(cpu);
 	int cpu_off = online ? -1 : cpu;
 	struct pool_workqueue *old_pwq = NULL, *pwq;
 	struct workqueue_attrs *target_attrs;
@@ -3698,7 +3733,7 @@ static void wq_update_unbound_numa(struct workqueue_struct *wq, int cpu,
 	cpumask = target_attrs->cpumask;
 
 	copy_workqueue_attrs(target_attrs, wq->unbound_attrs);
-	pwq = unbound_pwq_by_node(wq, node);
+	pwq = unbound_pwq_by_pod(wq, pod);
 
 	/*
 	 * Let's determine what needs to be done.  If the target cpumask is
@@ -3706,7 +3741,7 @@ static void wq_update_unbound_numa(struct workqueue_struct *wq, int cpu,
 	 * and create a new one if they don't match.  If the target cpumask
 	 * equals the default pwq's, the default pwq should be used.
 	 */
-	if (wq_calc_node_cpumask(wq->dfl_pwq->pool->attrs, node, cpu_off, cpumask)) {
+	if (wq_calc_pod_cpumask(wq->dfl_pwq->pool->attrs, pod, cpu_off, cpumask)) {
 		if (cpumask_equal(cpumask, pwq->pool->attrs->cpumask))
 			return;
 	} else {
@@ -3723,7 +3758,7 @@ static void wq_update_unbound_numa(struct workqueue_struct *wq, int cpu,
 
 	/* Install the new pwq. */
 	mutex_lock(&wq->mutex);
-	old_pwq = numa_pwq_tbl_install(wq, node, pwq);
+	old_pwq = numa_pwq_tbl_install(wq, pod, pwq);
 	goto out_unlock;
 
 use_dfl_pwq:
@@ -3731,7 +3766,7 @@ use_dfl_pwq:
 	spin_lock_irq(&wq->dfl_pwq->pool->lock);
 	get_pwq(wq->dfl_pwq);
 	spin_unlock_irq(&wq->dfl_pwq->pool->lock);
-	old_pwq = numa_pwq_tbl_install(wq, node, wq->dfl_pwq);
+	old_pwq = numa_pwq_tbl_install(wq, pod, wq->dfl_pwq);
 out_unlock:
 	mutex_unlock(&wq->mutex);
 	put_pwq_unlocked(old_pwq);
@@ -3801,7 +3836,7 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 
 	/* allocate wq and format name */
 	if (flags & WQ_UNBOUND)
-		tbl_size = nr_node_ids * sizeof(wq->numa_pwq_tbl[0]);
+		tbl_size = wq_nr_pod_slots() * sizeof(wq->numa_pwq_tbl[0]);
 
 	wq = kzalloc(sizeof(*wq) + tbl_size, GFP_KERNEL);
 	if (!wq)
@@ -3900,7 +3935,7 @@ EXPORT_SYMBOL_GPL(__alloc_workqueue_key);
 void destroy_workqueue(struct workqueue_struct *wq)
 {
 	struct pool_workqueue *pwq;
-	int node;
+	int pod;
 
 	/* drain it before proceeding with destruction */
 	drain_workqueue(wq);
@@ -3951,9 +3986,9 @@ void destroy_workqueue(struct workqueue_struct *wq)
 		 * access numa_pwq_tbl[] and dfl_pwq to put the base refs.
 		 * @wq will be freed when the last pwq is released.
 		 */
-		for_each_node(node) {
-			pwq = rcu_access_pointer(wq->numa_pwq_tbl[node]);
-			RCU_INIT_POINTER(wq->numa_pwq_tbl[node], NULL);
+		for_each_pod_slot(pod) {
+			pwq = rcu_access_pointer(wq->numa_pwq_tbl[pod]);
+			RCU_INIT_POINTER(wq->numa_pwq_tbl[pod], NULL);
 			put_pwq_unlocked(pwq);
 		}
 
@@ -4045,7 +4080,7 @@ bool workqueue_congested(int cpu, struct workqueue_struct *wq)
 	if (!(wq->flags & WQ_UNBOUND))
 		pwq = per_cpu_ptr(wq->cpu_pwqs, cpu);
 	else
-		pwq = unbound_pwq_by_node(wq, cpu_to_node(cpu));
+		pwq = unbound_pwq_by_pod(wq, wq_cpu_pod(cpu));
 
 	ret = !list_empty(&pwq->delayed_works);
 	rcu_read_unlock_sched();
@@ -4869,13 +4904,13 @@ static ssize_t wq_pool_ids_show(struct device *dev,
 {
 	struct workqueue_struct *wq = dev_to_wq(dev);
 	const char *delim = "";
-	int node, written = 0;
+	int pod, written = 0;
 
 	rcu_read_lock_sched();
-	for_each_node(node) {
+	for (pod = 0; pod < max(wq_nr_pods, nr_node_ids); pod++) {
 		written += scnprintf(buf + written, PAGE_SIZE - written,
-				     "%s%d:%d", delim, node,
-				     unbound_pwq_by_node(wq, node)->pool->id);
+				     "%s%d:%d", delim, pod,
+				     unbound_pwq_by_pod(wq, pod)->pool->id);
 		delim = " ";
 	}
 	written += scnprintf(buf + written, PAGE_SIZE - written, "\n");
@@ -5172,7 +5207,7 @@ static void __init wq_numa_init(void)
 	cpumask_var_t *tbl;
 	int node, cpu;
 
-	if (num_possible_nodes() <= 1)
+	if (num_possible_nodes() <= 1 && !wq_llc_pods)
 		return;
 
 	if (wq_disable_numa) {
@@ -5206,9 +5241,89 @@ static void __init wq_numa_init(void)
 	}
 
 	wq_numa_possible_cpumask = tbl;
+	wq_pod_cpus = tbl;
+	wq_nr_pods = nr_node_ids;
 	wq_numa_enabled = true;
 }
 
+#ifdef CONFIG_SCHED_MC
+/*
+ * Switch unbound workqueues from NUMA node to LLC pods.  Cache topology
+ * is only known for CPUs which have been brought up, so this runs once
+ * the boot CPUs are online; possible CPUs which are still offline share
+ * a pod per node.
+ */
+static int __init wq_llc_pods_init(void)
+{
+	cpumask_var_t *pod_cpus, assigned;
+	struct workqueue_struct *wq;
+	int *pod_of_cpu;
+	int cpu, pod, nr_pods = 0;
+
+	if (!wq_llc_pods || !wq_numa_enabled)
+		return 0;
+
+	pod_cpus = kcalloc(wq_nr_pod_slots(), sizeof(pod_cpus[0]), GFP_KERNEL);
+	pod_of_cpu = kcalloc(nr_cpu_ids, sizeof(pod_of_cpu[0]), GFP_KERNEL);
+	BUG_ON(!pod_cpus || !pod_of_cpu ||
+	       !zalloc_cpumask_var(&assigned, GFP_KERNEL));
+
+	apply_wqattrs_lock();
+
+	for_each_possible_cpu(cpu) {
+		const struct cpumask *node_cpus =
+			wq_numa_possible_cpumask[cpu_to_node(cpu)];
+
+		for (pod = 0; pod < nr_pods; pod++)
+			if (cpumask_test_cpu(cpu, pod_cpus[pod]))
+				break;
+
+		if (pod == nr_pods) {
+			BUG_ON(!zalloc_cpumask_var(&pod_cpus[pod], GFP_KERNEL));
+			if (cpu_online(cpu)) {
+				/* an LLC never spans nodes, but be safe */
+				cpumask_and(pod_cpus[pod], cpu_coregroup_mask(cpu),
+					    node_cpus);
+				cpumask_and(pod_cpus[pod], pod_cpus[pod],
+					    cpu_online_mask);
+			} else {
+				cpumask_andnot(pod_cpus[pod], node_cpus,
+					       cpu_online_mask);
+			}
+			cpumask_andnot(pod_cpus[pod], pod_cpus[pod], assigned);
+			cpumask_set_cpu(cpu, pod_cpus[pod]);
+			cpumask_or(assigned, assigned, pod_cpus[pod]);
+			nr_pods++;
+		}
+		pod_of_cpu[cpu] = pod;
+	}
+
+	/*
+	 * Every table slot holds a valid pwq, so queueing may see the new
+	 * CPU to pod mapping before the tables are rebuilt below.
+	 */
+	wq_pod_cpus = pod_cpus;
+	wq_nr_pods = nr_pods;
+	smp_wmb();
+	WRITE_ONCE(wq_pod_of_cpu, pod_of_cpu);
+
+	list_for_each_entry(wq, &workqueues, list) {
+		if (!(wq->flags & WQ_UNBOUND) || (wq->flags & __WQ_ORDERED))
+			continue;
+		if (apply_workqueue_attrs_locked(wq, wq->unbound_attrs))
+			pr_warn("workqueue: failed to switch \"%s\" to LLC pods\n",
+				wq->name);
+	}
+
+	apply_wqattrs_unlock();
+
+	free_cpumask_var(assigned);
+	pr_info("workqueue: %d LLC affinity pods\n", nr_pods);
+	return 0;
+}
+core_initcall(wq_llc_pods_init);
+#endif
+
 static int __init init_workqueues(void)
 {
 	int std_nice[NR_STD_WORKER_POOLS] = { 0, HIGHPRI_NICE_LEVEL };
@@ -0,0 +1,225 @@
+/*
+ * Page bulk allocation test
+ *
+ * Checks that alloc_pages_bulk_array() fills in only the empty entries of
+ * the array, with distinct, unshared pages.  Then compares the per-page
+ * cost of allocating batches of order-0 pages one at a time with
+ * alloc_page() against alloc_pages_bulk_array(), for a range of batch
+ * sizes.  The pages are freed one by one in both cases, so the difference
+ * is the cost of the allocation side alone.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/gfp.h>
+#include <linux/highmem.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/string.h>
+#include <linux/timex.h>
+
+#define MAX_BULK	256
+#define CHECK_ROUNDS	100
+
+static int loops = 10000;
+module_param(loops, int, 0);
+MODULE_PARM_DESC(loops, "Number of alloc/free rounds per batch size (default: 10000)");
+
+static const unsigned int batches[] __initconst = { 1, 8, 32, 64, 128, 256 };
+
+static void __init free_batch(struct page **pages, unsigned int nr)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		__free_page(pages[i]);
+		pages[i] = NULL;
+	}
+}
+
+static int cmp_ptr(const void *a, const void *b)
+{
+	unsigned long x = *(const unsigned long *)a;
+	unsigned long y = *(const unsigned long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Pre-populate every third entry of the array, let the bulk allocator
+ * fill in the rest, and check each page: the pre-populated ones must be
+ * left alone, the new ones must have a single reference, and writing a
+ * per-page pattern must not show up in any other page.  The batch size
+ * varies per round, so batches keep crossing the pcp list being refilled.
+ */
+static int __init test_check(struct page **pages, int round)
+{
+	unsigned int nr = (round * 7) % MAX_BULK + 1, i;
+	struct page *old[MAX_BULK / 3 + 1];
+	unsigned long got;
+	int err = 0;
+	void *addr;
+
+	for (i = 0; i < nr; i += 3) {
+		pages[i] = alloc_page(GFP_KERNEL);
+		if (!pages[i]) {
+			err = -ENOMEM;
+			goto free;
+		}
+		old[i / 3] = pages[i];
+	}
+
+	got = alloc_pages_bulk_array(GFP_KERNEL, nr, pages);
+	if (got < nr) {
+		err = -ENOMEM;
+		goto free;
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (!pages[i] || (i % 3 == 0 && pages[i] != old[i / 3]) ||
+		    page_count(pages[i]) != 1) {
+			pr_err("round %d: bad entry %u: %p\n",
+			       round, i, pages[i]);
+			err = -EINVAL;
+			goto free;
+		}
+		addr = kmap(pages[i]);
+		memset(addr, i & 0xff, PAGE_SIZE);
+		kunmap(pages[i]);
+	}
+
+	for (i = 0; !err && i < nr; i++) {
+		addr = kmap(pages[i]);
+		if (memchr_inv(addr, i & 0xff, PAGE_SIZE)) {
+			pr_err("round %d: page %u was overwritten\n",
+			       round, i);
+			err = -EINVAL;
+		}
+		kunmap(pages[i]);
+	}
+
+	sort(pages, nr, sizeof(*pages), cmp_ptr, NULL);
+	for (i = 1; i < nr; i++) {
+		if (pages[i] == pages[i - 1]) {
+			pr_err("round %d: page %p handed out twice\n",
+			       round, pages[i]);
+			/* freeing the batch would corrupt the free lists, leak it */
+			memset(pages, 0, nr * sizeof(*pages));
+			return -EINVAL;
+		}
+	}
+
+free:
+	/* entries past a failure are NULL, or one of the pre-populated pages */
+	for (i = 0; i < nr; i++) {
+		if (pages[i])
+			__free_page(pages[i]);
+		pages[i] = NULL;
+	}
+	return err;
+}
+
+static int __init test_single(struct page **pages, unsigned int nr,
+			      u64 *cycles)
+{
+	u64 total = 0;
+	cycles_t start;
+	unsigned int i;
+	int l;
+
+	for (l = 0; l < loops; l++) {
+		start = get_cycles();
+		for (i = 0; i < nr; i++) {
+			pages[i] = alloc_page(GFP_KERNEL);
+			if (!pages[i]) {
+				free_batch(pages, i);
+				return -ENOMEM;
+			}
+		}
+		total += get_cycles() - start;
+		free_batch(pages, nr);
+		cond_resched();
+	}
+	*cycles = total;
+	return 0;
+}
+
+static int __init test_bulk(struct page **pages, unsigned int nr,
+			    u64 *cycles)
+{
+	unsigned long got;
+	u64 total = 0;
+	cycles_t start;
+	int l;
+
+	for (l = 0; l < loops; l++) {
+		start = get_cycles();
+		got = alloc_pages_bulk_array(GFP_KERNEL, nr, pages);
+		total += get_cycles() - start;
+		free_batch(pages, got);
+		if (got < nr)
+			return -ENOMEM;
+		cond_resched();
+	}
+	*cycles = total;
+	return 0;
+}
+
+static int __init test_page_bulk_init(void)
+{
+	struct page **pages;
+	u64 single, bulk;
+	int i, err = 0;
+
+	if (loops <= 0)
+		return -EINVAL;
+
+	pages = kcalloc(MAX_BULK, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	for (i = 0; i < CHECK_ROUNDS; i++) {
+		err = test_check(pages, i);
+		if (err)
+			goto out;
+		cond_resched();
+	}
+	pr_info("%d rounds: no duplicate, shared or overlapping pages\n",
+		CHECK_ROUNDS);
+
+	for (i = 0; i < ARRAY_SIZE(batches); i++) {
+		unsigned int nr = batches[i];
+		u64 div = (u64)loops * nr;
+
+		err = test_single(pages, nr, &single);
+		if (!err)
+			err = test_bulk(pages, nr, &bulk);
+		if (err)
+			break;
+
+		pr_info("batch %3u: single %llu cycles/page, bulk %llu cycles/page\n",
+			nr, div64_u64(single, div), div64_u64(bulk, div));
+	}
+
+out:
+	kfree(pages);
+	return err;
+}
+
+static void __exit test_page_bulk_exit(void)
+{
+}
+
+module_init(test_page_bulk_init);
+module_exit(test_page_bulk_exit);
+
+MODULE_LICENSE("GPL v2");
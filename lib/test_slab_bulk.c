@@ -0,0 +1,205 @@
+/*
+ * Slab bulk allocation test
+ *
+ * Checks that kmem_cache_alloc_bulk() hands out distinct objects that
+ * don't overlap, with batches that run across the end of the cpu slab.
+ * Then compares the per-object cost of allocating and freeing batches of
+ * objects one at a time with kmem_cache_alloc()/kmem_cache_free() against
+ * kmem_cache_alloc_bulk()/kmem_cache_free_bulk(), for a range of batch
+ * sizes.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/string.h>
+#include <linux/timex.h>
+
+#define MAX_BULK	64
+#define CHECK_OBJS	(16 * MAX_BULK)
+#define CHECK_ROUNDS	100
+
+static int loops = 100000;
+module_param(loops, int, 0);
+MODULE_PARM_DESC(loops, "Number of alloc/free rounds per batch size (default: 100000)");
+
+static int obj_size = 256;
+module_param(obj_size, int, 0);
+MODULE_PARM_DESC(obj_size, "Size of the test cache's objects (default: 256)");
+
+static const size_t batches[] __initconst = { 1, 8, 16, 32, 64 };
+
+/* Tag an object with its index: in the first word, and in every byte after. */
+static void __init fill_obj(void *obj, size_t idx)
+{
+	*(unsigned long *)obj = idx;
+	memset(obj + sizeof(unsigned long), idx & 0xff,
+	       obj_size - sizeof(unsigned long));
+}
+
+static bool __init check_obj(void *obj, size_t idx)
+{
+	return *(unsigned long *)obj == idx &&
+	       !memchr_inv(obj + sizeof(unsigned long), idx & 0xff,
+			   obj_size - sizeof(unsigned long));
+}
+
+static int cmp_ptr(const void *a, const void *b)
+{
+	unsigned long x = *(const unsigned long *)a;
+	unsigned long y = *(const unsigned long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Allocate CHECK_OBJS objects in batches of varying size, so that a batch
+ * ends up spanning the cpu slab running out and being refilled, and make
+ * sure none of them is handed out twice or overlaps another one.
+ */
+static int __init test_check(struct kmem_cache *s, void **objs, int round)
+{
+	size_t n = 0, nr, i;
+	int err = 0;
+
+	while (n < CHECK_OBJS) {
+		nr = min_t(size_t, CHECK_OBJS - n, (round + n) % MAX_BULK + 1);
+		if (!kmem_cache_alloc_bulk(s, GFP_KERNEL, nr, objs + n)) {
+			err = -ENOMEM;
+			break;
+		}
+		for (i = n; i < n + nr; i++)
+			fill_obj(objs[i], i);
+		n += nr;
+	}
+
+	for (i = 0; !err && i < n; i++) {
+		if (!check_obj(objs[i], i)) {
+			pr_err("round %d: object %zu at %p was overwritten\n",
+			       round, i, objs[i]);
+			err = -EINVAL;
+		}
+	}
+
+	sort(objs, n, sizeof(*objs), cmp_ptr, NULL);
+	for (i = 1; i < n; i++) {
+		if (objs[i] == objs[i - 1]) {
+			pr_err("round %d: object %p handed out twice\n",
+			       round, objs[i]);
+			/* freeing the batch would corrupt the cache, leak it */
+			return -EINVAL;
+		}
+	}
+
+	/* free in batches of varying size too */
+	for (i = 0; i < n; i += nr) {
+		nr = min_t(size_t, n - i, (round + i) % MAX_BULK + 1);
+		kmem_cache_free_bulk(s, nr, objs + i);
+	}
+	return err;
+}
+
+static int __init test_single(struct kmem_cache *s, size_t nr, void **objs,
+			      u64 *cycles)
+{
+	cycles_t start = get_cycles();
+	size_t i;
+	int l;
+
+	for (l = 0; l < loops; l++) {
+		for (i = 0; i < nr; i++) {
+			objs[i] = kmem_cache_alloc(s, GFP_KERNEL);
+			if (!objs[i]) {
+				while (i--)
+					kmem_cache_free(s, objs[i]);
+				return -ENOMEM;
+			}
+		}
+		for (i = 0; i < nr; i++)
+			kmem_cache_free(s, objs[i]);
+	}
+	*cycles = get_cycles() - start;
+	return 0;
+}
+
+static int __init test_bulk(struct kmem_cache *s, size_t nr, void **objs,
+			    u64 *cycles)
+{
+	cycles_t start = get_cycles();
+	int l;
+
+	for (l = 0; l < loops; l++) {
+		if (!kmem_cache_alloc_bulk(s, GFP_KERNEL, nr, objs))
+			return -ENOMEM;
+		kmem_cache_free_bulk(s, nr, objs);
+	}
+	*cycles = get_cycles() - start;
+	return 0;
+}
+
+static int __init test_slab_bulk_init(void)
+{
+	struct kmem_cache *s;
+	u64 single, bulk;
+	void **objs;
+	int i, err = 0;
+
+	if (loops <= 0 || obj_size < (int)sizeof(unsigned long))
+		return -EINVAL;
+
+	objs = kcalloc(CHECK_OBJS, sizeof(*objs), GFP_KERNEL);
+	if (!objs)
+		return -ENOMEM;
+
+	s = kmem_cache_create("test_slab_bulk", obj_size, 0, 0, NULL);
+	if (!s) {
+		kfree(objs);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < CHECK_ROUNDS; i++) {
+		err = test_check(s, objs, i);
+		if (err)
+			goto out;
+		cond_resched();
+	}
+	pr_info("%d rounds of %d objects: no duplicates or overlaps\n",
+		CHECK_ROUNDS, CHECK_OBJS);
+
+	for (i = 0; i < ARRAY_SIZE(batches); i++) {
+		size_t nr = batches[i];
+		u64 div = (u64)loops * nr;
+
+		err = test_single(s, nr, objs, &single);
+		if (!err)
+			err = test_bulk(s, nr, objs, &bulk);
+		if (err)
+			break;
+
+		pr_info("batch %2zu: single %llu cycles/object, bulk %llu cycles/object\n",
+			nr, div64_u64(single, div), div64_u64(bulk, div));
+	}
+
+out:
+	kmem_cache_destroy(s);
+	kfree(objs);
+	return err;
+}
+
+static void __exit test_slab_bulk_exit(void)
+{
+}
+
+module_init(test_slab_bulk_init);
+module_exit(test_slab_bulk_exit);
+
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,129 @@
+/*
+ * Workqueue throughput and latency test
+ *
+ * Queues a burst of short CPU-bound work items from a single CPU onto a
+ * per-cpu and an unbound workqueue and reports, for each, the completion
+ * rate and the queueing latency (time from queue_work() until the item
+ * starts executing).  Unbound workqueues use one pool per affinity pod;
+ * boot with workqueue.llc_pods=1 to measure LLC instead of NUMA pods.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/vmalloc.h>
+#include <linux/delay.h>
+#include <linux/atomic.h>
+#include <linux/workqueue.h>
+#include <linux/timekeeping.h>
+
+static int items = 100000;
+module_param(items, int, 0);
+MODULE_PARM_DESC(items, "Number of work items per run (default: 100000)");
+
+static int work_ns = 1000;
+module_param(work_ns, int, 0);
+MODULE_PARM_DESC(work_ns, "CPU time burnt by each work item in ns (default: 1000)");
+
+static int runs = 3;
+module_param(runs, int, 0);
+MODULE_PARM_DESC(runs, "Number of runs per workqueue type (default: 3)");
+
+struct test_work {
+	struct work_struct	work;
+	u64			queued;
+};
+
+static atomic64_t lat_sum;
+static atomic64_t lat_max;
+
+static void test_work_fn(struct work_struct *work)
+{
+	struct test_work *tw = container_of(work, struct test_work, work);
+	u64 lat = ktime_get_ns() - tw->queued;
+	u64 max = atomic64_read(&lat_max);
+
+	atomic64_add(lat, &lat_sum);
+	while (lat > max) {
+		u64 old = atomic64_cmpxchg(&lat_max, max, lat);
+
+		if (old == max)
+			break;
+		max = old;
+	}
+
+	ndelay(work_ns);
+}
+
+static int __init test_wq_run(const char *name, unsigned int flags,
+			      struct test_work *tw)
+{
+	struct workqueue_struct *wq;
+	u64 start, elapsed;
+	int i, run;
+
+	wq = alloc_workqueue("test_wq_%s", flags, 0, name);
+	if (!wq)
+		return -ENOMEM;
+
+	for (run = 0; run < runs; run++) {
+		atomic64_set(&lat_sum, 0);
+		atomic64_set(&lat_max, 0);
+
+		start = ktime_get_ns();
+		for (i = 0; i < items; i++) {
+			INIT_WORK(&tw[i].work, test_work_fn);
+			tw[i].queued = ktime_get_ns();
+			queue_work(wq, &tw[i].work);
+		}
+		flush_workqueue(wq);
+		elapsed = ktime_get_ns() - start ?: 1;
+
+		pr_info("%-8s run %d: %llu items/s, latency avg %llu ns, max %llu ns\n",
+			name, run,
+			div64_u64((u64)items * NSEC_PER_SEC, elapsed),
+			div64_u64(atomic64_read(&lat_sum), items),
+			(u64)atomic64_read(&lat_max));
+	}
+
+	destroy_workqueue(wq);
+	return 0;
+}
+
+static int __init test_wq_init(void)
+{
+	struct test_work *tw;
+	int err;
+
+	if (items <= 0 || work_ns < 0)
+		return -EINVAL;
+
+	tw = vzalloc(items * sizeof(*tw));
+	if (!tw)
+		return -ENOMEM;
+
+	pr_info("%d items of %d ns from cpu %d, %d online cpus\n",
+		items, work_ns, raw_smp_processor_id(), num_online_cpus());
+
+	err = test_wq_run("percpu", 0, tw);
+	if (!err)
+		err = test_wq_run("unbound", WQ_UNBOUND, tw);
+
+	vfree(tw);
+	return err;
+}
+
+static void __exit test_wq_exit(void)
+{
+}
+
+module_init(test_wq_init);
+module_exit(test_wq_exit);
+
+MODULE_LICENSE("GPL v2");
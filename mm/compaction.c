@@ -17,6 +17,8 @@
 #include <linux/balloon_compaction.h>
 #include <linux/page-isolation.h>
 #include <linux/kasan.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include "internal.h"
 
 #ifdef CONFIG_COMPACTION
@@ -328,6 +330,32 @@ static bool compact_trylock_irqsave(spinlock_t *lock, unsigned long *flags,
 	return true;
 }
 
+/*
+ * Lock the lruvec that @page belongs to, like lock_page_lruvec_irqsave() but
+ * honouring the async compaction rules of compact_trylock_irqsave().
+ * Returns NULL if the lock was contended.
+ */
+static struct lruvec *compact_lock_page_lruvec(struct page *page,
+		unsigned long *flags, struct compact_control *cc)
+{
+	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec;
+
+	rcu_read_lock();
+	for (;;) {
+		lruvec = mem_cgroup_page_lruvec(page, zone);
+		if (!compact_trylock_irqsave(&lruvec->lru_lock, flags, cc)) {
+			lruvec = NULL;
+			break;
+		}
+		if (likely(lruvec == mem_cgroup_page_lruvec(page, zone)))
+			break;
+		spin_unlock_irqrestore(&lruvec->lru_lock, *flags);
+	}
+	rcu_read_unlock();
+	return lruvec;
+}
+
 /*
  * Compaction requires the taking of some coarse locks that are potentially
  * very heavily contended. The lock should be periodically unlocked to avoid
@@ -647,7 +675,7 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 	struct zone *zone = cc->zone;
 	unsigned long nr_scanned = 0, nr_isolated = 0;
 	struct list_head *migratelist = &cc->migratepages;
-	struct lruvec *lruvec;
+	struct lruvec *lruvec = NULL;
 	unsigned long flags = 0;
 	bool locked = false;
 	struct page *page = NULL, *valid_page = NULL;
@@ -680,8 +708,9 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 		 * if contended.
 		 */
 		if (!(low_pfn % SWAP_CLUSTER_MAX)
-		    && compact_unlock_should_abort(&zone->lru_lock, flags,
-								&locked, cc))
+		    && compact_unlock_should_abort(
+				locked ? &lruvec->lru_lock : NULL, flags,
+				&locked, cc))
 			break;
 
 		if (!pfn_valid_within(low_pfn))
@@ -730,20 +759,16 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 		/*
 		 * PageLRU is set. lru_lock normally excludes isolation
 		 * splitting and collapsing (collapsing has already happened
-		 * if PageLRU is set) but the lock is not necessarily taken
-		 * here and it is wasteful to take it just to check transhuge.
-		 * Check TransHuge without lock and skip the whole pageblock if
-		 * it's either a transhuge or hugetlbfs page, as calling
-		 * compound_order() without preventing THP from splitting the
-		 * page underneath us may return surprising results.
+		 * if PageLRU is set) but the page's lruvec lock is not
+		 * necessarily the one held here and it is wasteful to take it
+		 * just to check transhuge. Check TransHuge without lock and
+		 * skip the whole pageblock if it's either a transhuge or
+		 * hugetlbfs page, as calling compound_order() without
+		 * preventing THP from splitting the page underneath us may
+		 * return surprising results.
 		 */
 		if (PageTransHuge(page)) {
-			if (!locked)
-				low_pfn = ALIGN(low_pfn + 1,
-						pageblock_nr_pages) - 1;
-			else
-				low_pfn += (1 << compound_order(page)) - 1;
-
+			low_pfn = ALIGN(low_pfn + 1, pageblock_nr_pages) - 1;
 			continue;
 		}
 
@@ -756,10 +781,15 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 		    page_count(page) > page_mapcount(page))
 			continue;
 
-		/* If we already hold the lock, we can skip some rechecking */
-		if (!locked) {
-			locked = compact_trylock_irqsave(&zone->lru_lock,
-								&flags, cc);
+		/*
+		 * If we already hold the page's lruvec lock, we can skip some
+		 * rechecking. Pages of a pageblock mostly belong to one memcg.
+		 */
+		if (!locked || lruvec != mem_cgroup_page_lruvec(page, zone)) {
+			if (locked)
+				spin_unlock_irqrestore(&lruvec->lru_lock, flags);
+			lruvec = compact_lock_page_lruvec(page, &flags, cc);
+			locked = lruvec != NULL;
 			if (!locked)
 				break;
 
@@ -772,8 +802,6 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 			}
 		}
 
-		lruvec = mem_cgroup_page_lruvec(page, zone);
-
 		/* Try isolate the page */
 		if (__isolate_lru_page(page, isolate_mode) != 0)
 			continue;
@@ -803,7 +831,7 @@ isolate_success:
 		low_pfn = end_pfn;
 
 	if (locked)
-		spin_unlock_irqrestore(&zone->lru_lock, flags);
+		spin_unlock_irqrestore(&lruvec->lru_lock, flags);
 
 	/*
 	 * Update the pageblock-skip information and cached scanner pfn,
@@ -1146,6 +1174,10 @@ static int __compact_finished(struct zone *zone, struct compact_control *cc,
 	if (cc->contended || fatal_signal_pending(current))
 		return COMPACT_PARTIAL;
 
+	/* kcompactd used up its time for this round */
+	if (cc->deadline && time_after(jiffies, cc->deadline))
+		return COMPACT_PARTIAL;
+
 	/* Compaction run completes if the migrate and free scanner meet */
 	if (cc->free_pfn <= cc->migrate_pfn) {
 		/* Let the next compaction start anew. */
@@ -1685,6 +1717,242 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+/*
+ * Proactive compaction
+ *
+ * kcompactd, one per node, keeps the fragmentation score of its node
+ * below a threshold so that high-order allocations, hugepages first of
+ * all, rarely have to wait for direct compaction.  The score of a zone
+ * is the percentage of its free memory that is in blocks too small for
+ * an allocation of sysctl_compaction_proactive_order; that of a node is
+ * the average over the zones compaction can do something about,
+ * weighted by their size.
+ *
+ * kcompactd checks the score every KCOMPACTD_WAKE_MSECS.  When it is
+ * above 100 - proactiveness + 10, kcompactd compacts the fragmented zones
+ * of the node for at most KCOMPACTD_BUDGET_MSECS per check, until the
+ * score has come down to 100 - proactiveness.  The compaction scanners
+ * resume where they left off, so each round picks up the work of the
+ * previous one.  A round that does not lower the score makes kcompactd
+ * back off for 1 << COMPACT_MAX_DEFER_SHIFT checks.
+ */
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+#define COMPACTION_HPAGE_ORDER	HPAGE_PMD_ORDER
+#else
+#define COMPACTION_HPAGE_ORDER	(PMD_SHIFT - PAGE_SHIFT < MAX_ORDER ? \
+				 PMD_SHIFT - PAGE_SHIFT : MAX_ORDER - 1)
+#endif
+
+int sysctl_compaction_proactiveness __read_mostly = 20;
+int sysctl_compaction_proactive_order __read_mostly = COMPACTION_HPAGE_ORDER;
+
+#define KCOMPACTD_WAKE_MSECS	500
+/* at most 10% of a cpu */
+#define KCOMPACTD_BUDGET_MSECS	50
+
+/* Is there enough free memory in @zone for compaction to make use of? */
+static bool kcompactd_zone_suitable(struct zone *zone, unsigned int order)
+{
+	return populated_zone(zone) &&
+		zone_watermark_ok(zone, 0, low_wmark_pages(zone) + (2UL << order),
+				  0, 0);
+}
+
+static unsigned int fragmentation_score_zone(struct zone *zone,
+					     unsigned int order)
+{
+	unsigned long free = 0, suitable = 0;
+	unsigned int o;
+
+	for (o = 0; o < MAX_ORDER; o++) {
+		unsigned long pages = zone->free_area[o].nr_free << o;
+
+		free += pages;
+		if (o >= order)
+			suitable += pages;
+	}
+
+	if (!free || suitable >= free)
+		return 0;
+	return div64_u64((u64)(free - suitable) * 100, free);
+}
+
+static unsigned int fragmentation_score_node(pg_data_t *pgdat,
+					     unsigned int order)
+{
+	unsigned long pages = 0;
+	u64 score = 0;
+	int zoneid;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!kcompactd_zone_suitable(zone, order))
+			continue;
+		score += (u64)fragmentation_score_zone(zone, order) *
+			 zone->managed_pages;
+		pages += zone->managed_pages;
+	}
+
+	return pages ? div64_u64(score, pages) : 0;
+}
+
+static unsigned int fragmentation_score_wmark(bool high)
+{
+	unsigned int wmark = 100 - READ_ONCE(sysctl_compaction_proactiveness);
+
+	return high ? min(wmark + 10, 100U) : wmark;
+}
+
+static void kcompactd_do_work(pg_data_t *pgdat, unsigned int order)
+{
+	struct compact_control cc = {
+		.order = -1,
+		.mode = MIGRATE_SYNC_LIGHT,
+		.deadline = jiffies + msecs_to_jiffies(KCOMPACTD_BUDGET_MSECS),
+	};
+	unsigned int wmark_low = fragmentation_score_wmark(false);
+	int zoneid;
+
+	count_compact_event(KCOMPACTD_WAKE);
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!kcompactd_zone_suitable(zone, order))
+			continue;
+		if (fragmentation_score_zone(zone, order) <= wmark_low)
+			continue;
+
+		cc.nr_freepages = 0;
+		cc.nr_migratepages = 0;
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		/* the next pass over the zone starts with fresh skip hints */
+		if (compact_zone(zone, &cc) == COMPACT_COMPLETE)
+			__reset_isolation_suitable(zone);
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+
+		if (time_after(jiffies, cc.deadline) || kthread_should_stop())
+			break;
+	}
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = p;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	unsigned int defer = 0;
+	bool active = false;
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		unsigned int order, score, prev;
+
+		if (!READ_ONCE(sysctl_compaction_proactiveness)) {
+			active = false;
+			wait_event_freezable(pgdat->kcompactd_wait,
+					kthread_should_stop() ||
+					READ_ONCE(sysctl_compaction_proactiveness));
+			continue;
+		}
+
+		wait_event_freezable_timeout(pgdat->kcompactd_wait,
+				kthread_should_stop(),
+				msecs_to_jiffies(KCOMPACTD_WAKE_MSECS));
+		if (defer) {
+			defer--;
+			continue;
+		}
+
+		order = READ_ONCE(sysctl_compaction_proactive_order);
+		prev = fragmentation_score_node(pgdat, order);
+		/* start above the high mark, keep going down to the low one */
+		if (prev <= fragmentation_score_wmark(!active))
+			continue;
+
+		active = true;
+		kcompactd_do_work(pgdat, order);
+
+		score = fragmentation_score_node(pgdat, order);
+		if (score <= fragmentation_score_wmark(false))
+			active = false;
+		else if (score >= prev) {
+			/* compaction doesn't help, e.g. too much is pinned */
+			active = false;
+			defer = 1 << COMPACT_MAX_DEFER_SHIFT;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		pr_err("Failed to start kcompactd on node %d\n", nid);
+		ret = PTR_ERR(pgdat->kcompactd);
+		pgdat->kcompactd = NULL;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.  Caller must
+ * hold mem_hotplug_begin/end().
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+int sysctl_compaction_proactiveness_handler(struct ctl_table *table,
+			int write, void __user *buffer, size_t *length,
+			loff_t *ppos)
+{
+	int ret, nid;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	for_each_node_state(nid, N_MEMORY)
+		wake_up_interruptible(&NODE_DATA(nid)->kcompactd_wait);
+	return 0;
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+subsys_initcall(kcompactd_init);
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 static ssize_t sysfs_compact_node(struct device *dev,
 			struct device_attribute *attr,
@@ -94,8 +94,8 @@
  *    ->swap_lock		(try_to_unmap_one)
  *    ->private_lock		(try_to_unmap_one)
  *    ->tree_lock		(try_to_unmap_one)
- *    ->zone.lru_lock		(follow_page->mark_page_accessed)
- *    ->zone.lru_lock		(check_pte_range->isolate_lru_page)
+ *    ->lruvec->lru_lock	(follow_page->mark_page_accessed)
+ *    ->lruvec->lru_lock	(check_pte_range->isolate_lru_page)
  *    ->private_lock		(page_remove_rmap->set_page_dirty)
  *    ->tree_lock		(page_remove_rmap->set_page_dirty)
  *    bdi.wb->list_lock		(page_remove_rmap->set_page_dirty)
@@ -1471,6 +1471,31 @@ static void shrink_readahead_size_eio(struct file *filp,
 	ra->ra_pages /= 4;
 }
 
+/*
+ * Return the page at @index from the batch do_generic_file_read() looked
+ * up ahead, or look up a new batch of up to @nr contiguous pages starting
+ * at @index in a single radix tree walk.  Pages of the old batch that were
+ * not handed out are dropped.
+ */
+static struct page *read_batch_next(struct address_space *mapping,
+				    struct pagevec *batch, unsigned int *next,
+				    pgoff_t index, unsigned long nr)
+{
+	if (*next < pagevec_count(batch)) {
+		if (batch->pages[*next]->index == index)
+			return batch->pages[(*next)++];
+		release_pages(batch->pages + *next,
+			      pagevec_count(batch) - *next, false);
+	}
+
+	nr = clamp_t(unsigned long, nr, 1, PAGEVEC_SIZE);
+	batch->nr = find_get_pages_contig(mapping, index, nr, batch->pages);
+	*next = 0;
+	if (!batch->nr)
+		return NULL;
+	return batch->pages[(*next)++];
+}
+
 /**
  * do_generic_file_read - generic file read routine
  * @filp:	the file to read
@@ -1495,8 +1520,14 @@ static ssize_t do_generic_file_read(struct file *filp, loff_t *ppos,
 	pgoff_t prev_index;
 	unsigned long offset;      /* offset into pagecache page */
 	unsigned int prev_offset;
+	struct pagevec batch;		/* pages looked up ahead */
+	struct pagevec done;		/* copied pages, to be released */
+	unsigned int next = 0;
 	int error = 0;
 
+	pagevec_init(&batch, 0);
+	pagevec_init(&done, 0);
+
 	index = *ppos >> PAGE_CACHE_SHIFT;
 	prev_index = ra->prev_pos >> PAGE_CACHE_SHIFT;
 	prev_offset = ra->prev_pos & (PAGE_CACHE_SIZE-1);
@@ -1511,12 +1542,14 @@ static ssize_t do_generic_file_read(struct file *filp, loff_t *ppos,
 
 		cond_resched();
 find_page:
-		page = find_get_page(mapping, index);
+		page = read_batch_next(mapping, &batch, &next,
+				       index, last_index - index);
 		if (!page) {
 			page_cache_sync_readahead(mapping,
 					ra, filp,
 					index, last_index - index);
-			page = find_get_page(mapping, index);
+			page = read_batch_next(mapping, &batch, &next,
+					       index, last_index - index);
 			if (unlikely(page == NULL))
 				goto no_cached_page;
 		}
@@ -1593,7 +1626,10 @@ page_ok:
 		offset &= ~PAGE_CACHE_MASK;
 		prev_offset = offset;
 
-		page_cache_release(page);
+		if (!pagevec_add(&done, page)) {
+			release_pages(done.pages, pagevec_count(&done), false);
+			pagevec_reinit(&done);
+		}
 		written += ret;
 		if (!iov_iter_count(iter))
 			goto out;
@@ -1694,6 +1730,12 @@ no_cached_page:
 	}
 
 out:
+	if (next < pagevec_count(&batch))
+		release_pages(batch.pages + next, pagevec_count(&batch) - next,
+			      false);
+	if (pagevec_count(&done))
+		release_pages(done.pages, pagevec_count(&done), false);
+
 	ra->prev_pos = prev_index;
 	ra->prev_pos <<= PAGE_CACHE_SHIFT;
 	ra->prev_pos |= prev_offset;
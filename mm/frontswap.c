@@ -19,6 +19,7 @@
 #include <linux/debugfs.h>
 #include <linux/frontswap.h>
 #include <linux/swapfile.h>
+#include <linux/pagemap.h>
 
 /*
  * frontswap_ops are added by frontswap_register_ops, and provide the
@@ -289,6 +290,70 @@ int __frontswap_store(struct page *page)
 }
 EXPORT_SYMBOL(__frontswap_store);
 
+/*
+ * Offer a locked page to the backend to store in the background.  Returns
+ * 0 if the backend took it: the page is then unlocked, and under writeback
+ * until the backend calls frontswap_store_end() for it.  Otherwise the page
+ * is still locked and __frontswap_store() can be tried.
+ *
+ * Only done with a single backend, as a failed store goes to the swap
+ * device rather than to the next backend, and not for swap files, which
+ * are not written through bios.
+ */
+int __frontswap_store_async(struct page *page)
+{
+	swp_entry_t entry = { .val = page_private(page), };
+	int type = swp_type(entry);
+	struct swap_info_struct *sis = swap_info[type];
+	pgoff_t offset = swp_offset(entry);
+	struct frontswap_ops *ops = frontswap_ops;
+
+	if (!ops || ops->next || !ops->store_async ||
+	    frontswap_writethrough_enabled)
+		return -1;
+
+	BUG_ON(!PageLocked(page));
+	BUG_ON(sis == NULL);
+
+	if (sis->flags & SWP_FILE)
+		return -1;
+
+	/* A dup: the old page goes first, see __frontswap_store(). */
+	if (__frontswap_test(sis, offset)) {
+		__frontswap_clear(sis, offset);
+		ops->invalidate_page(type, offset);
+	}
+
+	if (ops->store_async(type, offset, page))
+		return -1;
+	unlock_page(page);
+	return 0;
+}
+EXPORT_SYMBOL(__frontswap_store_async);
+
+/*
+ * Called by the backend when it is done with a page it took in
+ * __frontswap_store_async(): @ret is 0 if the page was stored, otherwise
+ * it is written to the swap device instead.  May sleep.
+ */
+void frontswap_store_end(struct page *page, int ret)
+{
+	swp_entry_t entry = { .val = page_private(page), };
+	struct swap_info_struct *sis = swap_info[swp_type(entry)];
+
+	VM_BUG_ON_PAGE(!PageWriteback(page), page);
+
+	if (ret == 0) {
+		__frontswap_set(sis, swp_offset(entry));
+		inc_frontswap_succ_stores();
+		end_page_writeback(page);
+	} else {
+		inc_frontswap_failed_stores();
+		swap_writepage_submit(page);
+	}
+}
+EXPORT_SYMBOL(frontswap_store_end);
+
 /*
  * "Get" data from frontswap associated with swaptype and offset that were
  * specified when the data was put to frontswap and use it to fill the
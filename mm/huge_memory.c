@@ -49,12 +49,9 @@ unsigned long transparent_hugepage_flags __read_mostly =
 
 /* default scan 8*512 pte (or vmas) every 30 second */
 static unsigned int khugepaged_pages_to_scan __read_mostly = HPAGE_PMD_NR*8;
-static unsigned int khugepaged_pages_collapsed;
-static unsigned int khugepaged_full_scans;
 static unsigned int khugepaged_scan_sleep_millisecs __read_mostly = 10000;
 /* during fragmentation poll the hugepage allocator once every minute */
 static unsigned int khugepaged_alloc_sleep_millisecs __read_mostly = 60000;
-static struct task_struct *khugepaged_thread __read_mostly;
 static DEFINE_MUTEX(khugepaged_mutex);
 static DEFINE_SPINLOCK(khugepaged_mm_lock);
 static DECLARE_WAIT_QUEUE_HEAD(khugepaged_wait);
@@ -65,9 +62,11 @@ static DECLARE_WAIT_QUEUE_HEAD(khugepaged_wait);
  */
 static unsigned int khugepaged_max_ptes_none __read_mostly = HPAGE_PMD_NR-1;
 
-static int khugepaged(void *none);
+static int khugepaged(void *data);
 static int khugepaged_slab_init(void);
 static void khugepaged_slab_exit(void);
+static int khugepaged_scans_init(void);
+static void khugepaged_scans_exit(void);
 
 #define MM_SLOTS_HASH_BITS 10
 static __read_mostly DEFINE_HASHTABLE(mm_slots_hash, MM_SLOTS_HASH_BITS);
@@ -77,13 +76,15 @@ static struct kmem_cache *mm_slot_cache __read_mostly;
 /**
  * struct mm_slot - hash lookup from mm to mm_slot
  * @hash: hash collision list
- * @mm_node: khugepaged scan list headed in khugepaged_scan.mm_head
+ * @mm_node: khugepaged scan list headed in @scan->mm_head
  * @mm: the mm that this information is valid for
+ * @scan: the per-node scan whose list the mm is on
  */
 struct mm_slot {
 	struct hlist_node hash;
 	struct list_head mm_node;
 	struct mm_struct *mm;
+	struct khugepaged_scan *scan;
 };
 
 /**
@@ -91,17 +92,53 @@ struct mm_slot {
  * @mm_head: the head of the mm list to scan
  * @mm_slot: the current mm_slot we are scanning
  * @address: the next address inside that to be scanned
+ * @node: the node this scan and its khugepaged thread belong to
+ * @thread: the khugepaged thread working on this scan
+ * @pages_collapsed: hugepages collapsed by @thread
+ * @full_scans: passes @thread made over @mm_head
+ * @last_target_node: for balancing collapses between equally loaded nodes
+ * @node_load: where the small pages of the pmd being scanned are
+ * @mm_node_load: where the small pages of the mm being scanned are
  *
- * There is only the one khugepaged_scan instance of this cursor structure.
+ * There is one khugepaged_scan per node with memory, each with its own
+ * khugepaged thread, and an mm is on the list of the node where most of
+ * its memory is.  All of them are protected by khugepaged_mm_lock.
  */
 struct khugepaged_scan {
 	struct list_head mm_head;
 	struct mm_slot *mm_slot;
 	unsigned long address;
+	int node;
+	struct task_struct *thread;
+	unsigned int pages_collapsed;
+	unsigned int full_scans;
+	int last_target_node;
+	int node_load[MAX_NUMNODES];
+	unsigned int mm_node_load[MAX_NUMNODES];
 };
-static struct khugepaged_scan khugepaged_scan = {
-	.mm_head = LIST_HEAD_INIT(khugepaged_scan.mm_head),
-};
+static struct khugepaged_scan *khugepaged_scans[MAX_NUMNODES] __read_mostly;
+
+#define for_each_khugepaged_scan(scan, nid)			\
+	for_each_node(nid)					\
+		if (((scan) = khugepaged_scans[nid]) != NULL)
+
+/*
+ * The scan an mm is first queued on: that of the node the task faulting
+ * in its first huge-eligible vma runs on, which is where its memory will
+ * have been allocated.  khugepaged_scan_mm_slot() moves it elsewhere if
+ * that turns out not to be the case.
+ */
+static struct khugepaged_scan *khugepaged_node_scan(int nid)
+{
+	if (nid == NUMA_NO_NODE || !khugepaged_scans[nid])
+		nid = first_memory_node;
+	if (!khugepaged_scans[nid]) {
+		for_each_node(nid)
+			if (khugepaged_scans[nid])
+				break;
+	}
+	return nid < MAX_NUMNODES ? khugepaged_scans[nid] : NULL;
+}
 
 
 static int set_recommended_min_free_kbytes(void)
@@ -142,27 +179,65 @@ static int set_recommended_min_free_kbytes(void)
 	return 0;
 }
 
+/*
+ * Start one khugepaged thread per node with memory, bound to the node's
+ * cpus (if it has any) so that the copies into the new hugepages, which
+ * are allocated on the node where the small pages are, stay local.
+ */
+static int start_khugepaged(struct khugepaged_scan *scan)
+{
+	const struct cpumask *mask = cpumask_of_node(scan->node);
+	struct task_struct *thread;
+
+	if (scan->thread)
+		return 0;
+
+	thread = kthread_create_on_node(khugepaged, scan, scan->node,
+					"khugepaged%d", scan->node);
+	if (IS_ERR(thread)) {
+		pr_err("khugepaged: kthread_create(khugepaged%d) failed\n",
+		       scan->node);
+		return PTR_ERR(thread);
+	}
+	if (cpumask_any_and(mask, cpu_online_mask) < nr_cpu_ids)
+		set_cpus_allowed_ptr(thread, mask);
+	scan->thread = thread;
+	wake_up_process(thread);
+	return 0;
+}
+
+static void stop_khugepaged(void)
+{
+	struct khugepaged_scan *scan;
+	int nid;
+
+	for_each_khugepaged_scan(scan, nid) {
+		if (scan->thread) {
+			kthread_stop(scan->thread);
+			scan->thread = NULL;
+		}
+	}
+}
+
 static int start_stop_khugepaged(void)
 {
-	int err = 0;
+	struct khugepaged_scan *scan;
+	int nid, err = 0;
+
 	if (khugepaged_enabled()) {
-		if (!khugepaged_thread)
-			khugepaged_thread = kthread_run(khugepaged, NULL,
-							"khugepaged");
-		if (unlikely(IS_ERR(khugepaged_thread))) {
-			pr_err("khugepaged: kthread_run(khugepaged) failed\n");
-			err = PTR_ERR(khugepaged_thread);
-			khugepaged_thread = NULL;
-			goto fail;
+		for_each_khugepaged_scan(scan, nid) {
+			err = start_khugepaged(scan);
+			if (unlikely(err)) {
+				stop_khugepaged();
+				goto fail;
+			}
 		}
 
-		if (!list_empty(&khugepaged_scan.mm_head))
-			wake_up_interruptible(&khugepaged_wait);
+		wake_up_interruptible(&khugepaged_wait);
 
 		set_recommended_min_free_kbytes();
-	} else if (khugepaged_thread) {
-		kthread_stop(khugepaged_thread);
-		khugepaged_thread = NULL;
+	} else {
+		stop_khugepaged();
 	}
 fail:
 	return err;
@@ -492,16 +567,62 @@ static ssize_t pages_collapsed_show(struct kobject *kobj,
 				    struct kobj_attribute *attr,
 				    char *buf)
 {
-	return sprintf(buf, "%u\n", khugepaged_pages_collapsed);
+	struct khugepaged_scan *scan;
+	unsigned int collapsed = 0;
+	int nid;
+
+	for_each_khugepaged_scan(scan, nid)
+		collapsed += READ_ONCE(scan->pages_collapsed);
+	return sprintf(buf, "%u\n", collapsed);
 }
 static struct kobj_attribute pages_collapsed_attr =
 	__ATTR_RO(pages_collapsed);
 
+/*
+ * The per-node breakdown of pages_collapsed, as "N<node>=<collapsed>"
+ * pairs like in /proc/<pid>/numa_maps.
+ */
+static ssize_t node_pages_collapsed_show(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 char *buf)
+{
+	struct khugepaged_scan *scan;
+	ssize_t len = 0;
+	int nid;
+
+	for_each_khugepaged_scan(scan, nid)
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%sN%d=%u",
+				 len ? " " : "", nid,
+				 READ_ONCE(scan->pages_collapsed));
+	len += scnprintf(buf + len, PAGE_SIZE - len, "\n");
+	return len;
+}
+static struct kobj_attribute node_pages_collapsed_attr =
+	__ATTR_RO(node_pages_collapsed);
+
+/*
+ * All mms have been scanned once the slowest node with mms to scan has
+ * gone through its list, so report the fewest passes among those.
+ */
 static ssize_t full_scans_show(struct kobject *kobj,
 			       struct kobj_attribute *attr,
 			       char *buf)
 {
-	return sprintf(buf, "%u\n", khugepaged_full_scans);
+	unsigned int full_scans = UINT_MAX, idle_scans = 0;
+	struct khugepaged_scan *scan;
+	int nid;
+
+	for_each_khugepaged_scan(scan, nid) {
+		unsigned int n = READ_ONCE(scan->full_scans);
+
+		if (list_empty(&scan->mm_head))
+			idle_scans = max(idle_scans, n);
+		else
+			full_scans = min(full_scans, n);
+	}
+	if (full_scans == UINT_MAX)
+		full_scans = idle_scans;
+	return sprintf(buf, "%u\n", full_scans);
 }
 static struct kobj_attribute full_scans_attr =
 	__ATTR_RO(full_scans);
@@ -561,6 +682,7 @@ static struct attribute *khugepaged_attr[] = {
 	&khugepaged_max_ptes_none_attr.attr,
 	&pages_to_scan_attr.attr,
 	&pages_collapsed_attr.attr,
+	&node_pages_collapsed_attr.attr,
 	&full_scans_attr.attr,
 	&scan_sleep_millisecs_attr.attr,
 	&alloc_sleep_millisecs_attr.attr,
@@ -638,6 +760,10 @@ static int __init hugepage_init(void)
 	if (err)
 		goto err_slab;
 
+	err = khugepaged_scans_init();
+	if (err)
+		goto err_scans;
+
 	err = register_shrinker(&huge_zero_page_shrinker);
 	if (err)
 		goto err_hzp_shrinker;
@@ -660,6 +786,8 @@ static int __init hugepage_init(void)
 err_khugepaged:
 	unregister_shrinker(&huge_zero_page_shrinker);
 err_hzp_shrinker:
+	khugepaged_scans_exit();
+err_scans:
 	khugepaged_slab_exit();
 err_slab:
 	hugepage_exit_sysfs(hugepage_kobj);
@@ -1641,8 +1769,7 @@ static void __split_huge_page_refcount(struct page *page,
 	int tail_count = 0;
 
 	/* prevent PageLRU to go away from under us, and freeze lru stats */
-	spin_lock_irq(&zone->lru_lock);
-	lruvec = mem_cgroup_page_lruvec(page, zone);
+	lruvec = lock_page_lruvec_irq(page);
 
 	compound_lock(page);
 	/* complete memcg works before add pages to LRU */
@@ -1725,7 +1852,7 @@ static void __split_huge_page_refcount(struct page *page,
 
 	ClearPageCompound(page);
 	compound_unlock(page);
-	spin_unlock_irq(&zone->lru_lock);
+	spin_unlock_irq(&lruvec->lru_lock);
 
 	for (i = 1; i < HPAGE_PMD_NR; i++) {
 		struct page *page_tail = page + i;
@@ -1983,6 +2110,36 @@ static void __init khugepaged_slab_exit(void)
 	kmem_cache_destroy(mm_slot_cache);
 }
 
+static int __init khugepaged_scans_init(void)
+{
+	struct khugepaged_scan *scan;
+	int nid;
+
+	for_each_node_state(nid, N_MEMORY) {
+		scan = kzalloc_node(sizeof(*scan), GFP_KERNEL, nid);
+		if (!scan) {
+			khugepaged_scans_exit();
+			return -ENOMEM;
+		}
+		INIT_LIST_HEAD(&scan->mm_head);
+		scan->node = nid;
+		scan->last_target_node = NUMA_NO_NODE;
+		khugepaged_scans[nid] = scan;
+	}
+
+	return 0;
+}
+
+static void __init khugepaged_scans_exit(void)
+{
+	int nid;
+
+	for_each_node(nid) {
+		kfree(khugepaged_scans[nid]);
+		khugepaged_scans[nid] = NULL;
+	}
+}
+
 static inline struct mm_slot *alloc_mm_slot(void)
 {
 	if (!mm_slot_cache)	/* initialization failed */
@@ -2020,9 +2177,14 @@ static inline int khugepaged_test_exit(struct mm_struct *mm)
 
 int __khugepaged_enter(struct mm_struct *mm)
 {
+	struct khugepaged_scan *scan;
 	struct mm_slot *mm_slot;
 	int wakeup;
 
+	scan = khugepaged_node_scan(numa_node_id());
+	if (!scan)	/* initialization failed */
+		return -ENOMEM;
+
 	mm_slot = alloc_mm_slot();
 	if (!mm_slot)
 		return -ENOMEM;
@@ -2040,8 +2202,9 @@ int __khugepaged_enter(struct mm_struct *mm)
 	 * Insert just behind the scanning cursor, to let the area settle
 	 * down a little.
 	 */
-	wakeup = list_empty(&khugepaged_scan.mm_head);
-	list_add_tail(&mm_slot->mm_node, &khugepaged_scan.mm_head);
+	mm_slot->scan = scan;
+	wakeup = list_empty(&scan->mm_head);
+	list_add_tail(&mm_slot->mm_node, &scan->mm_head);
 	spin_unlock(&khugepaged_mm_lock);
 
 	atomic_inc(&mm->mm_count);
@@ -2079,7 +2242,7 @@ void __khugepaged_exit(struct mm_struct *mm)
 
 	spin_lock(&khugepaged_mm_lock);
 	mm_slot = get_mm_slot(mm);
-	if (mm_slot && khugepaged_scan.mm_slot != mm_slot) {
+	if (mm_slot && mm_slot->scan->mm_slot != mm_slot) {
 		hash_del(&mm_slot->hash);
 		list_del(&mm_slot->mm_node);
 		free = 1;
@@ -2261,9 +2424,7 @@ static void khugepaged_alloc_sleep(void)
 			msecs_to_jiffies(khugepaged_alloc_sleep_millisecs));
 }
 
-static int khugepaged_node_load[MAX_NUMNODES];
-
-static bool khugepaged_scan_abort(int nid)
+static bool khugepaged_scan_abort(struct khugepaged_scan *scan, int nid)
 {
 	int i;
 
@@ -2275,11 +2436,11 @@ static bool khugepaged_scan_abort(int nid)
 		return false;
 
 	/* If there is a count for this node already, it must be acceptable */
-	if (khugepaged_node_load[nid])
+	if (scan->node_load[nid])
 		return false;
 
 	for (i = 0; i < MAX_NUMNODES; i++) {
-		if (!khugepaged_node_load[i])
+		if (!scan->node_load[i])
 			continue;
 		if (node_distance(nid, i) > RECLAIM_DISTANCE)
 			return true;
@@ -2288,28 +2449,45 @@ static bool khugepaged_scan_abort(int nid)
 }
 
 #ifdef CONFIG_NUMA
-static int khugepaged_find_target_node(void)
+static int khugepaged_find_target_node(struct khugepaged_scan *scan)
 {
-	static int last_khugepaged_target_node = NUMA_NO_NODE;
 	int nid, target_node = 0, max_value = 0;
 
 	/* find first node with max normal pages hit */
 	for (nid = 0; nid < MAX_NUMNODES; nid++)
-		if (khugepaged_node_load[nid] > max_value) {
-			max_value = khugepaged_node_load[nid];
+		if (scan->node_load[nid] > max_value) {
+			max_value = scan->node_load[nid];
 			target_node = nid;
 		}
 
 	/* do some balance if several nodes have the same hit record */
-	if (target_node <= last_khugepaged_target_node)
-		for (nid = last_khugepaged_target_node + 1; nid < MAX_NUMNODES;
+	if (target_node <= scan->last_target_node)
+		for (nid = scan->last_target_node + 1; nid < MAX_NUMNODES;
 				nid++)
-			if (max_value == khugepaged_node_load[nid]) {
+			if (max_value == scan->node_load[nid]) {
 				target_node = nid;
 				break;
 			}
 
-	last_khugepaged_target_node = target_node;
+	scan->last_target_node = target_node;
+	return target_node;
+}
+
+/*
+ * The node most of the mm's pages seen in this pass were on, or the
+ * scan's own node if that is as good as any.
+ */
+static int khugepaged_find_mm_node(struct khugepaged_scan *scan)
+{
+	unsigned int max_value = scan->mm_node_load[scan->node];
+	int nid, target_node = scan->node;
+
+	for (nid = 0; nid < MAX_NUMNODES; nid++)
+		if (scan->mm_node_load[nid] > max_value) {
+			max_value = scan->mm_node_load[nid];
+			target_node = nid;
+		}
+
 	return target_node;
 }
 
@@ -2356,11 +2534,16 @@ khugepaged_alloc_page(struct page **hpage, gfp_t gfp, struct mm_struct *mm,
 	return *hpage;
 }
 #else
-static int khugepaged_find_target_node(void)
+static int khugepaged_find_target_node(struct khugepaged_scan *scan)
 {
 	return 0;
 }
 
+static int khugepaged_find_mm_node(struct khugepaged_scan *scan)
+{
+	return scan->node;
+}
+
 static inline struct page *alloc_hugepage(int defrag)
 {
 	return alloc_pages(alloc_hugepage_gfpmask(defrag, 0),
@@ -2424,7 +2607,8 @@ static bool hugepage_vma_check(struct vm_area_struct *vma)
 	return true;
 }
 
-static void collapse_huge_page(struct mm_struct *mm,
+static void collapse_huge_page(struct khugepaged_scan *scan,
+				   struct mm_struct *mm,
 				   unsigned long address,
 				   struct page **hpage,
 				   struct vm_area_struct *vma,
@@ -2550,7 +2734,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 
 	*hpage = NULL;
 
-	khugepaged_pages_collapsed++;
+	scan->pages_collapsed++;
 out_up_write:
 	up_write(&mm->mmap_sem);
 	return;
@@ -2560,7 +2744,8 @@ out:
 	goto out_up_write;
 }
 
-static int khugepaged_scan_pmd(struct mm_struct *mm,
+static int khugepaged_scan_pmd(struct khugepaged_scan *scan,
+			       struct mm_struct *mm,
 			       struct vm_area_struct *vma,
 			       unsigned long address,
 			       struct page **hpage)
@@ -2580,7 +2765,7 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 	if (!pmd)
 		goto out;
 
-	memset(khugepaged_node_load, 0, sizeof(khugepaged_node_load));
+	memset(scan->node_load, 0, sizeof(scan->node_load));
 	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
 	for (_address = address, _pte = pte; _pte < pte+HPAGE_PMD_NR;
 	     _pte++, _address += PAGE_SIZE) {
@@ -2601,14 +2786,16 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 			goto out_unmap;
 		/*
 		 * Record which node the original page is from and save this
-		 * information to khugepaged_node_load[].
+		 * information to scan->node_load[].
 		 * Khupaged will allocate hugepage from the node has the max
-		 * hit record.
+		 * hit record.  scan->mm_node_load[] adds it up for the whole
+		 * mm, to decide which node's khugepaged should scan it.
 		 */
 		node = page_to_nid(page);
-		if (khugepaged_scan_abort(node))
+		scan->mm_node_load[node]++;
+		if (khugepaged_scan_abort(scan, node))
 			goto out_unmap;
-		khugepaged_node_load[node]++;
+		scan->node_load[node]++;
 		VM_BUG_ON_PAGE(PageCompound(page), page);
 		if (!PageLRU(page) || PageLocked(page) || !PageAnon(page))
 			goto out_unmap;
@@ -2628,9 +2815,9 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 out_unmap:
 	pte_unmap_unlock(pte, ptl);
 	if (ret) {
-		node = khugepaged_find_target_node();
+		node = khugepaged_find_target_node(scan);
 		/* collapse_huge_page will return with the mmap_sem released */
-		collapse_huge_page(mm, address, hpage, vma, node);
+		collapse_huge_page(scan, mm, address, hpage, vma, node);
 	}
 out:
 	return ret;
@@ -2659,7 +2846,30 @@ static void collect_mm_slot(struct mm_slot *mm_slot)
 	}
 }
 
-static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
+/*
+ * Hand an mm whose pages turned out to be mostly on another node over to
+ * that node's khugepaged.
+ */
+static void khugepaged_move_mm_slot(struct khugepaged_scan *scan,
+				    struct mm_slot *mm_slot)
+{
+	struct khugepaged_scan *target;
+	int nid;
+
+	VM_BUG_ON(NR_CPUS != 1 && !spin_is_locked(&khugepaged_mm_lock));
+
+	nid = khugepaged_find_mm_node(scan);
+	target = khugepaged_scans[nid];
+	if (nid == scan->node || !target)
+		return;
+
+	list_move_tail(&mm_slot->mm_node, &target->mm_head);
+	mm_slot->scan = target;
+	wake_up_interruptible(&khugepaged_wait);
+}
+
+static unsigned int khugepaged_scan_mm_slot(struct khugepaged_scan *scan,
+					    unsigned int pages,
 					    struct page **hpage)
 	__releases(&khugepaged_mm_lock)
 	__acquires(&khugepaged_mm_lock)
@@ -2672,22 +2882,25 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 	VM_BUG_ON(!pages);
 	VM_BUG_ON(NR_CPUS != 1 && !spin_is_locked(&khugepaged_mm_lock));
 
-	if (khugepaged_scan.mm_slot)
-		mm_slot = khugepaged_scan.mm_slot;
+	if (scan->mm_slot)
+		mm_slot = scan->mm_slot;
 	else {
-		mm_slot = list_entry(khugepaged_scan.mm_head.next,
+		mm_slot = list_entry(scan->mm_head.next,
 				     struct mm_slot, mm_node);
-		khugepaged_scan.address = 0;
-		khugepaged_scan.mm_slot = mm_slot;
+		scan->address = 0;
+		scan->mm_slot = mm_slot;
 	}
 	spin_unlock(&khugepaged_mm_lock);
 
+	if (!scan->address)
+		memset(scan->mm_node_load, 0, sizeof(scan->mm_node_load));
+
 	mm = mm_slot->mm;
 	down_read(&mm->mmap_sem);
 	if (unlikely(khugepaged_test_exit(mm)))
 		vma = NULL;
 	else
-		vma = find_vma(mm, khugepaged_scan.address);
+		vma = find_vma(mm, scan->address);
 
 	progress++;
 	for (; vma; vma = vma->vm_next) {
@@ -2707,26 +2920,26 @@ skip:
 		hend = vma->vm_end & HPAGE_PMD_MASK;
 		if (hstart >= hend)
 			goto skip;
-		if (khugepaged_scan.address > hend)
+		if (scan->address > hend)
 			goto skip;
-		if (khugepaged_scan.address < hstart)
-			khugepaged_scan.address = hstart;
-		VM_BUG_ON(khugepaged_scan.address & ~HPAGE_PMD_MASK);
+		if (scan->address < hstart)
+			scan->address = hstart;
+		VM_BUG_ON(scan->address & ~HPAGE_PMD_MASK);
 
-		while (khugepaged_scan.address < hend) {
+		while (scan->address < hend) {
 			int ret;
 			cond_resched();
 			if (unlikely(khugepaged_test_exit(mm)))
 				goto breakouterloop;
 
-			VM_BUG_ON(khugepaged_scan.address < hstart ||
-				  khugepaged_scan.address + HPAGE_PMD_SIZE >
+			VM_BUG_ON(scan->address < hstart ||
+				  scan->address + HPAGE_PMD_SIZE >
 				  hend);
-			ret = khugepaged_scan_pmd(mm, vma,
-						  khugepaged_scan.address,
+			ret = khugepaged_scan_pmd(scan, mm, vma,
+						  scan->address,
 						  hpage);
 			/* move to next address */
-			khugepaged_scan.address += HPAGE_PMD_SIZE;
+			scan->address += HPAGE_PMD_SIZE;
 			progress += HPAGE_PMD_NR;
 			if (ret)
 				/* we released mmap_sem so break loop */
@@ -2740,7 +2953,7 @@ breakouterloop:
 breakouterloop_mmap_sem:
 
 	spin_lock(&khugepaged_mm_lock);
-	VM_BUG_ON(khugepaged_scan.mm_slot != mm_slot);
+	VM_BUG_ON(scan->mm_slot != mm_slot);
 	/*
 	 * Release the current mm_slot if this mm is about to die, or
 	 * if we scanned all vmas of this mm.
@@ -2751,35 +2964,38 @@ breakouterloop_mmap_sem:
 		 * khugepaged runs here, khugepaged_exit will find
 		 * mm_slot not pointing to the exiting mm.
 		 */
-		if (mm_slot->mm_node.next != &khugepaged_scan.mm_head) {
-			khugepaged_scan.mm_slot = list_entry(
+		if (mm_slot->mm_node.next != &scan->mm_head) {
+			scan->mm_slot = list_entry(
 				mm_slot->mm_node.next,
 				struct mm_slot, mm_node);
-			khugepaged_scan.address = 0;
+			scan->address = 0;
 		} else {
-			khugepaged_scan.mm_slot = NULL;
-			khugepaged_full_scans++;
+			scan->mm_slot = NULL;
+			scan->full_scans++;
 		}
 
-		collect_mm_slot(mm_slot);
+		if (khugepaged_test_exit(mm))
+			collect_mm_slot(mm_slot);
+		else
+			khugepaged_move_mm_slot(scan, mm_slot);
 	}
 
 	return progress;
 }
 
-static int khugepaged_has_work(void)
+static int khugepaged_has_work(struct khugepaged_scan *scan)
 {
-	return !list_empty(&khugepaged_scan.mm_head) &&
+	return !list_empty(&scan->mm_head) &&
 		khugepaged_enabled();
 }
 
-static int khugepaged_wait_event(void)
+static int khugepaged_wait_event(struct khugepaged_scan *scan)
 {
-	return !list_empty(&khugepaged_scan.mm_head) ||
+	return !list_empty(&scan->mm_head) ||
 		kthread_should_stop();
 }
 
-static void khugepaged_do_scan(void)
+static void khugepaged_do_scan(struct khugepaged_scan *scan)
 {
 	struct page *hpage = NULL;
 	unsigned int progress = 0, pass_through_head = 0;
@@ -2798,11 +3014,12 @@ static void khugepaged_do_scan(void)
 			break;
 
 		spin_lock(&khugepaged_mm_lock);
-		if (!khugepaged_scan.mm_slot)
+		if (!scan->mm_slot)
 			pass_through_head++;
-		if (khugepaged_has_work() &&
+		if (khugepaged_has_work(scan) &&
 		    pass_through_head < 2)
-			progress += khugepaged_scan_mm_slot(pages - progress,
+			progress += khugepaged_scan_mm_slot(scan,
+							    pages - progress,
 							    &hpage);
 		else
 			progress = pages;
@@ -2813,9 +3030,9 @@ static void khugepaged_do_scan(void)
 		put_page(hpage);
 }
 
-static void khugepaged_wait_work(void)
+static void khugepaged_wait_work(struct khugepaged_scan *scan)
 {
-	if (khugepaged_has_work()) {
+	if (khugepaged_has_work(scan)) {
 		if (!khugepaged_scan_sleep_millisecs)
 			return;
 
@@ -2826,24 +3043,26 @@ static void khugepaged_wait_work(void)
 	}
 
 	if (khugepaged_enabled())
-		wait_event_freezable(khugepaged_wait, khugepaged_wait_event());
+		wait_event_freezable(khugepaged_wait,
+				     khugepaged_wait_event(scan));
 }
 
-static int khugepaged(void *none)
+static int khugepaged(void *data)
 {
+	struct khugepaged_scan *scan = data;
 	struct mm_slot *mm_slot;
 
 	set_freezable();
 	set_user_nice(current, MAX_NICE);
 
 	while (!kthread_should_stop()) {
-		khugepaged_do_scan();
-		khugepaged_wait_work();
+		khugepaged_do_scan(scan);
+		khugepaged_wait_work(scan);
 	}
 
 	spin_lock(&khugepaged_mm_lock);
-	mm_slot = khugepaged_scan.mm_slot;
-	khugepaged_scan.mm_slot = NULL;
+	mm_slot = scan->mm_slot;
+	scan->mm_slot = NULL;
 	if (mm_slot)
 		collect_mm_slot(mm_slot);
 	spin_unlock(&khugepaged_mm_lock);
@@ -193,6 +193,9 @@ struct compact_control {
 					 * contention detected during
 					 * compaction
 					 */
+	unsigned long deadline;		/* jiffies at which kcompactd's
+					 * proactive compaction stops
+					 */
 };
 
 unsigned long
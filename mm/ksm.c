@@ -23,7 +23,7 @@
 #include <linux/pagemap.h>
 #include <linux/rmap.h>
 #include <linux/spinlock.h>
-#include <linux/jhash.h>
+#include <linux/crc32c.h>
 #include <linux/delay.h>
 #include <linux/kthread.h>
 #include <linux/wait.h>
@@ -37,6 +37,7 @@
 #include <linux/freezer.h>
 #include <linux/oom.h>
 #include <linux/numa.h>
+#include <linux/log2.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -154,6 +155,8 @@ struct stable_node {
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
  * @oldchecksum: previous checksum of the page at that virtual address
+ * @volatility: number of consecutive scans that found the checksum changed
+ * @skip_scans: number of scans still to pass over this volatile page
  * @node: rb node of this rmap_item in the unstable tree
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
@@ -169,6 +172,8 @@ struct rmap_item {
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
+	u8 volatility;			/* when unstable */
+	u8 skip_scans;			/* when unstable */
 	union {
 		struct rb_node node;	/* when node of unstable tree */
 		struct {		/* when listed from stable tree */
@@ -217,12 +222,25 @@ static unsigned long ksm_pages_unshared;
 /* The number of rmap_items in use: to calculate pages_volatile */
 static unsigned long ksm_rmap_items;
 
+/* Total number of page slots ever merged into a KSM page */
+static unsigned long ksm_pages_merged;
+
+/* Number of volatile pages passed over without checksumming */
+static unsigned long ksm_pages_skipped;
+
 /* Number of pages ksmd should scan in one batch */
 static unsigned int ksm_thread_pages_to_scan = 100;
 
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Number of cache lines sampled per page for the checksum, 0 for all */
+static unsigned int ksm_checksum_sample;
+
+/* Most full scans a repeatedly changing page is passed over for, 0 for none */
+static unsigned int ksm_volatile_skip_max;
+#define KSM_VOLATILE_SKIP_LIMIT	U8_MAX
+
 #ifdef CONFIG_NUMA
 /* Zeroed when merging across nodes is not allowed */
 static unsigned int ksm_merge_across_nodes = 1;
@@ -825,11 +843,27 @@ error:
 }
 #endif /* CONFIG_SYSFS */
 
+/*
+ * The checksum only serves to tell whether a page changed since the last
+ * scan, so it need not be strong: crc32c is used because most architectures
+ * have an instruction for it.  When checksum_sample is set, only that many
+ * evenly spaced cache lines of the page are hashed; a page that changes
+ * elsewhere then gets into the unstable tree, which copes with that anyway.
+ */
 static u32 calc_checksum(struct page *page)
 {
-	u32 checksum;
+	unsigned int i, sample = READ_ONCE(ksm_checksum_sample);
+	u32 checksum = ~0;
 	void *addr = kmap_atomic(page);
-	checksum = jhash2(addr, PAGE_SIZE / 4, 17);
+
+	if (!sample) {
+		checksum = crc32c(checksum, addr, PAGE_SIZE);
+	} else {
+		for (i = 0; i < sample; i++)
+			checksum = crc32c(checksum,
+					  addr + i * (PAGE_SIZE / sample),
+					  L1_CACHE_BYTES);
+	}
 	kunmap_atomic(addr);
 	return checksum;
 }
@@ -1397,9 +1431,10 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 	rmap_item->address |= STABLE_FLAG;
 	hlist_add_head(&rmap_item->hlist, &stable_node->hlist);
 
-	if (rmap_item->hlist.next)
+	if (rmap_item->hlist.next) {
 		ksm_pages_sharing++;
-	else
+		ksm_pages_merged++;
+	} else
 		ksm_pages_shared++;
 }
 
@@ -1421,6 +1456,13 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	unsigned int checksum;
 	int err;
 
+	/* Pass over a page which kept changing the last few times around */
+	if (rmap_item->skip_scans) {
+		rmap_item->skip_scans--;
+		ksm_pages_skipped++;
+		return;
+	}
+
 	stable_node = page_stable_node(page);
 	if (stable_node) {
 		if (stable_node->head != &migrate_nodes &&
@@ -1464,12 +1506,21 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 * we calculated it, this page is changing frequently: therefore we
 	 * don't want to insert it in the unstable tree, and we don't want
 	 * to waste our time searching for something identical to it there.
+	 * If it keeps changing, don't even checksum it for a while: back off
+	 * exponentially, up to volatile_skip_max full scans.  The first change
+	 * is usually just the checksum being set for a new rmap_item, so the
+	 * backoff only starts with the second.
 	 */
 	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
+		if (rmap_item->volatility < 10)
+			rmap_item->volatility++;
+		rmap_item->skip_scans = min((1U << rmap_item->volatility) / 4,
+					    READ_ONCE(ksm_volatile_skip_max));
 		return;
 	}
+	rmap_item->volatility = 0;
 
 	tree_rmap_item =
 		unstable_tree_search_insert(rmap_item, page, &tree_page);
@@ -2127,6 +2178,57 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 }
 KSM_ATTR(pages_to_scan);
 
+static ssize_t checksum_sample_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_checksum_sample);
+}
+
+static ssize_t checksum_sample_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	int err;
+	unsigned long lines;
+
+	err = kstrtoul(buf, 10, &lines);
+	if (err || lines > PAGE_SIZE / L1_CACHE_BYTES)
+		return -EINVAL;
+	if (lines && !is_power_of_2(lines))
+		return -EINVAL;
+
+	/* sampling every line is the same as hashing the whole page */
+	if (lines == PAGE_SIZE / L1_CACHE_BYTES)
+		lines = 0;
+	ksm_checksum_sample = lines;
+
+	return count;
+}
+KSM_ATTR(checksum_sample);
+
+static ssize_t volatile_skip_max_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_volatile_skip_max);
+}
+
+static ssize_t volatile_skip_max_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	int err;
+	unsigned long scans;
+
+	err = kstrtoul(buf, 10, &scans);
+	if (err || scans > KSM_VOLATILE_SKIP_LIMIT)
+		return -EINVAL;
+
+	ksm_volatile_skip_max = scans;
+
+	return count;
+}
+KSM_ATTR(volatile_skip_max);
+
 static ssize_t run_show(struct kobject *kobj, struct kobj_attribute *attr,
 			char *buf)
 {
@@ -2271,6 +2373,20 @@ static ssize_t pages_volatile_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(pages_volatile);
 
+static ssize_t pages_merged_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_merged);
+}
+KSM_ATTR_RO(pages_merged);
+
+static ssize_t pages_skipped_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_skipped);
+}
+KSM_ATTR_RO(pages_skipped);
+
 static ssize_t full_scans_show(struct kobject *kobj,
 			       struct kobj_attribute *attr, char *buf)
 {
@@ -2286,7 +2402,11 @@ static struct attribute *ksm_attrs[] = {
 	&pages_sharing_attr.attr,
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
+	&pages_merged_attr.attr,
+	&pages_skipped_attr.attr,
 	&full_scans_attr.attr,
+	&checksum_sample_attr.attr,
+	&volatile_skip_max_attr.attr,
 #ifdef CONFIG_NUMA
 	&merge_across_nodes_attr.attr,
 #endif
@@ -325,6 +325,14 @@ struct mem_cgroup {
 	 */
 	struct mem_cgroup_stat_cpu __percpu *stat;
 	spinlock_t pcp_counter_lock;
+	/*
+	 * Sums of the percpu counters as of the last memcg_stats_flush(),
+	 * for this memcg alone and for the subtree rooted at it.
+	 */
+	long stat_local[MEM_CGROUP_STAT_NSTATS];
+	long stat_tree[MEM_CGROUP_STAT_NSTATS];
+	unsigned long events_local[MEMCG_NR_EVENTS];
+	unsigned long events_tree[MEMCG_NR_EVENTS];
 
 #if defined(CONFIG_MEMCG_KMEM) && defined(CONFIG_INET)
 	struct cg_proto tcp_mem;
@@ -823,6 +831,12 @@ mem_cgroup_largest_soft_limit_node(struct mem_cgroup_tree_per_zone *mctz)
  * value, and reading all cpu value can be performance bottleneck in some
  * common workload, threashold and synchonization as vmstat[] should be
  * implemented.
+ *
+ * memory.stat turned out to be such a case: with thousands of memcgs its
+ * hierarchical totals cost O(cpus * memcgs) per read.  It is now served
+ * from the stat_local/stat_tree copies, which memcg_stats_flush() brings
+ * up to date every MEMCG_STATS_FLUSH_INTERVAL; everything else still reads
+ * the percpu counters directly.
  */
 static long mem_cgroup_read_stat(struct mem_cgroup *memcg,
 				 enum mem_cgroup_stat_index idx)
@@ -846,6 +860,98 @@ static unsigned long mem_cgroup_read_events(struct mem_cgroup *memcg,
 	return val;
 }
 
+/*
+ * How often memcg_stats_flush() folds the percpu counters into the flushed
+ * copies, i.e. how stale memory.stat may be.
+ */
+#define MEMCG_STATS_FLUSH_INTERVAL	HZ
+
+static DEFINE_MUTEX(memcg_stats_mutex);
+static void memcg_stats_flush_work(struct work_struct *w);
+static DECLARE_DEFERRABLE_WORK(memcg_stats_dwork, memcg_stats_flush_work);
+
+/*
+ * Does @ancestor's subtree total include its descendants?  This mirrors
+ * for_each_mem_cgroup_tree(), which only descends below the root or
+ * below a memcg with use_hierarchy set.
+ */
+static bool memcg_stats_aggregates(struct mem_cgroup *ancestor)
+{
+	return ancestor == root_mem_cgroup || ancestor->use_hierarchy;
+}
+
+static struct mem_cgroup *memcg_stats_parent(struct mem_cgroup *memcg)
+{
+	if (!memcg->css.parent)
+		return NULL;
+	return mem_cgroup_from_css(memcg->css.parent);
+}
+
+/*
+ * Fold @memcg's percpu counters into its flushed copies and propagate the
+ * change since the previous flush to the subtree totals of its ancestors.
+ * Only the delta is propagated, so a flush costs O(cpus + depth) per
+ * counter no matter how many descendants the ancestors have.
+ */
+static void memcg_stats_flush_one(struct mem_cgroup *memcg)
+{
+	struct mem_cgroup *mi;
+	unsigned int i;
+
+	lockdep_assert_held(&memcg_stats_mutex);
+
+	for (i = 0; i < MEM_CGROUP_STAT_NSTATS; i++) {
+		long val = mem_cgroup_read_stat(memcg, i);
+		long delta = val - memcg->stat_local[i];
+
+		if (!delta)
+			continue;
+		WRITE_ONCE(memcg->stat_local[i], val);
+		WRITE_ONCE(memcg->stat_tree[i], memcg->stat_tree[i] + delta);
+		for (mi = memcg_stats_parent(memcg); mi;
+		     mi = memcg_stats_parent(mi)) {
+			if (!memcg_stats_aggregates(mi))
+				continue;
+			WRITE_ONCE(mi->stat_tree[i], mi->stat_tree[i] + delta);
+		}
+	}
+
+	for (i = 0; i < MEMCG_NR_EVENTS; i++) {
+		unsigned long val = mem_cgroup_read_events(memcg, i);
+		unsigned long delta = val - memcg->events_local[i];
+
+		if (!delta)
+			continue;
+		WRITE_ONCE(memcg->events_local[i], val);
+		WRITE_ONCE(memcg->events_tree[i], memcg->events_tree[i] + delta);
+		for (mi = memcg_stats_parent(memcg); mi;
+		     mi = memcg_stats_parent(mi)) {
+			if (!memcg_stats_aggregates(mi))
+				continue;
+			WRITE_ONCE(mi->events_tree[i], mi->events_tree[i] + delta);
+		}
+	}
+}
+
+/* Flushed, and therefore possibly stale, readers for memory.stat */
+static long memcg_stat_flushed(struct mem_cgroup *memcg,
+			       enum mem_cgroup_stat_index idx, bool tree)
+{
+	long val = tree ? READ_ONCE(memcg->stat_tree[idx]) :
+			  READ_ONCE(memcg->stat_local[idx]);
+
+	/* Per-cpu values can be negative, the sum only transiently so */
+	return max(val, 0L);
+}
+
+static unsigned long memcg_events_flushed(struct mem_cgroup *memcg,
+					  enum mem_cgroup_events_index idx,
+					  bool tree)
+{
+	return tree ? READ_ONCE(memcg->events_tree[idx]) :
+		      READ_ONCE(memcg->events_local[idx]);
+}
+
 static void mem_cgroup_charge_statistics(struct mem_cgroup *memcg,
 					 struct page *page,
 					 int nr_pages)
@@ -1173,6 +1279,25 @@ void mem_cgroup_iter_break(struct mem_cgroup *root,
 	     iter != NULL;				\
 	     iter = mem_cgroup_iter(NULL, iter, NULL))
 
+static void memcg_stats_flush(void)
+{
+	struct mem_cgroup *memcg;
+
+	mutex_lock(&memcg_stats_mutex);
+	for_each_mem_cgroup(memcg) {
+		memcg_stats_flush_one(memcg);
+		cond_resched();
+	}
+	mutex_unlock(&memcg_stats_mutex);
+}
+
+static void memcg_stats_flush_work(struct work_struct *w)
+{
+	memcg_stats_flush();
+	queue_delayed_work(system_unbound_wq, &memcg_stats_dwork,
+			   round_jiffies_relative(MEMCG_STATS_FLUSH_INTERVAL));
+}
+
 void __mem_cgroup_count_vm_event(struct mm_struct *mm, enum vm_event_item idx)
 {
 	struct mem_cgroup *memcg;
@@ -1236,8 +1361,9 @@ out:
  * @zone: zone of the page
  *
  * This function is only safe when following the LRU page isolation
- * and putback protocol: the LRU lock must be held, and the page must
- * either be PageLRU() or the caller must have isolated/allocated it.
+ * and putback protocol: the lock of the returned lruvec must be held,
+ * and the page must either be PageLRU() or the caller must have
+ * isolated/allocated it.  lock_page_lruvec_irq() looks up and locks it.
  */
 struct lruvec *mem_cgroup_page_lruvec(struct page *page, struct zone *zone)
 {
@@ -2081,12 +2207,20 @@ void mem_cgroup_update_page_stat(struct mem_cgroup *memcg,
 
 /*
  * size of first charge trial. "32" comes from vmscan.c's magic value.
- * TODO: maybe necessary to use big numbers in big irons.
+ * A CPU that keeps charging to the same memcg at a high rate gets its
+ * batch doubled up to CHARGE_BATCH_MAX, see stock_batch().
  */
 #define CHARGE_BATCH	32U
+#define CHARGE_BATCH_MAX	512U
+/* stock used up quicker than this: grow the batch */
+#define CHARGE_BATCH_FAST	max(HZ / 100, 1)
+/* stock lasted longer than this: shrink the batch */
+#define CHARGE_BATCH_SLOW	(HZ / 10)
 struct memcg_stock_pcp {
 	struct mem_cgroup *cached; /* this never be root cgroup */
 	unsigned int nr_pages;
+	unsigned int batch;		/* size of the last refill */
+	unsigned long refill_stamp;	/* jiffies at the last refill */
 	struct work_struct work;
 	unsigned long flags;
 #define FLUSHING_CACHED_CHARGE	0
@@ -2153,8 +2287,10 @@ static void drain_local_stock(struct work_struct *dummy)
 /*
  * Cache charges(val) to local per_cpu area.
  * This will be consumed by consume_stock() function, later.
+ * @batch is the size of the charge @nr_pages were left over from.
  */
-static void refill_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
+static void refill_stock(struct mem_cgroup *memcg, unsigned int nr_pages,
+			 unsigned int batch)
 {
 	struct memcg_stock_pcp *stock = &get_cpu_var(memcg_stock);
 
@@ -2163,7 +2299,39 @@ static void refill_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 		stock->cached = memcg;
 	}
 	stock->nr_pages += nr_pages;
+	stock->batch = batch;
+	stock->refill_stamp = jiffies;
+	put_cpu_var(memcg_stock);
+}
+
+/*
+ * How many pages to charge to @memcg's page_counter when this cpu's stock
+ * ran dry.  The batch adapts to the rate at which this cpu charges to
+ * @memcg: it doubles when the last refill was used up within
+ * CHARGE_BATCH_FAST and halves when it lasted longer than
+ * CHARGE_BATCH_SLOW.  It only grows while @memcg has room for a batch
+ * that size on every cpu, so that stocks don't push a small memcg into
+ * reclaim.
+ */
+static unsigned int stock_batch(struct mem_cgroup *memcg)
+{
+	struct memcg_stock_pcp *stock = &get_cpu_var(memcg_stock);
+	unsigned int batch = CHARGE_BATCH;
+	unsigned long since;
+
+	if (stock->cached != memcg)
+		goto out;
+
+	batch = max(stock->batch, CHARGE_BATCH);
+	since = jiffies - stock->refill_stamp;
+	if (since > CHARGE_BATCH_SLOW)
+		batch = max(batch / 2, CHARGE_BATCH);
+	else if (since < CHARGE_BATCH_FAST && batch < CHARGE_BATCH_MAX &&
+		 mem_cgroup_margin(memcg) >= 2UL * batch * num_online_cpus())
+		batch *= 2;
+out:
 	put_cpu_var(memcg_stock);
+	return batch;
 }
 
 /*
@@ -2222,7 +2390,7 @@ static int memcg_cpu_hotplug_callback(struct notifier_block *nb,
 static int try_charge(struct mem_cgroup *memcg, gfp_t gfp_mask,
 		      unsigned int nr_pages)
 {
-	unsigned int batch = max(CHARGE_BATCH, nr_pages);
+	unsigned int batch = 0;
 	int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
 	struct mem_cgroup *mem_over_limit;
 	struct page_counter *counter;
@@ -2237,6 +2405,9 @@ retry:
 	if (consume_stock(memcg, nr_pages))
 		goto done;
 
+	if (!batch)
+		batch = max(stock_batch(memcg), nr_pages);
+
 	if (!do_swap_account ||
 	    !page_counter_try_charge(&memcg->memsw, batch, &counter)) {
 		if (!page_counter_try_charge(&memcg->memory, batch, &counter))
@@ -2250,6 +2421,8 @@ retry:
 	}
 
 	if (batch > nr_pages) {
+		/* close to the limit, don't grow the stock any further */
+		this_cpu_write(memcg_stock.batch, CHARGE_BATCH);
 		batch = nr_pages;
 		goto retry;
 	}
@@ -2326,7 +2499,7 @@ bypass:
 done_restock:
 	css_get_many(&memcg->css, batch);
 	if (batch > nr_pages)
-		refill_stock(memcg, batch - nr_pages);
+		refill_stock(memcg, batch - nr_pages, batch);
 	if (!(gfp_mask & __GFP_WAIT))
 		goto done;
 	/*
@@ -2389,40 +2562,42 @@ struct mem_cgroup *try_get_mem_cgroup_from_page(struct page *page)
 	return memcg;
 }
 
-static void lock_page_lru(struct page *page, int *isolated)
+/*
+ * page->mem_cgroup of a page that may be on an LRU list must only change
+ * under the lock of the lruvec it belongs to before the change: that is
+ * what lock_page_lruvec_irq() relies on to find the right lock.
+ */
+static struct lruvec *lock_page_lru(struct page *page, int *isolated)
 {
-	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec;
 
-	spin_lock_irq(&zone->lru_lock);
+	lruvec = lock_page_lruvec_irq(page);
 	if (PageLRU(page)) {
-		struct lruvec *lruvec;
-
-		lruvec = mem_cgroup_page_lruvec(page, zone);
 		ClearPageLRU(page);
 		del_page_from_lru_list(page, lruvec, page_lru(page));
 		*isolated = 1;
 	} else
 		*isolated = 0;
+	return lruvec;
 }
 
-static void unlock_page_lru(struct page *page, int isolated)
+static void unlock_page_lru(struct page *page, struct lruvec *lruvec,
+			    int isolated)
 {
-	struct zone *zone = page_zone(page);
-
 	if (isolated) {
-		struct lruvec *lruvec;
-
-		lruvec = mem_cgroup_page_lruvec(page, zone);
+		/* the page now belongs to a different lruvec */
+		lruvec = relock_page_lruvec_irq(page, lruvec);
 		VM_BUG_ON_PAGE(PageLRU(page), page);
 		SetPageLRU(page);
 		add_page_to_lru_list(page, lruvec, page_lru(page));
 	}
-	spin_unlock_irq(&zone->lru_lock);
+	spin_unlock_irq(&lruvec->lru_lock);
 }
 
 static void commit_charge(struct page *page, struct mem_cgroup *memcg,
 			  bool lrucare)
 {
+	struct lruvec *uninitialized_var(lruvec);
 	int isolated;
 
 	VM_BUG_ON_PAGE(page->mem_cgroup, page);
@@ -2432,7 +2607,7 @@ static void commit_charge(struct page *page, struct mem_cgroup *memcg,
 	 * may already be on some other mem_cgroup's LRU.  Take care of it.
 	 */
 	if (lrucare)
-		lock_page_lru(page, &isolated);
+		lruvec = lock_page_lru(page, &isolated);
 
 	/*
 	 * Nobody should be changing or seriously looking at
@@ -2451,7 +2626,7 @@ static void commit_charge(struct page *page, struct mem_cgroup *memcg,
 	page->mem_cgroup = memcg;
 
 	if (lrucare)
-		unlock_page_lru(page, isolated);
+		unlock_page_lru(page, lruvec, isolated);
 }
 
 #ifdef CONFIG_MEMCG_KMEM
@@ -2761,7 +2936,7 @@ struct mem_cgroup *__mem_cgroup_from_kmem(void *ptr)
 
 /*
  * Because tail pages are not marked as "used", set it. We're under
- * zone->lru_lock, 'splitting on pmd' and compound_lock.
+ * the head page's lruvec->lru_lock, 'splitting on pmd' and compound_lock.
  * charge/uncharge will be never happen and move_account() is done under
  * compound_lock(), so we don't have to take care of races.
  */
@@ -3118,16 +3293,7 @@ out:
 static unsigned long tree_stat(struct mem_cgroup *memcg,
 			       enum mem_cgroup_stat_index idx)
 {
-	struct mem_cgroup *iter;
-	long val = 0;
-
-	/* Per-cpu values can be negative, use a signed accumulator */
-	for_each_mem_cgroup_tree(iter, memcg)
-		val += mem_cgroup_read_stat(iter, idx);
-
-	if (val < 0) /* race ? */
-		val = 0;
-	return val;
+	return memcg_stat_flushed(memcg, idx, true);
 }
 
 static inline u64 mem_cgroup_usage(struct mem_cgroup *memcg, bool swap)
@@ -3470,12 +3636,12 @@ static int memcg_stat_show(struct seq_file *m, void *v)
 		if (i == MEM_CGROUP_STAT_SWAP && !do_swap_account)
 			continue;
 		seq_printf(m, "%s %ld\n", mem_cgroup_stat_names[i],
-			   mem_cgroup_read_stat(memcg, i) * PAGE_SIZE);
+			   memcg_stat_flushed(memcg, i, false) * PAGE_SIZE);
 	}
 
 	for (i = 0; i < MEM_CGROUP_EVENTS_NSTATS; i++)
 		seq_printf(m, "%s %lu\n", mem_cgroup_events_names[i],
-			   mem_cgroup_read_events(memcg, i));
+			   memcg_events_flushed(memcg, i, false));
 
 	for (i = 0; i < NR_LRU_LISTS; i++)
 		seq_printf(m, "%s %lu\n", mem_cgroup_lru_names[i],
@@ -3494,23 +3660,17 @@ static int memcg_stat_show(struct seq_file *m, void *v)
 			   (u64)memsw * PAGE_SIZE);
 
 	for (i = 0; i < MEM_CGROUP_STAT_NSTATS; i++) {
-		long long val = 0;
+		long long val;
 
 		if (i == MEM_CGROUP_STAT_SWAP && !do_swap_account)
 			continue;
-		for_each_mem_cgroup_tree(mi, memcg)
-			val += mem_cgroup_read_stat(mi, i) * PAGE_SIZE;
+		val = (long long)memcg_stat_flushed(memcg, i, true) * PAGE_SIZE;
 		seq_printf(m, "total_%s %lld\n", mem_cgroup_stat_names[i], val);
 	}
 
-	for (i = 0; i < MEM_CGROUP_EVENTS_NSTATS; i++) {
-		unsigned long long val = 0;
-
-		for_each_mem_cgroup_tree(mi, memcg)
-			val += mem_cgroup_read_events(mi, i);
-		seq_printf(m, "total_%s %llu\n",
-			   mem_cgroup_events_names[i], val);
-	}
+	for (i = 0; i < MEM_CGROUP_EVENTS_NSTATS; i++)
+		seq_printf(m, "total_%s %lu\n", mem_cgroup_events_names[i],
+			   memcg_events_flushed(memcg, i, true));
 
 	for (i = 0; i < NR_LRU_LISTS; i++) {
 		unsigned long long val = 0;
@@ -4660,6 +4820,11 @@ static void mem_cgroup_css_free(struct cgroup_subsys_state *css)
 {
 	struct mem_cgroup *memcg = mem_cgroup_from_css(css);
 
+	/* hand the final counts over to the ancestors' subtree totals */
+	mutex_lock(&memcg_stats_mutex);
+	memcg_stats_flush_one(memcg);
+	mutex_unlock(&memcg_stats_mutex);
+
 	memcg_destroy_kmem(memcg);
 	__mem_cgroup_free(memcg);
 }
@@ -5853,6 +6018,7 @@ void mem_cgroup_uncharge_list(struct list_head *page_list)
 void mem_cgroup_migrate(struct page *oldpage, struct page *newpage,
 			bool lrucare)
 {
+	struct lruvec *uninitialized_var(lruvec);
 	struct mem_cgroup *memcg;
 	int isolated;
 
@@ -5882,12 +6048,12 @@ void mem_cgroup_migrate(struct page *oldpage, struct page *newpage,
 		return;
 
 	if (lrucare)
-		lock_page_lru(oldpage, &isolated);
+		lruvec = lock_page_lru(oldpage, &isolated);
 
 	oldpage->mem_cgroup = NULL;
 
 	if (lrucare)
-		unlock_page_lru(oldpage, isolated);
+		unlock_page_lru(oldpage, lruvec, isolated);
 
 	commit_charge(newpage, memcg, lrucare);
 }
@@ -5910,6 +6076,10 @@ static int __init mem_cgroup_init(void)
 		INIT_WORK(&per_cpu_ptr(&memcg_stock, cpu)->work,
 			  drain_local_stock);
 
+	if (!mem_cgroup_disabled())
+		queue_delayed_work(system_unbound_wq, &memcg_stats_dwork,
+				   round_jiffies_relative(MEMCG_STATS_FLUSH_INTERVAL));
+
 	for_each_node(node) {
 		struct mem_cgroup_tree_per_node *rtpn;
 		int zone;
@@ -3245,6 +3245,180 @@ out:
 }
 EXPORT_SYMBOL(__alloc_pages_nodemask);
 
+/*
+ * Take up to @nr_pages order-0 pages off this cpu's pcp list of @zone,
+ * refilling it from the buddy lists with a single zone->lock round trip,
+ * all with interrupts disabled only once.  Returns the number of pages
+ * added to @list, which still need prep_new_page().
+ */
+static unsigned long rmqueue_pcp_bulk(struct zone *preferred_zone,
+			struct zone *zone, unsigned long nr_pages,
+			gfp_t gfp_flags, int migratetype, struct list_head *list)
+{
+	bool cold = ((gfp_flags & __GFP_COLD) != 0);
+	struct per_cpu_pages *pcp;
+	struct list_head *pcp_list;
+	unsigned long flags, i;
+	struct page *page;
+
+	local_irq_save(flags);
+	pcp = &this_cpu_ptr(zone->pageset)->pcp;
+	pcp_list = &pcp->lists[migratetype];
+	for (i = 0; i < nr_pages; i++) {
+		if (list_empty(pcp_list)) {
+			pcp->count += rmqueue_bulk(zone, 0,
+					max_t(unsigned long, nr_pages - i,
+					      pcp->batch),
+					pcp_list, migratetype, cold);
+			if (unlikely(list_empty(pcp_list)))
+				break;
+		}
+
+		if (cold)
+			page = list_entry(pcp_list->prev, struct page, lru);
+		else
+			page = list_entry(pcp_list->next, struct page, lru);
+
+		list_move_tail(&page->lru, list);
+		pcp->count--;
+		VM_BUG_ON_PAGE(bad_range(zone, page), page);
+	}
+
+	if (i) {
+		__mod_zone_page_state(zone, NR_ALLOC_BATCH, -i);
+		if (atomic_long_read(&zone->vm_stat[NR_ALLOC_BATCH]) <= 0 &&
+		    !test_bit(ZONE_FAIR_DEPLETED, &zone->flags))
+			set_bit(ZONE_FAIR_DEPLETED, &zone->flags);
+
+		__count_zone_vm_events(PGALLOC, zone, i);
+		for (nr_pages = i; nr_pages; nr_pages--)
+			zone_statistics(preferred_zone, zone, gfp_flags);
+	}
+	local_irq_restore(flags);
+
+	return i;
+}
+
+/**
+ * __alloc_pages_bulk - allocate a number of order-0 pages
+ * @gfp_mask: GFP flags for the allocation
+ * @zonelist: zonelist to allocate from
+ * @nodemask: nodes to allocate from, or NULL for all of them
+ * @nr_pages: number of pages to allocate
+ * @page_list: list to add the pages to, or NULL to use @page_array
+ * @page_array: array whose NULL entries are to be filled in
+ *
+ * The pages come from the pcp list of the first allowed zone that stays
+ * above its low watermark after giving out all of them, with interrupts
+ * disabled once for the whole batch and the pcp list refilled with a
+ * single zone->lock acquisition.  Whatever that can't provide is
+ * allocated page by page with __alloc_pages_nodemask(), which may enter
+ * the slow path as usual.
+ *
+ * Returns the number of pages added to @page_list, or the number of
+ * populated entries in @page_array.  That can be less than @nr_pages
+ * if the allocation fails part way through.
+ */
+unsigned long
+__alloc_pages_bulk(gfp_t gfp_mask, struct zonelist *zonelist,
+		   nodemask_t *nodemask, unsigned long nr_pages,
+		   struct list_head *page_list, struct page **page_array)
+{
+	int alloc_flags = ALLOC_WMARK_LOW|ALLOC_CPUSET;
+	int migratetype = gfpflags_to_migratetype(gfp_mask);
+	enum zone_type high_zoneidx = gfp_zone(gfp_mask);
+	unsigned long nr_populated = 0, nr_allocated = 0, i;
+	struct zone *zone, *preferred_zone;
+	struct page *page, *next;
+	struct zoneref *z;
+	int classzone_idx;
+	LIST_HEAD(pages);
+
+	if (page_array) {
+		for (i = 0; i < nr_pages; i++)
+			if (page_array[i])
+				nr_populated++;
+	}
+	nr_pages -= nr_populated;
+	if (!nr_pages)
+		return nr_populated;
+
+	gfp_mask &= gfp_allowed_mask;
+
+	lockdep_trace_alloc(gfp_mask);
+
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	/* Leave single pages and debug checking to the regular path */
+	if (nr_pages == 1 || kmemcheck_enabled ||
+	    IS_ENABLED(CONFIG_FAIL_PAGE_ALLOC))
+		goto fallback;
+
+	if (unlikely(!zonelist->_zonerefs->zone))
+		return nr_populated;
+
+	if (IS_ENABLED(CONFIG_CMA) && migratetype == MIGRATE_MOVABLE)
+		alloc_flags |= ALLOC_CMA;
+
+	z = first_zones_zonelist(zonelist, high_zoneidx,
+				 nodemask ? : &cpuset_current_mems_allowed,
+				 &preferred_zone);
+	if (!preferred_zone)
+		goto fallback;
+	classzone_idx = zonelist_zone_idx(z);
+
+	for_each_zone_zonelist_nodemask(zone, z, zonelist, high_zoneidx,
+					nodemask) {
+		if (cpusets_enabled() &&
+		    !cpuset_zone_allowed(zone, gfp_mask | __GFP_HARDWALL))
+			continue;
+		if ((gfp_mask & __GFP_WRITE) && !zone_dirty_ok(zone))
+			continue;
+		if (zone_watermark_ok(zone, 0, low_wmark_pages(zone) + nr_pages,
+				      classzone_idx, alloc_flags))
+			break;
+	}
+	if (!zone)
+		goto fallback;
+
+	rmqueue_pcp_bulk(preferred_zone, zone, nr_pages, gfp_mask,
+			 migratetype, &pages);
+
+	list_for_each_entry_safe(page, next, &pages, lru) {
+		/* A bad page is left alone, like in get_page_from_freelist() */
+		if (prep_new_page(page, 0, gfp_mask, alloc_flags)) {
+			list_del(&page->lru);
+			continue;
+		}
+		trace_mm_page_alloc(page, 0, gfp_mask, migratetype);
+		nr_allocated++;
+	}
+
+fallback:
+	while (nr_allocated < nr_pages) {
+		page = __alloc_pages_nodemask(gfp_mask, 0, zonelist, nodemask);
+		if (!page)
+			break;
+		list_add_tail(&page->lru, &pages);
+		nr_allocated++;
+	}
+
+	if (page_list) {
+		list_splice_tail(&pages, page_list);
+	} else {
+		i = 0;
+		list_for_each_entry_safe(page, next, &pages, lru) {
+			list_del(&page->lru);
+			while (page_array[i])
+				i++;
+			page_array[i] = page;
+		}
+	}
+
+	return nr_populated + nr_allocated;
+}
+EXPORT_SYMBOL(__alloc_pages_bulk);
+
 /*
  * Common helper functions.
  */
@@ -5319,6 +5493,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 #endif
 	init_waitqueue_head(&pgdat->kswapd_wait);
 	init_waitqueue_head(&pgdat->pfmemalloc_wait);
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat_page_ext_init(pgdat);
 
 	for (j = 0; j < MAX_NR_ZONES; j++) {
@@ -5375,7 +5552,6 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 #endif
 		zone->name = zone_names[j];
 		spin_lock_init(&zone->lock);
-		spin_lock_init(&zone->lru_lock);
 		zone_seqlock_init(zone);
 		zone->zone_pgdat = pgdat;
 		zone_pcp_init(zone);
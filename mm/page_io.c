@@ -22,6 +22,7 @@
 #include <linux/frontswap.h>
 #include <linux/blkdev.h>
 #include <linux/uio.h>
+#include <linux/backing-dev.h>
 #include <asm/pgtable.h>
 
 static struct bio *get_swap_bio(gfp_t gfp_flags,
@@ -237,6 +238,8 @@ int swap_writepage(struct page *page, struct writeback_control *wbc)
 		unlock_page(page);
 		goto out;
 	}
+	if (wbc->sync_mode == WB_SYNC_NONE && frontswap_store_async(page) == 0)
+		goto out;
 	if (frontswap_store(page) == 0) {
 		set_page_writeback(page);
 		unlock_page(page);
@@ -248,6 +251,35 @@ out:
 	return ret;
 }
 
+/*
+ * Write a swap cache page that is already under writeback and unlocked to
+ * the swap device: one that a frontswap backend took asynchronously but
+ * could not store.
+ */
+void swap_writepage_submit(struct page *page)
+{
+	struct bio *bio;
+
+	while (!(bio = get_swap_bio(GFP_NOIO, page, end_swap_bio_write))) {
+		/*
+		 * Leave the page dirty for reclaim to write again.  That
+		 * needs the page lock, but whoever holds it may be waiting
+		 * for our writeback to end: only try, and otherwise retry
+		 * the allocation.
+		 */
+		if (trylock_page(page)) {
+			set_page_dirty(page);
+			ClearPageReclaim(page);
+			unlock_page(page);
+			end_page_writeback(page);
+			return;
+		}
+		congestion_wait(BLK_RW_ASYNC, HZ / 50);
+	}
+	count_vm_event(PSWPOUT);
+	submit_bio(WRITE, bio);
+}
+
 static sector_t swap_page_sector(struct page *page)
 {
 	return (sector_t)__page_file_index(page) << (PAGE_CACHE_SHIFT - 9);
@@ -262,6 +262,39 @@ static unsigned long get_init_ra_size(unsigned long size, unsigned long max)
 	return newsize;
 }
 
+/*
+ * Access patterns recognised in ra->pattern, besides plain sequential
+ * reads.
+ */
+enum {
+	RA_PATTERN_NONE,
+	RA_PATTERN_STRIDE,	/* same-sized reads at a fixed forward stride */
+	RA_PATTERN_REVERSE,	/* same-sized reads walking backwards */
+};
+
+/* misses at the same distance in a row before a stride is trusted */
+#define RA_PATTERN_CONFIRM	2
+/* most chunks of a strided scan to keep in flight */
+#define RA_STRIDE_CHUNKS	8UL
+/* late marker hits before a stream's window is boosted */
+#define RA_LATE_BOOST		2
+#define RA_LATE_MAX		4
+
+/*
+ * The readahead window limit.  A stream whose readahead I/O is repeatedly
+ * still in flight when the reader catches up with it is bound by device
+ * latency rather than by its window, so let it grow to twice ra_pages.
+ */
+static unsigned long get_max_ra_size(struct file_ra_state *ra)
+{
+	unsigned long max = ra->ra_pages;
+
+	if (ra->late >= RA_LATE_BOOST)
+		max *= 2;
+
+	return max_sane_readahead(max);
+}
+
 /*
  *  Get the previous window size, ramp it up, and
  *  return it as the new window size.
@@ -272,7 +305,7 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
 	unsigned long cur = ra->size;
 	unsigned long newsize;
 
-	if (cur < max / 16)
+	if (cur < max / 16 || ra->late >= RA_LATE_BOOST)
 		newsize = 4 * cur;
 	else
 		newsize = 2 * cur;
@@ -317,7 +350,79 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
  *
  * The code ramps up the readahead size aggressively at first, but slow down as
  * it approaches max_readhead.
+ *
+ * Several sequential streams on one fd (e.g. a columnar scan reading a few
+ * columns of the same file in lockstep) would keep resetting each other's
+ * window.  When a read starts a new window, the old one is parked in
+ * ra->streams, and a later read continuing a parked window swaps it back
+ * in and carries on ramping it up, without the page cache probing below.
+ *
+ * Reads that miss at a constant distance from each other are recognised
+ * as a strided scan when the distance is larger than the read, or as a
+ * reverse scan when it is negative.  A strided scan reads ahead whole
+ * chunks at the following strides, a reverse scan reads ahead the window
+ * below the current one.  Both leave a PG_readahead marker for themselves
+ * like the sequential case does.
+ *
+ * Finally, a stream whose marker is hit while the readahead I/O behind it
+ * is still in flight is reading faster than the device delivers, and its
+ * window is ramped up faster and allowed to grow beyond ra_pages.
+ */
+
+static inline bool ra_window_next(pgoff_t start, unsigned int size,
+				  unsigned int async_size, pgoff_t offset)
+{
+	return offset == start + size - async_size || offset == start + size;
+}
+
+/*
+ * Save the current window before a read not continuing it replaces it.
+ * Strided and reverse windows are not worth remembering.
  */
+static void ra_park_stream(struct file_ra_state *ra)
+{
+	struct ra_stream *s;
+
+	if (!ra->size || ra->pattern != RA_PATTERN_NONE)
+		return;
+
+	s = &ra->streams[ra->next_stream];
+	ra->next_stream = (ra->next_stream + 1) % RA_STREAMS;
+	s->start = ra->start;
+	s->size = ra->size;
+	s->async_size = ra->async_size;
+}
+
+/*
+ * Does @offset continue one of the parked streams?  If so, swap it with
+ * the current window.
+ */
+static bool ra_resume_stream(struct file_ra_state *ra, pgoff_t offset)
+{
+	struct ra_stream *s, tmp;
+	int i;
+
+	for (i = 0; i < RA_STREAMS; i++) {
+		s = &ra->streams[i];
+		if (!s->size ||
+		    !ra_window_next(s->start, s->size, s->async_size, offset))
+			continue;
+
+		tmp = *s;
+		if (ra->pattern == RA_PATTERN_NONE) {
+			s->start = ra->start;
+			s->size = ra->size;
+			s->async_size = ra->async_size;
+		} else
+			s->size = 0;
+		ra->start = tmp.start;
+		ra->size = tmp.size;
+		ra->async_size = tmp.async_size;
+		ra->pattern = RA_PATTERN_NONE;
+		return true;
+	}
+	return false;
+}
 
 /*
  * Count contiguously cached pages from @offset-1 to @offset-@max,
@@ -364,6 +469,8 @@ static int try_context_readahead(struct address_space *mapping,
 	if (size >= offset)
 		size *= 2;
 
+	ra_park_stream(ra);
+	ra->pattern = RA_PATTERN_NONE;
 	ra->start = offset;
 	ra->size = min(size + req_size, max);
 	ra->async_size = 1;
@@ -371,6 +478,135 @@ static int try_context_readahead(struct address_space *mapping,
 	return 1;
 }
 
+/*
+ * Track the distance between consecutive misses.  Once the same distance
+ * has been seen RA_PATTERN_CONFIRM times in a row, it is the stride of a
+ * strided or reverse scan.  Misses that skip over strides we read ahead
+ * of keep the pattern going.
+ */
+static void ra_learn_pattern(struct file_ra_state *ra, pgoff_t offset,
+			     unsigned long req_size)
+{
+	long delta = (long)(offset - ra->prev_miss);
+	unsigned char old;
+
+	ra->prev_miss = offset;
+
+	if (ra->pattern != RA_PATTERN_NONE && ra->stride &&
+	    (delta > 0) == (ra->stride > 0) && !(delta % ra->stride))
+		return;
+
+	if (delta == ra->stride) {
+		if (ra->confidence < RA_PATTERN_CONFIRM)
+			ra->confidence++;
+	} else {
+		ra->stride = delta;
+		ra->confidence = 1;
+	}
+
+	old = ra->pattern;
+	if (ra->confidence < RA_PATTERN_CONFIRM)
+		ra->pattern = RA_PATTERN_NONE;
+	else if (ra->stride > (long)req_size)
+		ra->pattern = RA_PATTERN_STRIDE;
+	else if (ra->stride < 0)
+		ra->pattern = RA_PATTERN_REVERSE;
+	else
+		ra->pattern = RA_PATTERN_NONE;
+
+	/* the window of a scan that ended means nothing to sequential reads */
+	if (old != RA_PATTERN_NONE && ra->pattern == RA_PATTERN_NONE)
+		ra->size = 0;
+}
+
+/*
+ * Read ahead the chunks of a strided scan up to RA_STRIDE_CHUNKS strides
+ * past @offset.  ra->start is the first chunk not submitted yet and
+ * ra->size the chunk length.  The first new chunk halfway out or further
+ * gets the marker for the next round.
+ */
+static unsigned long ra_stride_submit(struct address_space *mapping,
+				      struct file_ra_state *ra,
+				      struct file *filp, pgoff_t offset)
+{
+	unsigned long chunks, i, nr = 0;
+	pgoff_t index;
+	bool marked = false;
+
+	chunks = clamp(get_max_ra_size(ra) / ra->size, 1UL, RA_STRIDE_CHUNKS);
+	for (i = 1; i <= chunks; i++) {
+		index = offset + i * ra->stride;
+		if (index < ra->start)
+			continue;
+		if (!marked && i > chunks / 2) {
+			nr += __do_page_cache_readahead(mapping, filp, index,
+							ra->size, ra->size);
+			marked = true;
+		} else
+			nr += __do_page_cache_readahead(mapping, filp, index,
+							ra->size, 0);
+		ra->start = index + ra->stride;
+	}
+	return nr;
+}
+
+/*
+ * Read ahead the window below @end for a reverse scan, with the marker a
+ * quarter of the way up from its bottom.
+ */
+static unsigned long ra_reverse_submit(struct address_space *mapping,
+				       struct file_ra_state *ra,
+				       struct file *filp, pgoff_t end,
+				       unsigned long size)
+{
+	ra->start = end > size ? end - size : 0;
+	ra->size = end - ra->start;
+	ra->async_size = ra->size - ra->size / 4;
+
+	return ra_submit(ra, mapping, filp);
+}
+
+/*
+ * Readahead for strided and reverse scans.  Returns -1 if the read is
+ * not part of the scan.
+ */
+static long pattern_readahead(struct address_space *mapping,
+			      struct file_ra_state *ra, struct file *filp,
+			      bool hit_readahead_marker, pgoff_t offset,
+			      unsigned long req_size)
+{
+	unsigned long max = get_max_ra_size(ra);
+	unsigned long nr;
+
+	switch (ra->pattern) {
+	case RA_PATTERN_STRIDE:
+		if (hit_readahead_marker) {
+			if (offset >= ra->start ||
+			    offset + RA_STRIDE_CHUNKS * ra->stride < ra->start)
+				return -1;
+			return ra_stride_submit(mapping, ra, filp, offset);
+		}
+		ra->size = req_size;
+		ra->start = offset + ra->stride;
+		nr = __do_page_cache_readahead(mapping, filp, offset,
+					       req_size, 0);
+		return nr + ra_stride_submit(mapping, ra, filp, offset);
+
+	case RA_PATTERN_REVERSE:
+		if (hit_readahead_marker) {
+			if (offset != ra->start + ra->size - ra->async_size)
+				return -1;
+			if (!ra->start)
+				return 0;
+			return ra_reverse_submit(mapping, ra, filp, ra->start,
+						 get_next_ra_size(ra, max));
+		}
+		return ra_reverse_submit(mapping, ra, filp, offset + req_size,
+					 get_init_ra_size(req_size, max));
+	}
+	return -1;
+}
+
 /*
  * A minimal readahead algorithm for trivial sequential/random reads.
  */
@@ -380,8 +616,22 @@ ondemand_readahead(struct address_space *mapping,
 		   bool hit_readahead_marker, pgoff_t offset,
 		   unsigned long req_size)
 {
-	unsigned long max = max_sane_readahead(ra->ra_pages);
+	unsigned long max = get_max_ra_size(ra);
 	pgoff_t prev_offset;
+	long nr;
+
+	if (!hit_readahead_marker)
+		ra_learn_pattern(ra, offset, req_size);
+
+	/*
+	 * Strided or reverse scan going on.
+	 */
+	if (ra->pattern != RA_PATTERN_NONE && offset && req_size <= max) {
+		nr = pattern_readahead(mapping, ra, filp,
+				       hit_readahead_marker, offset, req_size);
+		if (nr >= 0)
+			return nr;
+	}
 
 	/*
 	 * start of file
@@ -392,9 +642,11 @@ ondemand_readahead(struct address_space *mapping,
 	/*
 	 * It's the expected callback offset, assume sequential access.
 	 * Ramp up sizes, and push forward the readahead window.
+	 * The same goes for a stream we parked to serve another one.
 	 */
-	if ((offset == (ra->start + ra->size - ra->async_size) ||
-	     offset == (ra->start + ra->size))) {
+	if ((ra->pattern == RA_PATTERN_NONE &&
+	     ra_window_next(ra->start, ra->size, ra->async_size, offset)) ||
+	    ra_resume_stream(ra, offset)) {
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
@@ -417,6 +669,8 @@ ondemand_readahead(struct address_space *mapping,
 		if (!start || start - offset > max)
 			return 0;
 
+		ra_park_stream(ra);
+		ra->pattern = RA_PATTERN_NONE;
 		ra->start = start;
 		ra->size = start - offset;	/* old async_size */
 		ra->size += req_size;
@@ -454,6 +708,8 @@ ondemand_readahead(struct address_space *mapping,
 	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 
 initial_readahead:
+	ra_park_stream(ra);
+	ra->pattern = RA_PATTERN_NONE;
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
@@ -538,6 +794,16 @@ page_cache_async_readahead(struct address_space *mapping,
 
 	ClearPageReadahead(page);
 
+	/*
+	 * Readahead I/O still in flight means the reader is outrunning the
+	 * device at the current window size.
+	 */
+	if (!PageUptodate(page)) {
+		if (ra->late < RA_LATE_MAX)
+			ra->late++;
+	} else if (ra->late)
+		ra->late--;
+
 	/*
 	 * Defer asynchronous read-ahead on IO congestion.
 	 */
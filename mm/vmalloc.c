@@ -1575,6 +1575,27 @@ EXPORT_SYMBOL(vmap);
 static void *__vmalloc_node(unsigned long size, unsigned long align,
 			    gfp_t gfp_mask, pgprot_t prot,
 			    int node, const void *caller);
+/*
+ * Pages are allocated VMALLOC_BULK at a time with alloc_pages_bulk,
+ * which keeps interrupts disabled while it takes a batch off the pcp
+ * lists.
+ */
+#define VMALLOC_BULK	256U
+
+/*
+ * alloc_page() follows the task's mempolicy, which during boot is
+ * interleave so that large system hashes get spread over all nodes;
+ * alloc_pages_bulk only allocates from one node.
+ */
+static bool vmalloc_bulk_ok(int node)
+{
+#ifdef CONFIG_NUMA
+	if (node == NUMA_NO_NODE && current->mempolicy)
+		return false;
+#endif
+	return true;
+}
+
 static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
 				 pgprot_t prot, int node)
 {
@@ -1603,22 +1624,39 @@ static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
 		return NULL;
 	}
 
-	for (i = 0; i < area->nr_pages; i++) {
-		struct page *page;
+	if (vmalloc_bulk_ok(node)) {
+		for (i = 0; i < area->nr_pages; i += VMALLOC_BULK) {
+			unsigned int nr = min(area->nr_pages - i, VMALLOC_BULK);
+			unsigned long got;
+
+			got = alloc_pages_bulk_array_node(node, alloc_mask, nr,
+							  pages + i);
+			if (unlikely(got < nr)) {
+				/* Free the pages we got in __vunmap() */
+				area->nr_pages = i + got;
+				goto fail;
+			}
+			if (gfp_mask & __GFP_WAIT)
+				cond_resched();
+		}
+	} else {
+		for (i = 0; i < area->nr_pages; i++) {
+			struct page *page;
 
-		if (node == NUMA_NO_NODE)
-			page = alloc_page(alloc_mask);
-		else
-			page = alloc_pages_node(node, alloc_mask, order);
+			if (node == NUMA_NO_NODE)
+				page = alloc_page(alloc_mask);
+			else
+				page = alloc_pages_node(node, alloc_mask, order);
 
-		if (unlikely(!page)) {
-			/* Successfully allocated i pages, free them in __vunmap() */
-			area->nr_pages = i;
-			goto fail;
+			if (unlikely(!page)) {
+				/* Successfully allocated i pages, free them in __vunmap() */
+				area->nr_pages = i;
+				goto fail;
+			}
+			area->pages[i] = page;
+			if (gfp_mask & __GFP_WAIT)
+				cond_resched();
 		}
-		area->pages[i] = page;
-		if (gfp_mask & __GFP_WAIT)
-			cond_resched();
 	}
 
 	if (map_vm_area(area, prot, pages))
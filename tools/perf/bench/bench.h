@@ -28,6 +28,9 @@
 extern int bench_numa(int argc, const char **argv, const char *prefix);
 extern int bench_sched_messaging(int argc, const char **argv, const char *prefix);
 extern int bench_sched_pipe(int argc, const char **argv, const char *prefix);
+extern int bench_sched_deadline(int argc, const char **argv, const char *prefix);
+extern int bench_sched_rt_latency(int argc, const char **argv, const char *prefix);
+extern int bench_sched_cgroups(int argc, const char **argv, const char *prefix);
 extern int bench_mem_memcpy(int argc, const char **argv,
 			    const char *prefix __maybe_unused);
 extern int bench_mem_memset(int argc, const char **argv, const char *prefix);
@@ -0,0 +1,199 @@
+/*
+ * sched-cgroups: idle-entry cost with many (mostly idle) task groups
+ *
+ * Creates a large number of cpu cgroups and runs a task briefly in each
+ * one on the target CPU, so that every group leaves a cfs_rq with some
+ * blocked load behind on that CPU.  It then ping-pongs over a pipe
+ * between the target CPU and another CPU; every round trip makes the
+ * target CPU go idle, which runs idle_balance() and thus
+ * update_blocked_averages() over that CPU's leaf cfs_rq list.  The round
+ * trip time is reported per interval: once the groups' load has decayed
+ * it should drop back to what it is without the groups.
+ *
+ * Requires root and a mounted cgroup v1 cpu controller.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+static unsigned int nr_cgroups = 10000;
+static unsigned int nsecs      = 5;
+static unsigned int interval_ms = 500;
+static unsigned int target_cpu = 0;
+static const char *mnt = "/sys/fs/cgroup/cpu";
+static bool silent = false;
+
+static int ping[2], pong[2];
+static char base[PATH_MAX];
+
+static const struct option options[] = {
+	OPT_UINTEGER('c', "cgroups", &nr_cgroups,  "Number of cgroups to create"),
+	OPT_UINTEGER('r', "runtime", &nsecs,       "Specify benchmark runtime (in seconds)"),
+	OPT_UINTEGER('i', "interval", &interval_ms, "Reporting interval (in msecs)"),
+	OPT_UINTEGER('C', "cpu",     &target_cpu,  "CPU whose idle entry is measured"),
+	OPT_STRING(  'm', "mount",   &mnt, "path", "cpu cgroup mount point"),
+	OPT_BOOLEAN( 's', "silent",  &silent,      "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_sched_cgroups_usage[] = {
+	"perf bench sched cgroups <options>",
+	NULL
+};
+
+static void pin_to(unsigned int cpu)
+{
+	cpu_set_t mask;
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	if (sched_setaffinity(0, sizeof(mask), &mask))
+		err(EXIT_FAILURE, "sched_setaffinity(%u)", cpu);
+}
+
+/* Move the calling thread into the cgroup at @dir. */
+static int join_cgroup(const char *dir)
+{
+	char path[PATH_MAX];
+	int fd, ret = 0;
+
+	snprintf(path, sizeof(path), "%s/tasks", dir);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	if (write(fd, "0", 1) != 1)
+		ret = -1;
+	close(fd);
+	return ret;
+}
+
+static void cgroups_destroy(unsigned int nr)
+{
+	char path[PATH_MAX];
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		snprintf(path, sizeof(path), "%s/g%u", base, i);
+		rmdir(path);
+	}
+	rmdir(base);
+}
+
+static unsigned int cgroups_populate(void)
+{
+	char path[PATH_MAX];
+	unsigned int i;
+
+	snprintf(base, sizeof(base), "%s/perf-bench-sched-%d", mnt, getpid());
+	if (mkdir(base, 0755))
+		err(EXIT_FAILURE, "mkdir(%s)", base);
+
+	for (i = 0; i < nr_cgroups; i++) {
+		snprintf(path, sizeof(path), "%s/g%u", base, i);
+		if (mkdir(path, 0755) || join_cgroup(path)) {
+			warn("%s", path);
+			rmdir(path);
+			break;
+		}
+		/* get enqueued on this group's cfs_rq for a moment */
+		sched_yield();
+	}
+
+	if (join_cgroup(mnt))
+		err(EXIT_FAILURE, "%s/tasks", mnt);
+	return i;
+}
+
+static void *ponger(void *arg __maybe_unused)
+{
+	char c;
+
+	pin_to((target_cpu + 1) % sysconf(_SC_NPROCESSORS_ONLN));
+	while (read(ping[0], &c, 1) == 1) {
+		if (write(pong[1], &c, 1) != 1)
+			break;
+	}
+	return NULL;
+}
+
+static u64 now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+int bench_sched_cgroups(int argc, const char **argv,
+			const char *prefix __maybe_unused)
+{
+	unsigned int created;
+	pthread_t thread;
+	u64 start, t0, t, loops, total = 0;
+	char c = 0;
+
+	argc = parse_options(argc, argv, options, bench_sched_cgroups_usage, 0);
+	if (argc) {
+		usage_with_options(bench_sched_cgroups_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (sysconf(_SC_NPROCESSORS_ONLN) < 2 || !interval_ms) {
+		fprintf(stderr, "need at least 2 CPUs and a non-zero interval\n");
+		exit(EXIT_FAILURE);
+	}
+
+	pin_to(target_cpu);
+	t0 = now_us();
+	created = cgroups_populate();
+	t = now_us();
+
+	printf("Run summary [PID %d]: %u cgroups populated on CPU %u in %" PRIu64 " ms, pipe round trips for %d secs.\n\n",
+	       getpid(), created, target_cpu, (t - t0) / 1000, nsecs);
+
+	if (pipe(ping) || pipe(pong))
+		err(EXIT_FAILURE, "pipe");
+	if (pthread_create(&thread, NULL, ponger, NULL))
+		err(EXIT_FAILURE, "pthread_create");
+
+	start = t0 = now_us();
+	loops = 0;
+	for (;;) {
+		if (write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1)
+			err(EXIT_FAILURE, "pipe");
+		loops++;
+
+		t = now_us();
+		if (t - t0 < interval_ms * 1000ULL)
+			continue;
+
+		if (!silent)
+			printf("[%6.2f s] %10.3f usecs/round trip\n",
+			       (t - start) / 1e6, (double)(t - t0) / loops);
+		total += loops;
+		loops = 0;
+		t0 = t;
+		if (t - start >= nsecs * 1000000ULL)
+			break;
+	}
+
+	close(ping[1]);
+	pthread_join(thread, NULL);
+	cgroups_destroy(created);
+
+	printf("%sTotal %" PRIu64 " round trips, %.3f usecs/round trip\n",
+	       !silent ? "\n" : "", total,
+	       total ? (double)(t - start) / total : 0.0);
+	return 0;
+}
@@ -0,0 +1,240 @@
+/*
+ * sched-deadline: stress SCHED_DEADLINE enqueue/dequeue
+ *
+ * Runs many short periodic SCHED_DEADLINE threads.  Each job burns a bit
+ * of CPU and then yields the rest of its runtime, so every period costs a
+ * dequeue, a replenishment and an enqueue, all of which update the root
+ * domain's cpudl state and trigger push/pull decisions.  The job rate is
+ * a measure of how well that path scales with the number of CPUs.
+ *
+ * Requires CAP_SYS_NICE; the total bandwidth requested must fit within
+ * the admission control limit (sched_rt_runtime_us/sched_rt_period_us).
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <err.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE		6
+#endif
+
+struct dl_sched_attr {
+	u32 size;
+	u32 sched_policy;
+	u64 sched_flags;
+	s32 sched_nice;
+	u32 sched_priority;
+	u64 sched_runtime;
+	u64 sched_deadline;
+	u64 sched_period;
+};
+
+static unsigned int nthreads = 0;
+static unsigned int nsecs    = 10;
+static unsigned int runtime_us = 20;
+static unsigned int period_us  = 500;
+static unsigned int work_us    = 5;
+static bool done = false, silent = false;
+
+static struct timeval start, end, runtime;
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static struct stats throughput_stats;
+static pthread_cond_t thread_parent, thread_worker;
+
+struct worker {
+	int tid;
+	pthread_t thread;
+	unsigned long jobs;
+	int err;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,   "Specify amount of threads (default: 4 per CPU)"),
+	OPT_UINTEGER('r', "runtime", &nsecs,      "Specify benchmark runtime (in seconds)"),
+	OPT_UINTEGER('R', "dl-runtime", &runtime_us, "SCHED_DEADLINE runtime per period (in usecs)"),
+	OPT_UINTEGER('P', "dl-period", &period_us, "SCHED_DEADLINE period and deadline (in usecs)"),
+	OPT_UINTEGER('w', "work", &work_us,       "CPU time burnt per job (in usecs)"),
+	OPT_BOOLEAN( 's', "silent",  &silent,     "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_sched_deadline_usage[] = {
+	"perf bench sched deadline <options>",
+	NULL
+};
+
+static int sched_setattr_dl(void)
+{
+	struct dl_sched_attr attr = {
+		.size		= sizeof(attr),
+		.sched_policy	= SCHED_DEADLINE,
+		.sched_runtime	= runtime_us * 1000ULL,
+		.sched_deadline	= period_us * 1000ULL,
+		.sched_period	= period_us * 1000ULL,
+	};
+
+#ifdef __NR_sched_setattr
+	return syscall(__NR_sched_setattr, 0, &attr, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static void burn(unsigned int usecs)
+{
+	struct timeval now, stop, delta = { 0, usecs };
+
+	gettimeofday(&now, NULL);
+	timeradd(&now, &delta, &stop);
+	while (timercmp(&now, &stop, <))
+		gettimeofday(&now, NULL);
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+
+	if (sched_setattr_dl())
+		w->err = errno;
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	if (w->err)
+		return NULL;
+
+	do {
+		burn(work_us);
+		/* give back the rest of this period's runtime */
+		sched_yield();
+		w->jobs++;
+	} while (!done);
+
+	return NULL;
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+}
+
+int bench_sched_deadline(int argc, const char **argv,
+			 const char *prefix __maybe_unused)
+{
+	int ret = 0;
+	struct sigaction act;
+	unsigned int i, ncpus;
+	unsigned long total = 0;
+	struct worker *worker = NULL;
+
+	argc = parse_options(argc, argv, options, bench_sched_deadline_usage, 0);
+	if (argc) {
+		usage_with_options(bench_sched_deadline_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!period_us || runtime_us > period_us || work_us > runtime_us) {
+		fprintf(stderr, "need work <= dl-runtime <= dl-period\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads)
+		nthreads = 4 * ncpus;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		err(EXIT_FAILURE, "calloc");
+
+	printf("Run summary [PID %d]: %d SCHED_DEADLINE threads (%u/%u us), %u us work per job, for %d secs.\n\n",
+	       getpid(), nthreads, runtime_us, period_us, work_us, nsecs);
+
+	init_stats(&throughput_stats);
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+		ret = pthread_create(&worker[i].thread, NULL, workerfn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	gettimeofday(&start, NULL);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t = worker[i].jobs / runtime.tv_sec;
+
+		if (worker[i].err) {
+			errno = worker[i].err;
+			warn("[thread %2d] sched_setattr(SCHED_DEADLINE)", i);
+			ret = -1;
+			continue;
+		}
+
+		update_stats(&throughput_stats, t);
+		total += worker[i].jobs;
+		if (!silent)
+			printf("[thread %2d] %ld jobs/sec\n", worker[i].tid, t);
+	}
+
+	if (!ret) {
+		unsigned long avg = avg_stats(&throughput_stats);
+		double stddev = stddev_stats(&throughput_stats);
+
+		printf("%sAveraged %ld jobs/sec per thread (+- %.2f%%), %lu jobs/sec total, total secs = %d\n",
+		       !silent ? "\n" : "", avg, rel_stddev_stats(stddev, avg),
+		       total / runtime.tv_sec, (int) runtime.tv_sec);
+	}
+
+	free(worker);
+	return ret;
+}
@@ -0,0 +1,196 @@
+/*
+ * sched-rt-latency: cyclictest-style RT wakeup latency
+ *
+ * Each thread runs SCHED_FIFO, sleeps until an absolute periodic
+ * deadline and measures how late it got to run.  Threads are not pinned,
+ * so every wakeup goes through the RT select/push path (cpupri_find and
+ * find_lowest_rq); with more threads than CPUs, or staggered priorities,
+ * the latency tail shows how quickly a suitable CPU is found.
+ *
+ * Requires CAP_SYS_NICE.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <err.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+
+/* latency histogram resolution is 1us, anything above goes into the last bucket */
+#define HIST_BUCKETS	1000
+
+static unsigned int nthreads = 0;
+static unsigned int nsecs    = 10;
+static unsigned int interval_us = 1000;
+static unsigned int base_prio = 80;
+static unsigned int nr_prios = 1;
+static bool done = false, silent = false;
+
+struct worker {
+	int tid;
+	pthread_t thread;
+	int err;
+	u64 nr;
+	u64 sum;
+	u64 max;
+	u64 hist[HIST_BUCKETS + 1];
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,   "Specify amount of threads (default: one per CPU)"),
+	OPT_UINTEGER('r', "runtime", &nsecs,      "Specify benchmark runtime (in seconds)"),
+	OPT_UINTEGER('i', "interval", &interval_us, "Wakeup interval (in usecs)"),
+	OPT_UINTEGER('p', "prio", &base_prio,     "Highest SCHED_FIFO priority"),
+	OPT_UINTEGER('n', "nr-prios", &nr_prios,  "Spread threads over this many priorities below --prio"),
+	OPT_BOOLEAN( 's', "silent",  &silent,     "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_sched_rt_latency_usage[] = {
+	"perf bench sched rt-latency <options>",
+	NULL
+};
+
+static u64 ts_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	struct sched_param param = {
+		.sched_priority = base_prio - (w->tid % nr_prios),
+	};
+	struct timespec next, now;
+	u64 lat;
+
+	if (sched_setscheduler(0, SCHED_FIFO, &param)) {
+		w->err = errno;
+		return NULL;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (!done) {
+		next.tv_nsec += interval_us * 1000;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+
+		if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL))
+			continue;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		lat = ts_ns(&now) - ts_ns(&next);
+		w->nr++;
+		w->sum += lat;
+		if (lat > w->max)
+			w->max = lat;
+		w->hist[min(lat / 1000, (u64)HIST_BUCKETS)]++;
+	}
+
+	return NULL;
+}
+
+/* @permille: 990 for p99, 999 for p99.9 */
+static u64 percentile_us(u64 *hist, u64 nr, unsigned int permille)
+{
+	u64 target = (nr * permille + 999) / 1000, seen = 0;
+	unsigned int i;
+
+	for (i = 0; i <= HIST_BUCKETS; i++) {
+		seen += hist[i];
+		if (seen >= target)
+			return i;
+	}
+	return HIST_BUCKETS;
+}
+
+int bench_sched_rt_latency(int argc, const char **argv,
+			   const char *prefix __maybe_unused)
+{
+	int ret = 0;
+	unsigned int i, j;
+	struct worker *worker;
+	u64 nr = 0, sum = 0, max = 0;
+	u64 *hist;
+
+	argc = parse_options(argc, argv, options, bench_sched_rt_latency_usage, 0);
+	if (argc) {
+		usage_with_options(bench_sched_rt_latency_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!interval_us || !nr_prios || nr_prios > base_prio) {
+		fprintf(stderr, "need a non-zero interval and 1 <= nr-prios <= prio\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	worker = calloc(nthreads, sizeof(*worker));
+	hist = calloc(HIST_BUCKETS + 1, sizeof(*hist));
+	if (!worker || !hist)
+		err(EXIT_FAILURE, "calloc");
+
+	printf("Run summary [PID %d]: %d SCHED_FIFO threads (prio %u..%u), %u us interval, for %d secs.\n\n",
+	       getpid(), nthreads, base_prio - nr_prios + 1, base_prio,
+	       interval_us, nsecs);
+
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+		ret = pthread_create(&worker[i].thread, NULL, workerfn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	sleep(nsecs);
+	done = true;
+
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		struct worker *w = &worker[i];
+
+		if (w->err) {
+			errno = w->err;
+			warn("[thread %2d] sched_setscheduler(SCHED_FIFO)", i);
+			ret = -1;
+			continue;
+		}
+
+		nr += w->nr;
+		sum += w->sum;
+		if (w->max > max)
+			max = w->max;
+		for (j = 0; j <= HIST_BUCKETS; j++)
+			hist[j] += w->hist[j];
+
+		if (!silent && w->nr)
+			printf("[thread %2d] wakeups: %8" PRIu64 "  avg: %6" PRIu64 " us  max: %6" PRIu64 " us\n",
+			       w->tid, w->nr, w->sum / w->nr / 1000, w->max / 1000);
+	}
+
+	if (nr)
+		printf("%sTotal %" PRIu64 " wakeups, latency avg %" PRIu64 " us, p99 %" PRIu64 " us, p99.9 %" PRIu64 " us, max %" PRIu64 " us\n",
+		       !silent ? "\n" : "", nr, sum / nr / 1000,
+		       percentile_us(hist, nr, 990),
+		       percentile_us(hist, nr, 999), max / 1000);
+
+	free(hist);
+	free(worker);
+	return ret;
+}
@@ -44,6 +44,9 @@ static struct bench numa_benchmarks[] = {
 static struct bench sched_benchmarks[] = {
 	{ "messaging",	"Benchmark for scheduling and IPC",		bench_sched_messaging	},
 	{ "pipe",	"Benchmark for pipe() between two processes",	bench_sched_pipe	},
+	{ "deadline",	"Benchmark for SCHED_DEADLINE enqueue/dequeue",	bench_sched_deadline	},
+	{ "rt-latency",	"Benchmark for RT wakeup latency (cyclictest-style)", bench_sched_rt_latency },
+	{ "cgroups",	"Benchmark for idle entry cost with many cgroups", bench_sched_cgroups	},
 	{ "all",	"Test all scheduler benchmarks",		NULL			},
 	{ NULL,		NULL,						NULL			}
 };
@@ -5,6 +5,7 @@
 #include "util/evsel.h"
 #include "util/util.h"
 #include "util/cache.h"
+#include "util/callchain.h"
 #include "util/symbol.h"
 #include "util/thread.h"
 #include "util/header.h"
@@ -102,6 +103,7 @@ struct lock_seq_stat {
 	int			state;
 	u64			prev_event_time;
 	void                    *addr;
+	void			*caller;	/* contention: waiter call site */
 
 	int                     read_count;
 };
@@ -354,6 +356,12 @@ struct trace_lock_handler {
 
 	int (*release_event)(struct perf_evsel *evsel,
 			     struct perf_sample *sample);
+
+	int (*contention_begin_event)(struct perf_evsel *evsel,
+				      struct perf_sample *sample);
+
+	int (*contention_end_event)(struct perf_evsel *evsel,
+				    struct perf_sample *sample);
 };
 
 static struct lock_seq_stat *get_seq(struct thread_stat *ts, void *addr)
@@ -650,6 +658,170 @@ static struct trace_lock_handler report_lock_ops  = {
 	.release_event		= report_lock_release_event,
 };
 
+/*
+ * Contention events: lock:contention_begin/end are emitted from the lock
+ * slowpaths and do not need lockdep.  There is no lock class name, so
+ * contention is aggregated per waiter call site, i.e. the first function
+ * in the callchain which is not part of the locking code itself.
+ */
+#define LCB_F_SPIN	(1U << 0)
+#define LCB_F_READ	(1U << 1)
+#define LCB_F_WRITE	(1U << 2)
+#define LCB_F_MUTEX	(1U << 3)
+
+static const char *lock_func_prefixes[] = {
+	"_raw_", "__raw_", "queued_spin_lock", "native_queued_spin_lock",
+	"__pv_queued_spin_lock", "mutex_lock", "__mutex_lock", "mutex_trylock",
+	"down_read", "down_write", "rwsem_down_", "call_rwsem_",
+	"__down_read", "__down_write", "__lock_text_start",
+};
+
+static bool is_lock_function(struct symbol *sym)
+{
+	unsigned int i;
+
+	if (!sym)
+		return false;
+
+	for (i = 0; i < ARRAY_SIZE(lock_func_prefixes); i++) {
+		if (!strncmp(sym->name, lock_func_prefixes[i],
+			     strlen(lock_func_prefixes[i])))
+			return true;
+	}
+	return false;
+}
+
+static const char *lock_type_name(unsigned int flags)
+{
+	if (flags & LCB_F_SPIN)
+		return flags & LCB_F_MUTEX ? "mutex:spin" : "spinlock";
+	if (flags & LCB_F_MUTEX)
+		return "mutex";
+	if (flags & LCB_F_READ)
+		return "rwsem:R";
+	if (flags & LCB_F_WRITE)
+		return "rwsem:W";
+	return "unknown";
+}
+
+static struct lock_stat *contention_caller(struct perf_evsel *evsel,
+					   struct perf_sample *sample,
+					   unsigned int flags)
+{
+	struct machine *machine = &session->machines.host;
+	struct callchain_cursor_node *node;
+	struct addr_location al;
+	const char *name = "unknown";
+	char buf[128];
+	u64 caller = sample->ip;
+
+	al.thread = machine__findnew_thread(machine, sample->pid, sample->tid);
+	if (al.thread &&
+	    !sample__resolve_callchain(sample, NULL, evsel, &al, 16)) {
+		callchain_cursor_commit(&callchain_cursor);
+		while ((node = callchain_cursor_current(&callchain_cursor))) {
+			if (!is_lock_function(node->sym)) {
+				caller = node->ip;
+				if (node->sym)
+					name = node->sym->name;
+				break;
+			}
+			callchain_cursor_advance(&callchain_cursor);
+		}
+	}
+	thread__put(al.thread);
+
+	scnprintf(buf, sizeof(buf), "%s (%s)", name, lock_type_name(flags));
+	/* the same call site may contend on different lock types */
+	return lock_stat_findnew((void *)(unsigned long)(caller ^ flags), buf);
+}
+
+static int report_contention_begin_event(struct perf_evsel *evsel,
+					 struct perf_sample *sample)
+{
+	struct thread_stat *ts;
+	struct lock_seq_stat *seq;
+	struct lock_stat *ls;
+	u64 tmp = perf_evsel__intval(evsel, sample, "lock_addr");
+	unsigned int flags = perf_evsel__intval(evsel, sample, "flags");
+	void *addr;
+
+	memcpy(&addr, &tmp, sizeof(void *));
+
+	ts = thread_stat_findnew(sample->tid);
+	if (!ts)
+		return -ENOMEM;
+
+	seq = get_seq(ts, addr);
+	if (!seq)
+		return -ENOMEM;
+
+	/* the end event of the previous begin was lost, start over */
+	if (seq->state == SEQ_STATE_CONTENDED)
+		bad_hist[BROKEN_CONTENDED]++;
+
+	ls = contention_caller(evsel, sample, flags);
+	if (!ls)
+		return -ENOMEM;
+
+	seq->state = SEQ_STATE_CONTENDED;
+	seq->prev_event_time = sample->time;
+	seq->caller = ls->addr;
+	ls->nr_acquire++;
+	return 0;
+}
+
+static int report_contention_end_event(struct perf_evsel *evsel,
+				       struct perf_sample *sample)
+{
+	struct thread_stat *ts;
+	struct lock_seq_stat *seq;
+	struct lock_stat *ls;
+	u64 tmp = perf_evsel__intval(evsel, sample, "lock_addr");
+	void *addr;
+	u64 wait;
+
+	memcpy(&addr, &tmp, sizeof(void *));
+
+	ts = thread_stat_findnew(sample->tid);
+	if (!ts)
+		return -ENOMEM;
+
+	seq = get_seq(ts, addr);
+	if (!seq)
+		return -ENOMEM;
+
+	if (seq->state != SEQ_STATE_CONTENDED) {
+		/* the begin event was lost or predates the recording */
+		bad_hist[BROKEN_CONTENDED]++;
+		goto free_seq;
+	}
+
+	ls = lock_stat_findnew(seq->caller, "");
+	if (!ls)
+		return -ENOMEM;
+
+	wait = sample->time - seq->prev_event_time;
+	ls->nr_contended++;
+	ls->nr_acquired++;
+	ls->wait_time_total += wait;
+	if (ls->wait_time_max < wait)
+		ls->wait_time_max = wait;
+	if (ls->wait_time_min > wait)
+		ls->wait_time_min = wait;
+	ls->avg_wait_time = ls->wait_time_total / ls->nr_contended;
+
+free_seq:
+	list_del(&seq->list);
+	free(seq);
+	return 0;
+}
+
+static struct trace_lock_handler contention_lock_ops  = {
+	.contention_begin_event	= report_contention_begin_event,
+	.contention_end_event	= report_contention_end_event,
+};
+
 static struct trace_lock_handler *trace_handler;
 
 static int perf_evsel__process_lock_acquire(struct perf_evsel *evsel,
@@ -684,6 +856,22 @@ static int perf_evsel__process_lock_release(struct perf_evsel *evsel,
 	return 0;
 }
 
+static int perf_evsel__process_contention_begin(struct perf_evsel *evsel,
+						 struct perf_sample *sample)
+{
+	if (trace_handler->contention_begin_event)
+		return trace_handler->contention_begin_event(evsel, sample);
+	return 0;
+}
+
+static int perf_evsel__process_contention_end(struct perf_evsel *evsel,
+					       struct perf_sample *sample)
+{
+	if (trace_handler->contention_end_event)
+		return trace_handler->contention_end_event(evsel, sample);
+	return 0;
+}
+
 static void print_bad_events(int bad, int total)
 {
 	/* Output for debug, this have to be removed */
@@ -753,6 +941,32 @@ static void print_result(void)
 	print_bad_events(bad, total);
 }
 
+static void print_contention_result(void)
+{
+	struct lock_stat *st;
+
+	pr_info("%10s %15s %15s %15s %15s  %s\n\n", "contended",
+		"total wait (ns)", "max wait (ns)", "avg wait (ns)",
+		"min wait (ns)", "caller (type)");
+
+	while ((st = pop_from_result())) {
+		if (!st->nr_contended)
+			continue;
+
+		pr_info("%10u ", st->nr_contended);
+		pr_info("%15" PRIu64 " ", st->wait_time_total);
+		pr_info("%15" PRIu64 " ", st->wait_time_max);
+		pr_info("%15" PRIu64 " ", st->avg_wait_time);
+		pr_info("%15" PRIu64 "  ", st->wait_time_min == ULLONG_MAX ?
+			0 : st->wait_time_min);
+		pr_info("%s\n", st->name);
+	}
+
+	if (bad_hist[BROKEN_CONTENDED])
+		pr_debug("%d unmatched contention_begin/end events\n",
+			 bad_hist[BROKEN_CONTENDED]);
+}
+
 static bool info_threads, info_map;
 
 static void dump_threads(void)
@@ -850,7 +1064,13 @@ static const struct perf_evsel_str_handler lock_tracepoints[] = {
 	{ "lock:lock_release",	 perf_evsel__process_lock_release,   }, /* CONFIG_LOCKDEP */
 };
 
+static const struct perf_evsel_str_handler contention_tracepoints[] = {
+	{ "lock:contention_begin", perf_evsel__process_contention_begin, },
+	{ "lock:contention_end",   perf_evsel__process_contention_end,   },
+};
+
 static bool force;
+static bool show_contention;
 
 static int __cmd_report(bool display_info)
 {
@@ -877,7 +1097,8 @@ static int __cmd_report(bool display_info)
 	if (!perf_session__has_traces(session, "lock record"))
 		goto out_delete;
 
-	if (perf_session__set_tracepoints_handlers(session, lock_tracepoints)) {
+	if (perf_session__set_tracepoints_handlers(session, lock_tracepoints) ||
+	    perf_session__set_tracepoints_handlers(session, contention_tracepoints)) {
 		pr_err("Initializing perf session tracepoint handlers failed\n");
 		goto out_delete;
 	}
@@ -892,7 +1113,10 @@ static int __cmd_report(bool display_info)
 	setup_pager();
 	if (display_info) /* used for info subcommand */
 		err = dump_info();
-	else {
+	else if (show_contention) {
+		sort_result();
+		print_contention_result();
+	} else {
 		sort_result();
 		print_result();
 	}
@@ -907,21 +1131,43 @@ static int __cmd_record(int argc, const char **argv)
 	const char *record_args[] = {
 		"record", "-R", "-m", "1024", "-c", "1",
 	};
+	const char *callchain_args[] = {
+		"-g",
+	};
+	const struct perf_evsel_str_handler *tracepoints = lock_tracepoints;
+	unsigned int nr_tracepoints = ARRAY_SIZE(lock_tracepoints);
+	unsigned int nr_callchain_args = 0;
 	unsigned int rec_argc, i, j, ret;
 	const char **rec_argv;
 
 	for (i = 0; i < ARRAY_SIZE(lock_tracepoints); i++) {
-		if (!is_valid_tracepoint(lock_tracepoints[i].name)) {
-				pr_err("tracepoint %s is not enabled. "
+		if (!is_valid_tracepoint(lock_tracepoints[i].name))
+			break;
+	}
+
+	/*
+	 * Without lockdep, fall back to the contention tracepoints and
+	 * record callchains so that 'perf lock contention' can attribute
+	 * the waits to their call sites.
+	 */
+	if (i < ARRAY_SIZE(lock_tracepoints)) {
+		for (j = 0; j < ARRAY_SIZE(contention_tracepoints); j++) {
+			if (!is_valid_tracepoint(contention_tracepoints[j].name)) {
+				pr_err("tracepoints %s and %s are not enabled. "
 				       "Are CONFIG_LOCKDEP and CONFIG_LOCK_STAT enabled?\n",
-				       lock_tracepoints[i].name);
+				       lock_tracepoints[i].name,
+				       contention_tracepoints[j].name);
 				return 1;
+			}
 		}
+		tracepoints = contention_tracepoints;
+		nr_tracepoints = ARRAY_SIZE(contention_tracepoints);
+		nr_callchain_args = ARRAY_SIZE(callchain_args);
 	}
 
-	rec_argc = ARRAY_SIZE(record_args) + argc - 1;
+	rec_argc = ARRAY_SIZE(record_args) + nr_callchain_args + argc - 1;
 	/* factor of 2 is for -e in front of each tracepoint */
-	rec_argc += 2 * ARRAY_SIZE(lock_tracepoints);
+	rec_argc += 2 * nr_tracepoints;
 
 	rec_argv = calloc(rec_argc + 1, sizeof(char *));
 	if (!rec_argv)
@@ -930,9 +1176,12 @@ static int __cmd_record(int argc, const char **argv)
 	for (i = 0; i < ARRAY_SIZE(record_args); i++)
 		rec_argv[i] = strdup(record_args[i]);
 
-	for (j = 0; j < ARRAY_SIZE(lock_tracepoints); j++) {
+	for (j = 0; j < nr_callchain_args; j++)
+		rec_argv[i++] = strdup(callchain_args[j]);
+
+	for (j = 0; j < nr_tracepoints; j++) {
 		rec_argv[i++] = "-e";
-		rec_argv[i++] = strdup(lock_tracepoints[j].name);
+		rec_argv[i++] = strdup(tracepoints[j].name);
 	}
 
 	for (j = 1; j < (unsigned int)argc; j++, i++)
@@ -972,8 +1221,14 @@ int cmd_lock(int argc, const char **argv, const char *prefix __maybe_unused)
 		"perf lock info [<options>]",
 		NULL
 	};
+	const struct option contention_options[] = {
+	OPT_STRING('k', "key", &sort_key, "wait_total",
+		    "key for sorting (contended / avg_wait / wait_total / wait_max / wait_min)"),
+	OPT_BOOLEAN('f', "force", &force, "don't complain, do it"),
+	OPT_END()
+	};
 	const char *const lock_subcommands[] = { "record", "report", "script",
-						 "info", NULL };
+						 "info", "contention", NULL };
 	const char *lock_usage[] = {
 		NULL,
 		NULL
@@ -982,6 +1237,10 @@ int cmd_lock(int argc, const char **argv, const char *prefix __maybe_unused)
 		"perf lock report [<options>]",
 		NULL
 	};
+	const char * const contention_usage[] = {
+		"perf lock contention [<options>]",
+		NULL
+	};
 	unsigned int i;
 	int rc = 0;
 
@@ -1004,6 +1263,19 @@ int cmd_lock(int argc, const char **argv, const char *prefix __maybe_unused)
 				usage_with_options(report_usage, report_options);
 		}
 		rc = __cmd_report(false);
+	} else if (!strncmp(argv[0], "contention", 3)) {
+		trace_handler = &contention_lock_ops;
+		show_contention = true;
+		sort_key = "wait_total";
+		if (argc) {
+			argc = parse_options(argc, argv, contention_options,
+					     contention_usage, 0);
+			if (argc)
+				usage_with_options(contention_usage,
+						   contention_options);
+		}
+		symbol_conf.use_callchain = true;
+		rc = __cmd_report(false);
 	} else if (!strcmp(argv[0], "script")) {
 		/* Aliased to 'perf script' */
 		return cmd_script(argc, argv, prefix);
@@ -0,0 +1,105 @@
+/*
+ * Synchronous O_DIRECT read latency, optionally as high priority I/O.
+ *
+ * Issues 4k (or [block] byte) random reads to a block device one at a time
+ * for [seconds] and reports IOPS and the latency distribution.  With
+ * [hipri] set, the task puts itself in the realtime I/O class first, which
+ * makes the kernel poll for completions on queues with io_poll enabled.
+ *
+ * Usage: io-poll-latency <device> [seconds] [hipri] [block]
+ *
+ * This is free and unencumbered software released into the public domain.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <err.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+
+#define IOPRIO_CLASS_RT		1
+#define IOPRIO_CLASS_SHIFT	13
+#define IOPRIO_WHO_PROCESS	1
+#define MAX_SAMPLES		(1 << 22)
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+	size_t secs = 5, hipri = 1, bs = 4096, n = 0, total = 0;
+	uint64_t size, blocks;
+	double *lat, start, end, t, sum = 0;
+	void *buf;
+	int fd;
+
+	if (argc > 2)
+		secs = strtoul(argv[2], NULL, 0);
+	if (argc > 3)
+		hipri = strtoul(argv[3], NULL, 0);
+	if (argc > 4)
+		bs = strtoul(argv[4], NULL, 0);
+	if (argc < 2 || !secs || !bs || bs % 512)
+		errx(1, "usage: %s <device> [seconds] [hipri] [block]",
+		     argv[0]);
+
+	if (hipri && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+			     IOPRIO_CLASS_RT << IOPRIO_CLASS_SHIFT))
+		err(2, "ioprio_set");
+
+	fd = open(argv[1], O_RDONLY | O_DIRECT);
+	if (fd < 0)
+		err(2, "%s", argv[1]);
+	if (ioctl(fd, BLKGETSIZE64, &size))
+		err(2, "BLKGETSIZE64");
+	blocks = size / bs;
+	if (!blocks)
+		errx(1, "%s: too small", argv[1]);
+
+	if (posix_memalign(&buf, 4096, bs))
+		errx(2, "posix_memalign");
+	lat = calloc(MAX_SAMPLES, sizeof(*lat));
+	if (!lat)
+		err(2, "calloc");
+
+	srandom(1);
+	start = now();
+	end = start + secs;
+	do {
+		off_t off = (random() % blocks) * bs;
+
+		t = now();
+		if (pread(fd, buf, bs, off) != bs)
+			err(2, "pread");
+		t = (now() - t) * 1e6;
+		sum += t;
+		if (n < MAX_SAMPLES)
+			lat[n++] = t;
+		total++;
+	} while (now() < end);
+	end = now();
+
+	qsort(lat, n, sizeof(*lat), cmp_double);
+	printf("%s: %s, %.0f IOPS, latency usecs: avg %.1f p50 %.1f p99 %.1f max %.1f\n",
+	       argv[1], hipri ? "hipri" : "normal", total / (end - start),
+	       sum / total, lat[n / 2], lat[n * 99 / 100], lat[n - 1]);
+	return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * Synchronous read latency with a write load on the same device.
+ *
+ * Starts [writers] processes that each keep writing [write KiB] blocks at
+ * random offsets with O_DIRECT, and meanwhile issues 4k O_DIRECT random
+ * reads one at a time.  Reports the read latency distribution and the
+ * write throughput.  Compare the I/O schedulers in queue/scheduler: with
+ * enough writers to fill the device queue, reads on a queue without a
+ * scheduler wait for the writes ahead of them.
+ *
+ * With [buffered] set, the writers go through the page cache instead, and
+ * the device sees the writes as background writeback.  That is the load
+ * that queue/wbt_lat_usec throttles; written MB/s then counts the bytes
+ * dirtied rather than the bytes that reached the device.
+ *
+ * The device gets overwritten.
+ *
+ * Usage: rw-mix-latency <device> [seconds] [writers] [write KiB] [buffered]
+ *
+ * This is free and unencumbered software released into the public domain.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <err.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <linux/fs.h>
+
+#define READ_SIZE	4096
+#define MAX_SAMPLES	(1 << 22)
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void writer(const char *dev, uint64_t size, size_t bs, int buffered,
+		   double end, int seed, int fd)
+{
+	uint64_t blocks = size / bs, bytes = 0;
+	void *buf;
+	int dfd;
+
+	dfd = open(dev, buffered ? O_WRONLY : O_WRONLY | O_DIRECT);
+	if (dfd < 0)
+		err(2, "%s", dev);
+	if (posix_memalign(&buf, 4096, bs))
+		errx(2, "posix_memalign");
+
+	srandom(seed);
+	while (now() < end) {
+		if (pwrite(dfd, buf, bs, (random() % blocks) * bs) != bs)
+			err(2, "pwrite");
+		bytes += bs;
+	}
+	if (write(fd, &bytes, sizeof(bytes)) != sizeof(bytes))
+		err(2, "write");
+	exit(0);
+}
+
+int main(int argc, char **argv)
+{
+	size_t secs = 10, writers = 128, wbs = 64, buffered = 0;
+	size_t n = 0, total = 0, i;
+	uint64_t size, blocks, bytes, written = 0;
+	double *lat, start, end, t, sum = 0;
+	int fd, pipefd[2];
+	void *buf;
+
+	if (argc > 2)
+		secs = strtoul(argv[2], NULL, 0);
+	if (argc > 3)
+		writers = strtoul(argv[3], NULL, 0);
+	if (argc > 4)
+		wbs = strtoul(argv[4], NULL, 0);
+	if (argc > 5)
+		buffered = strtoul(argv[5], NULL, 0);
+	if (argc < 2 || !secs || !wbs)
+		errx(1, "usage: %s <device> [seconds] [writers] [write KiB] [buffered]",
+		     argv[0]);
+	wbs <<= 10;
+
+	fd = open(argv[1], O_RDONLY | O_DIRECT);
+	if (fd < 0)
+		err(2, "%s", argv[1]);
+	if (ioctl(fd, BLKGETSIZE64, &size))
+		err(2, "BLKGETSIZE64");
+	blocks = size / READ_SIZE;
+	if (size < wbs)
+		errx(1, "%s: too small", argv[1]);
+
+	if (posix_memalign(&buf, 4096, READ_SIZE))
+		errx(2, "posix_memalign");
+	lat = calloc(MAX_SAMPLES, sizeof(*lat));
+	if (!lat)
+		err(2, "calloc");
+	if (pipe(pipefd))
+		err(2, "pipe");
+
+	start = now();
+	end = start + secs;
+	for (i = 0; i < writers; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			err(2, "fork");
+		if (!pid)
+			writer(argv[1], size, wbs, buffered, end, i + 2,
+			       pipefd[1]);
+	}
+
+	srandom(1);
+	do {
+		off_t off = (random() % blocks) * READ_SIZE;
+
+		t = now();
+		if (pread(fd, buf, READ_SIZE, off) != READ_SIZE)
+			err(2, "pread");
+		t = (now() - t) * 1e6;
+		sum += t;
+		if (n < MAX_SAMPLES)
+			lat[n++] = t;
+		total++;
+	} while (now() < end);
+
+	for (i = 0; i < writers; i++) {
+		if (read(pipefd[0], &bytes, sizeof(bytes)) != sizeof(bytes))
+			err(2, "read");
+		written += bytes;
+	}
+	while (wait(NULL) > 0)
+		;
+	end = now();
+
+	qsort(lat, n, sizeof(*lat), cmp_double);
+	printf("%s: %zu %s writers, %.1f MB/s written, %zu reads, read latency usecs: avg %.1f p50 %.1f p99 %.1f max %.1f\n",
+	       argv[1], writers, buffered ? "buffered" : "direct", written / (end - start) / 1e6, total,
+	       sum / total, lat[n / 2], lat[n * 99 / 100], lat[n - 1]);
+	return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * KSM scan efficiency test: pages merged per ksmd CPU-second.
+ *
+ * Maps an anonymous MADV_MERGEABLE buffer filled with a handful of
+ * distinct page contents, so that nearly every page can be merged, and
+ * keeps rewriting a fraction of it to give ksmd volatile pages to waste
+ * time on.  Once a second it reports how many pages ksmd merged
+ * (/sys/kernel/mm/ksm/pages_merged) and how much CPU time ksmd used, and
+ * the ratio of the two.  Set /sys/kernel/mm/ksm/run to 1 first; compare
+ * runs with different checksum_sample and volatile_skip_max settings.
+ *
+ * Usage: ksm-merge-rate [size in MiB] [volatile percent] [seconds]
+ *
+ * This is free and unencumbered software released into the public domain.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <err.h>
+#include <time.h>
+#include <unistd.h>
+#include <string.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/mman.h>
+
+#define PAGE_SIZE 4096
+#define KSM_DIR "/sys/kernel/mm/ksm/"
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long read_ksm(const char *name)
+{
+	unsigned long val;
+	char path[64];
+	FILE *f;
+
+	snprintf(path, sizeof(path), KSM_DIR "%s", name);
+	f = fopen(path, "r");
+	if (!f || fscanf(f, "%lu", &val) != 1)
+		err(2, "%s", path);
+	fclose(f);
+	return val;
+}
+
+static int find_ksmd(void)
+{
+	struct dirent *d;
+	char path[PATH_MAX], comm[32];
+	int pid = 0;
+	DIR *dir;
+	FILE *f;
+
+	dir = opendir("/proc");
+	if (!dir)
+		err(2, "/proc");
+	while (!pid && (d = readdir(dir))) {
+		snprintf(path, sizeof(path), "/proc/%s/comm", d->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		if (fgets(comm, sizeof(comm), f) && !strcmp(comm, "ksmd\n"))
+			pid = atoi(d->d_name);
+		fclose(f);
+	}
+	closedir(dir);
+	if (!pid)
+		errx(2, "ksmd not found");
+	return pid;
+}
+
+/* utime + stime of @pid, in seconds */
+static double cpu_time(int pid)
+{
+	unsigned long utime, stime;
+	char path[64];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	f = fopen(path, "r");
+	if (!f || fscanf(f, "%*d (%*[^)]) %*c %*d %*d %*d %*d %*d %*u "
+			 "%*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+		err(2, "%s", path);
+	fclose(f);
+	return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+int main(int argc, char **argv)
+{
+	size_t size = 256, pct = 10, secs = 30, pages, nr_volatile, i;
+	unsigned long merged, last_merged;
+	double t, last_t, cpu, last_cpu, start;
+	int ksmd, s;
+	char *buf;
+
+	if (argc > 1)
+		size = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		pct = strtoul(argv[2], NULL, 0);
+	if (argc > 3)
+		secs = strtoul(argv[3], NULL, 0);
+	if (!size || pct > 100 || !secs)
+		errx(1, "usage: %s [size in MiB] [volatile percent] [seconds]",
+		     argv[0]);
+
+	if (read_ksm("run") != 1)
+		warnx("ksm is not running, echo 1 > " KSM_DIR "run");
+	ksmd = find_ksmd();
+
+	size <<= 20;
+	pages = size / PAGE_SIZE;
+	nr_volatile = pages * pct / 100;
+
+	buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (buf == MAP_FAILED)
+		err(2, "mmap");
+	for (i = 0; i < pages; i++)
+		memset(buf + i * PAGE_SIZE, 1 + i % 16, PAGE_SIZE);
+	if (madvise(buf, size, MADV_MERGEABLE))
+		err(2, "madvise(MADV_MERGEABLE)");
+
+	printf("%zu MiB, %zu volatile pages, %zu s\n",
+	       size >> 20, nr_volatile, secs);
+
+	start = last_t = now();
+	last_cpu = cpu_time(ksmd);
+	last_merged = read_ksm("pages_merged");
+	for (s = 1; s <= secs; s++) {
+		/* dirty the volatile pages until the next report is due */
+		do {
+			for (i = 0; i < nr_volatile; i++)
+				((volatile uint64_t *)(buf + i * PAGE_SIZE))[i % 512]++;
+			t = now();
+		} while (t < start + s);
+
+		cpu = cpu_time(ksmd);
+		merged = read_ksm("pages_merged");
+		printf("%3d s: %8lu merged/s, ksmd %5.1f%% cpu, %10.0f merged/cpu-s\n",
+		       s, (unsigned long)((merged - last_merged) / (t - last_t)),
+		       100 * (cpu - last_cpu) / (t - last_t),
+		       cpu > last_cpu ? (merged - last_merged) / (cpu - last_cpu) : 0);
+		last_t = t;
+		last_cpu = cpu;
+		last_merged = merged;
+	}
+
+	munmap(buf, size);
+	return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * LRU lock scalability across memory cgroups.
+ *
+ * Runs a number of tasks, spread round-robin over a number of memory
+ * cgroups, that each keep faulting in an anonymous buffer and unmapping
+ * it again, so that every page goes onto its memcg's LRU lists and back
+ * off.  Reports the aggregate rate.  With the same number of tasks, the
+ * rate should go up with the number of cgroups, as they no longer share
+ * an LRU lock.
+ *
+ * Requires root and a mounted cgroup v1 memory controller.
+ *
+ * Usage: memcg-lru-scale [tasks] [cgroups] [size in MiB] [seconds]
+ *
+ * This is free and unencumbered software released into the public domain.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <err.h>
+#include <time.h>
+#include <unistd.h>
+#include <string.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define PAGE_SIZE 4096
+#define MEMCG_MNT "/sys/fs/cgroup/memory"
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void cgroup_path(char *buf, size_t len, int parent, int i)
+{
+	if (i < 0)
+		snprintf(buf, len, MEMCG_MNT "/lru-scale-%d", parent);
+	else
+		snprintf(buf, len, MEMCG_MNT "/lru-scale-%d/g%d", parent, i);
+}
+
+static void join_cgroup(const char *dir)
+{
+	char path[PATH_MAX];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/tasks", dir);
+	f = fopen(path, "w");
+	if (!f || fprintf(f, "%d\n", getpid()) < 0 || fclose(f))
+		err(2, "%s", path);
+}
+
+static void worker(size_t size, double end, int fd)
+{
+	unsigned long pages = 0;
+	size_t i;
+	char *buf;
+
+	while (now() < end) {
+		buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			   MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+		if (buf == MAP_FAILED)
+			err(2, "mmap");
+		for (i = 0; i < size; i += PAGE_SIZE)
+			buf[i] = 1;
+		munmap(buf, size);
+		pages += size / PAGE_SIZE;
+	}
+	if (write(fd, &pages, sizeof(pages)) != sizeof(pages))
+		err(2, "write");
+	exit(0);
+}
+
+int main(int argc, char **argv)
+{
+	int tasks = sysconf(_SC_NPROCESSORS_ONLN), cgroups = 1, secs = 10;
+	size_t size = 64;
+	unsigned long pages, total = 0;
+	char path[PATH_MAX];
+	int i, pipefd[2], parent = getpid();
+	double start, end;
+
+	if (argc > 1)
+		tasks = atoi(argv[1]);
+	if (argc > 2)
+		cgroups = atoi(argv[2]);
+	if (argc > 3)
+		size = strtoul(argv[3], NULL, 0);
+	if (argc > 4)
+		secs = atoi(argv[4]);
+	if (tasks <= 0 || cgroups <= 0 || !size || secs <= 0)
+		errx(1, "usage: %s [tasks] [cgroups] [size in MiB] [seconds]",
+		     argv[0]);
+	size <<= 20;
+
+	cgroup_path(path, sizeof(path), parent, -1);
+	if (mkdir(path, 0755))
+		err(2, "mkdir(%s)", path);
+	for (i = 0; i < cgroups; i++) {
+		cgroup_path(path, sizeof(path), parent, i);
+		if (mkdir(path, 0755))
+			err(2, "mkdir(%s)", path);
+	}
+
+	if (pipe(pipefd))
+		err(2, "pipe");
+
+	start = now();
+	end = start + secs;
+	for (i = 0; i < tasks; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			err(2, "fork");
+		if (!pid) {
+			cgroup_path(path, sizeof(path), parent, i % cgroups);
+			join_cgroup(path);
+			worker(size, end, pipefd[1]);
+		}
+	}
+
+	for (i = 0; i < tasks; i++) {
+		if (read(pipefd[0], &pages, sizeof(pages)) != sizeof(pages))
+			err(2, "read");
+		total += pages;
+	}
+	while (wait(NULL) > 0)
+		;
+	end = now();
+
+	for (i = 0; i < cgroups; i++) {
+		cgroup_path(path, sizeof(path), parent, i);
+		rmdir(path);
+	}
+	cgroup_path(path, sizeof(path), parent, -1);
+	rmdir(path);
+
+	printf("%d tasks in %d cgroups: %.0f pages/s (%.0f pages/s per task)\n",
+	       tasks, cgroups, total / (end - start),
+	       total / (end - start) / tasks);
+	return 0;
+}
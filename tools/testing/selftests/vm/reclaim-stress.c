@@ -0,0 +1,89 @@
+/*
+ * Swap-out throughput stress test, mainly for zswap.
+ *
+ * Fills an anonymous buffer with moderately compressible data and then
+ * keeps rewriting it page by page, reporting the rate at which memory
+ * cycles through reclaim.  Run it inside a memory cgroup whose limit is
+ * well below the buffer size (or on a machine with less free RAM than
+ * that), so that every pass has to swap the buffer out and back in.
+ *
+ * Usage: reclaim-stress [size in MiB] [passes]
+ *
+ * This is free and unencumbered software released into the public domain.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <err.h>
+#include <time.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define PAGE_SIZE 4096
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Half of each page pseudo-random, half a repeating pattern: ~2:1 with lzo. */
+static void fill_page(uint64_t *p, uint64_t seed)
+{
+	size_t i, n = PAGE_SIZE / sizeof(*p);
+
+	for (i = 0; i < n / 2; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		p[i] = seed;
+	}
+	for (; i < n; i++)
+		p[i] = 0x0123456789abcdefULL;
+}
+
+int main(int argc, char **argv)
+{
+	size_t size = 1024, passes = 5, pages, i, pass;
+	double start, t;
+	char *buf;
+
+	if (argc > 1)
+		size = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		passes = strtoul(argv[2], NULL, 0);
+	if (!size || !passes)
+		errx(1, "usage: %s [size in MiB] [passes]", argv[0]);
+
+	size <<= 20;
+	pages = size / PAGE_SIZE;
+
+	buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (buf == MAP_FAILED)
+		err(2, "mmap");
+
+	start = now();
+	for (i = 0; i < pages; i++)
+		fill_page((uint64_t *)(buf + i * PAGE_SIZE), i + 1);
+	t = now() - start;
+	printf("fill:    %6.2f GB/s (%zu MiB in %.2f s)\n",
+	       size / t / 1e9, size >> 20, t);
+
+	for (pass = 0; pass < passes; pass++) {
+		start = now();
+		/* touching a page swaps it in and pushes an older one out */
+		for (i = 0; i < pages; i++)
+			((volatile uint64_t *)(buf + i * PAGE_SIZE))[0] += 1;
+		t = now() - start;
+		printf("pass %2zu: %6.2f GB/s (%zu MiB in %.2f s)\n",
+		       pass, size / t / 1e9, size >> 20, t);
+	}
+
+	munmap(buf, size);
+	return 0;
+}
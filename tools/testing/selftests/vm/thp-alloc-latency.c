@@ -0,0 +1,132 @@
+/*
+ * Transparent hugepage fault latency under fragmentation.
+ *
+ * Fragments memory by faulting in a buffer with small pages and then
+ * freeing every other page of it, which leaves free memory scattered in
+ * order-0 blocks.  It then faults in MADV_HUGEPAGE regions one at a time,
+ * with a pause in between, and reports the latency distribution of those
+ * faults and how many of them actually got a hugepage.  Without
+ * background compaction the faults go through direct compaction and the
+ * tail latency grows; with /proc/sys/vm/compaction_proactiveness set it
+ * should stay flat.
+ *
+ * Usage: thp-alloc-latency [fragment MiB] [faults] [pause ms]
+ *
+ * This is free and unencumbered software released into the public domain.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <err.h>
+#include <time.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define PAGE_SIZE 4096
+#define HPAGE_SIZE (2UL << 20)
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* AnonHugePages of this process, in kB */
+static unsigned long anon_huge_kb(void)
+{
+	unsigned long kb, total = 0;
+	char line[256];
+	FILE *f;
+
+	f = fopen("/proc/self/smaps", "r");
+	if (!f)
+		err(2, "/proc/self/smaps");
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+			total += kb;
+	fclose(f);
+	return total;
+}
+
+/* Returns a hugepage aligned, not yet faulted, MADV_HUGEPAGE region. */
+static char *map_hpage(void)
+{
+	char *p, *aligned;
+
+	p = mmap(NULL, 2 * HPAGE_SIZE, PROT_READ | PROT_WRITE,
+		 MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (p == MAP_FAILED)
+		err(2, "mmap");
+	aligned = (char *)(((uintptr_t)p + HPAGE_SIZE - 1) & ~(HPAGE_SIZE - 1));
+	if (madvise(aligned, HPAGE_SIZE, MADV_HUGEPAGE))
+		err(2, "madvise(MADV_HUGEPAGE)");
+	return aligned;
+}
+
+int main(int argc, char **argv)
+{
+	size_t frag = 1024, faults = 256, pause_ms = 10, i;
+	double *lat, t, sum = 0;
+	unsigned long huge;
+	char *buf;
+
+	if (argc > 1)
+		frag = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		faults = strtoul(argv[2], NULL, 0);
+	if (argc > 3)
+		pause_ms = strtoul(argv[3], NULL, 0);
+	if (!faults)
+		errx(1, "usage: %s [fragment MiB] [faults] [pause ms]",
+		     argv[0]);
+
+	lat = calloc(faults, sizeof(*lat));
+	if (!lat)
+		err(2, "calloc");
+
+	if (frag) {
+		frag <<= 20;
+		buf = mmap(NULL, frag, PROT_READ | PROT_WRITE,
+			   MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+		if (buf == MAP_FAILED)
+			err(2, "mmap");
+		if (madvise(buf, frag, MADV_NOHUGEPAGE))
+			err(2, "madvise(MADV_NOHUGEPAGE)");
+		for (i = 0; i < frag; i += PAGE_SIZE)
+			buf[i] = 1;
+		for (i = 0; i < frag; i += 2 * PAGE_SIZE)
+			madvise(buf + i, PAGE_SIZE, MADV_DONTNEED);
+		printf("fragmented %zu MiB\n", frag >> 20);
+	}
+
+	for (i = 0; i < faults; i++) {
+		char *p = map_hpage();
+
+		t = now();
+		*(volatile char *)p = 1;
+		lat[i] = (now() - t) * 1e6;
+		sum += lat[i];
+		if (pause_ms)
+			usleep(pause_ms * 1000);
+	}
+	huge = anon_huge_kb() / (HPAGE_SIZE >> 10);
+
+	qsort(lat, faults, sizeof(*lat), cmp_double);
+	printf("%zu faults, %lu hugepages (%.1f%%)\n", faults, huge,
+	       100.0 * huge / faults);
+	printf("latency usecs: avg %.1f p50 %.1f p90 %.1f p99 %.1f max %.1f\n",
+	       sum / faults, lat[faults / 2], lat[faults * 9 / 10],
+	       lat[faults * 99 / 100], lat[faults - 1]);
+	return 0;
+}